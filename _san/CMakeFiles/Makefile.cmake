@@ -0,0 +1,88 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/bench/CMakeLists.txt"
+  "/root/repo/tests/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFile.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPython/Support.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPython3.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "tests/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "bench/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "CMakeFiles/serial_log.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_record.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_tags.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_dump.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_binary.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_stats.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_dma.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_dma_async.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_formatter.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_formatter_float.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_threads.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_threads_async.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_overflow.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_async_init.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_cpp.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_cpp_format_error.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_payload.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_cbor.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_dedup.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_rate.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_recorder.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_compact.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_index.dir/DependInfo.cmake"
+  "tests/CMakeFiles/test_compress.dir/DependInfo.cmake"
+  "bench/CMakeFiles/bench_libc.dir/DependInfo.cmake"
+  "bench/CMakeFiles/bench_formatter.dir/DependInfo.cmake"
+  "bench/CMakeFiles/bench_pool.dir/DependInfo.cmake"
+  "bench/CMakeFiles/bench_async.dir/DependInfo.cmake"
+  "bench/CMakeFiles/bench.dir/DependInfo.cmake"
+  )
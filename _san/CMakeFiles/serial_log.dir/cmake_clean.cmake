@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/serial_log.dir/serial_log.c.o"
+  "CMakeFiles/serial_log.dir/serial_log.c.o.d"
+  "libserial_log.a"
+  "libserial_log.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/serial_log.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
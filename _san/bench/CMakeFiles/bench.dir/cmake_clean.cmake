@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../async.json"
+  "../formatter.json"
+  "../libc.json"
+  "../pool.json"
+  "CMakeFiles/bench"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang )
+  include(CMakeFiles/bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
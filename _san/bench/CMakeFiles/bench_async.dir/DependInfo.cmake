@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/serial_log.c" "bench/CMakeFiles/bench_async.dir/__/serial_log.c.o" "gcc" "bench/CMakeFiles/bench_async.dir/__/serial_log.c.o.d"
+  "/root/repo/tests/serial_log_mock.c" "bench/CMakeFiles/bench_async.dir/__/tests/serial_log_mock.c.o" "gcc" "bench/CMakeFiles/bench_async.dir/__/tests/serial_log_mock.c.o.d"
+  "/root/repo/bench/serial_log_bench.c" "bench/CMakeFiles/bench_async.dir/serial_log_bench.c.o" "gcc" "bench/CMakeFiles/bench_async.dir/serial_log_bench.c.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
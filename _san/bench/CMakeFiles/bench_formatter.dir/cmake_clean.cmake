@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bench_formatter.dir/__/serial_log.c.o"
+  "CMakeFiles/bench_formatter.dir/__/serial_log.c.o.d"
+  "CMakeFiles/bench_formatter.dir/__/tests/serial_log_mock.c.o"
+  "CMakeFiles/bench_formatter.dir/__/tests/serial_log_mock.c.o.d"
+  "CMakeFiles/bench_formatter.dir/serial_log_bench.c.o"
+  "CMakeFiles/bench_formatter.dir/serial_log_bench.c.o.d"
+  "bench_formatter"
+  "bench_formatter.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/bench_formatter.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
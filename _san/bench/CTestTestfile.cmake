@@ -0,0 +1,14 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/bench
+# Build directory: /root/repo/_san/bench
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(bench_libc "/root/repo/_san/bench/bench_libc" "--records" "1000" "--format" "csv")
+set_tests_properties(bench_libc PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/bench/CMakeLists.txt;26;add_test;/root/repo/bench/CMakeLists.txt;0;")
+add_test(bench_formatter "/root/repo/_san/bench/bench_formatter" "--records" "1000" "--format" "csv")
+set_tests_properties(bench_formatter PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/bench/CMakeLists.txt;26;add_test;/root/repo/bench/CMakeLists.txt;0;")
+add_test(bench_pool "/root/repo/_san/bench/bench_pool" "--records" "1000" "--format" "csv")
+set_tests_properties(bench_pool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/bench/CMakeLists.txt;26;add_test;/root/repo/bench/CMakeLists.txt;0;")
+add_test(bench_async "/root/repo/_san/bench/bench_async" "--records" "1000" "--format" "csv")
+set_tests_properties(bench_async PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/bench/CMakeLists.txt;26;add_test;/root/repo/bench/CMakeLists.txt;0;")
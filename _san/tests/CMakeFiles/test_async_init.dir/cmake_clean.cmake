@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_async_init.dir/__/serial_log.c.o"
+  "CMakeFiles/test_async_init.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_async_init.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_async_init.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_async_init.dir/test_async_init.c.o"
+  "CMakeFiles/test_async_init.dir/test_async_init.c.o.d"
+  "test_async_init"
+  "test_async_init.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_async_init.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_binary.dir/__/serial_log.c.o"
+  "CMakeFiles/test_binary.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_binary.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_binary.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_binary.dir/test_binary.c.o"
+  "CMakeFiles/test_binary.dir/test_binary.c.o.d"
+  "test_binary"
+  "test_binary.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_binary.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
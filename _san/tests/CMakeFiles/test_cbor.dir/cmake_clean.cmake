@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_cbor.dir/__/serial_log.c.o"
+  "CMakeFiles/test_cbor.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_cbor.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_cbor.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_cbor.dir/test_cbor.c.o"
+  "CMakeFiles/test_cbor.dir/test_cbor.c.o.d"
+  "test_cbor"
+  "test_cbor.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_cbor.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
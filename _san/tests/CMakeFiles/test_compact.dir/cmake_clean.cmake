@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_compact.dir/__/serial_log.c.o"
+  "CMakeFiles/test_compact.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_compact.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_compact.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_compact.dir/test_compact.c.o"
+  "CMakeFiles/test_compact.dir/test_compact.c.o.d"
+  "test_compact"
+  "test_compact.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_compact.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_compress.dir/__/serial_log.c.o"
+  "CMakeFiles/test_compress.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_compress.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_compress.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_compress.dir/test_compress.c.o"
+  "CMakeFiles/test_compress.dir/test_compress.c.o.d"
+  "test_compress"
+  "test_compress.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_compress.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_cpp.dir/__/serial_log.c.o"
+  "CMakeFiles/test_cpp.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_cpp.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_cpp.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_cpp.dir/test_cpp.cpp.o"
+  "CMakeFiles/test_cpp.dir/test_cpp.cpp.o.d"
+  "test_cpp"
+  "test_cpp.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C CXX)
+  include(CMakeFiles/test_cpp.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
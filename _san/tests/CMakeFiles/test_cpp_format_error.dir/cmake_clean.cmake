@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_cpp_format_error.dir/__/serial_log.c.o"
+  "CMakeFiles/test_cpp_format_error.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_cpp_format_error.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_cpp_format_error.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_cpp_format_error.dir/test_cpp_format_error.cpp.o"
+  "CMakeFiles/test_cpp_format_error.dir/test_cpp_format_error.cpp.o.d"
+  "test_cpp_format_error"
+  "test_cpp_format_error.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C CXX)
+  include(CMakeFiles/test_cpp_format_error.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
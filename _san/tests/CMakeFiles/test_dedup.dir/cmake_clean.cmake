@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_dedup.dir/__/serial_log.c.o"
+  "CMakeFiles/test_dedup.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_dedup.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_dedup.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_dedup.dir/test_dedup.c.o"
+  "CMakeFiles/test_dedup.dir/test_dedup.c.o.d"
+  "test_dedup"
+  "test_dedup.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_dedup.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
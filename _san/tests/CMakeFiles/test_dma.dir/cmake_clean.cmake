@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_dma.dir/__/serial_log.c.o"
+  "CMakeFiles/test_dma.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_dma.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_dma.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_dma.dir/test_dma.c.o"
+  "CMakeFiles/test_dma.dir/test_dma.c.o.d"
+  "test_dma"
+  "test_dma.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_dma.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
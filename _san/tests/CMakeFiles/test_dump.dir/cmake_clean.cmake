@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_dump.dir/__/serial_log.c.o"
+  "CMakeFiles/test_dump.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_dump.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_dump.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_dump.dir/test_dump.c.o"
+  "CMakeFiles/test_dump.dir/test_dump.c.o.d"
+  "test_dump"
+  "test_dump.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_dump.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_formatter.dir/__/serial_log.c.o"
+  "CMakeFiles/test_formatter.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_formatter.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_formatter.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_formatter.dir/test_formatter.c.o"
+  "CMakeFiles/test_formatter.dir/test_formatter.c.o.d"
+  "test_formatter"
+  "test_formatter.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_formatter.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
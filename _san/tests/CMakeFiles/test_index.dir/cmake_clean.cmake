@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_index.dir/__/serial_log.c.o"
+  "CMakeFiles/test_index.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_index.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_index.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_index.dir/test_index.c.o"
+  "CMakeFiles/test_index.dir/test_index.c.o.d"
+  "test_index"
+  "test_index.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_index.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
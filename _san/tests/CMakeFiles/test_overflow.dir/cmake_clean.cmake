@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_overflow.dir/__/serial_log.c.o"
+  "CMakeFiles/test_overflow.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_overflow.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_overflow.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_overflow.dir/test_overflow.c.o"
+  "CMakeFiles/test_overflow.dir/test_overflow.c.o.d"
+  "test_overflow"
+  "test_overflow.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_overflow.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
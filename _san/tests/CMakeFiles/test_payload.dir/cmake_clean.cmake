@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_payload.dir/__/serial_log.c.o"
+  "CMakeFiles/test_payload.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_payload.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_payload.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_payload.dir/test_payload.c.o"
+  "CMakeFiles/test_payload.dir/test_payload.c.o.d"
+  "test_payload"
+  "test_payload.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_payload.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
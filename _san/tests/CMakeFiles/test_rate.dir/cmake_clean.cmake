@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_rate.dir/__/serial_log.c.o"
+  "CMakeFiles/test_rate.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_rate.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_rate.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_rate.dir/test_rate.c.o"
+  "CMakeFiles/test_rate.dir/test_rate.c.o.d"
+  "test_rate"
+  "test_rate.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_rate.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_record.dir/__/serial_log.c.o"
+  "CMakeFiles/test_record.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_record.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_record.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_record.dir/test_record.c.o"
+  "CMakeFiles/test_record.dir/test_record.c.o.d"
+  "test_record"
+  "test_record.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_record.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_recorder.dir/__/serial_log.c.o"
+  "CMakeFiles/test_recorder.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_recorder.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_recorder.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_recorder.dir/test_recorder.c.o"
+  "CMakeFiles/test_recorder.dir/test_recorder.c.o.d"
+  "test_recorder"
+  "test_recorder.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_recorder.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_stats.dir/__/serial_log.c.o"
+  "CMakeFiles/test_stats.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_stats.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_stats.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_stats.dir/test_stats.c.o"
+  "CMakeFiles/test_stats.dir/test_stats.c.o.d"
+  "test_stats"
+  "test_stats.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_stats.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
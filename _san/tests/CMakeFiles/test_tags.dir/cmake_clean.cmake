@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_tags.dir/__/serial_log.c.o"
+  "CMakeFiles/test_tags.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_tags.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_tags.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_tags.dir/test_tags.c.o"
+  "CMakeFiles/test_tags.dir/test_tags.c.o.d"
+  "test_tags"
+  "test_tags.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_tags.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_threads.dir/__/serial_log.c.o"
+  "CMakeFiles/test_threads.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_threads.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_threads.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_threads.dir/test_threads.c.o"
+  "CMakeFiles/test_threads.dir/test_threads.c.o.d"
+  "test_threads"
+  "test_threads.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_threads.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
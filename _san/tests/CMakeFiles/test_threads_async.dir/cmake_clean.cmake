@@ -0,0 +1,15 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/test_threads_async.dir/__/serial_log.c.o"
+  "CMakeFiles/test_threads_async.dir/__/serial_log.c.o.d"
+  "CMakeFiles/test_threads_async.dir/serial_log_mock.c.o"
+  "CMakeFiles/test_threads_async.dir/serial_log_mock.c.o.d"
+  "CMakeFiles/test_threads_async.dir/test_threads.c.o"
+  "CMakeFiles/test_threads_async.dir/test_threads.c.o.d"
+  "test_threads_async"
+  "test_threads_async.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang C)
+  include(CMakeFiles/test_threads_async.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,62 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_san/tests
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(record "/root/repo/_san/tests/test_record")
+set_tests_properties(record PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;5;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(tags "/root/repo/_san/tests/test_tags")
+set_tests_properties(tags PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;8;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(dump "/root/repo/_san/tests/test_dump")
+set_tests_properties(dump PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;11;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(binary "/root/repo/_san/tests/test_binary")
+set_tests_properties(binary PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;14;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(stats "/root/repo/_san/tests/test_stats")
+set_tests_properties(stats PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;17;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(dma "/root/repo/_san/tests/test_dma")
+set_tests_properties(dma PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;20;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(dma_async "/root/repo/_san/tests/test_dma_async")
+set_tests_properties(dma_async PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;22;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(formatter "/root/repo/_san/tests/test_formatter")
+set_tests_properties(formatter PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;25;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(formatter_float "/root/repo/_san/tests/test_formatter_float")
+set_tests_properties(formatter_float PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;27;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(threads "/root/repo/_san/tests/test_threads")
+set_tests_properties(threads PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;30;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(threads_async "/root/repo/_san/tests/test_threads_async")
+set_tests_properties(threads_async PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;32;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(overflow "/root/repo/_san/tests/test_overflow")
+set_tests_properties(overflow PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;35;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(async_init "/root/repo/_san/tests/test_async_init")
+set_tests_properties(async_init PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;39;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(cpp "/root/repo/_san/tests/test_cpp")
+set_tests_properties(cpp PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;42;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(cpp_format_error "/usr/bin/cmake" "--build" "/root/repo/_san" "--target" "test_cpp_format_error")
+set_tests_properties(cpp_format_error PROPERTIES  PASS_REGULAR_EXPRESSION "argument is wider than its conversion" _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;47;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(payload "/root/repo/_san/tests/test_payload")
+set_tests_properties(payload PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;53;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(cbor "/root/repo/_san/tests/test_cbor")
+set_tests_properties(cbor PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;56;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(dedup "/root/repo/_san/tests/test_dedup")
+set_tests_properties(dedup PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;59;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(rate "/root/repo/_san/tests/test_rate")
+set_tests_properties(rate PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;62;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(recorder "/root/repo/_san/tests/test_recorder")
+set_tests_properties(recorder PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;65;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(compact "/root/repo/_san/tests/test_compact")
+set_tests_properties(compact PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;69;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(index "/root/repo/_san/tests/test_index")
+set_tests_properties(index PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;72;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(compress "/root/repo/_san/tests/test_compress")
+set_tests_properties(compress PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;75;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(compact_tool "/usr/bin/cmake" "-DPROGRAM=/root/repo/_san/tests/test_compact" "-DPYTHON=/root/.pyenv/shims/python3" "-DTOOL=/root/repo/tools/serial_log_compact.py" "-DTOOL_ARGS=@CAPTURE@" "-DTOOL_RESULT=0" "-DNAME=compact_tool" "-P" "/root/repo/tests/tool_test.cmake")
+set_tests_properties(compact_tool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;95;serial_log_tool_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(compress_tool "/usr/bin/cmake" "-DPROGRAM=/root/repo/_san/tests/test_compress" "-DPYTHON=/root/.pyenv/shims/python3" "-DTOOL=/root/repo/tools/serial_log_decompress.py" "-DTOOL_ARGS=@CAPTURE@" "-DTOOL_RESULT=0" "-DNAME=compress_tool" "-P" "/root/repo/tests/tool_test.cmake")
+set_tests_properties(compress_tool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;96;serial_log_tool_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(index_tool "/usr/bin/cmake" "-DPROGRAM=/root/repo/_san/tests/test_index" "-DPYTHON=/root/.pyenv/shims/python3" "-DTOOL=/root/repo/tools/serial_log_index.py" "-DTOOL_ARGS=query;@CAPTURE@;--tag;net.*;--level;W;--since;20000;--until;45000" "-DTOOL_RESULT=0" "-DNAME=index_tool" "-P" "/root/repo/tests/tool_test.cmake")
+set_tests_properties(index_tool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;97;serial_log_tool_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(cbor_tool "/usr/bin/cmake" "-DPROGRAM=/root/repo/_san/tests/test_cbor" "-DPYTHON=/root/.pyenv/shims/python3" "-DTOOL=/root/repo/tools/serial_log_cbor.py" "-DTOOL_ARGS=@CAPTURE@" "-DTOOL_RESULT=0" "-DNAME=cbor_tool" "-P" "/root/repo/tests/tool_test.cmake")
+set_tests_properties(cbor_tool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;99;serial_log_tool_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(payload_tool "/usr/bin/cmake" "-DPROGRAM=/root/repo/_san/tests/test_payload" "-DPYTHON=/root/.pyenv/shims/python3" "-DTOOL=/root/repo/tools/serial_log_payload.py" "-DTOOL_ARGS=@CAPTURE@;-o;@FILES@" "-DTOOL_RESULT=1" "-DNAME=payload_tool" "-P" "/root/repo/tests/tool_test.cmake")
+set_tests_properties(payload_tool PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;101;serial_log_tool_test;/root/repo/tests/CMakeLists.txt;0;")
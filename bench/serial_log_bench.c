@@ -0,0 +1,363 @@
+/*
+ * Caller-side cost of logging, in nanoseconds per call, for the library in the
+ * configuration it is built with. Records go to a log function which only
+ * counts the bytes, so the results leave out the cost of a real sink, except
+ * for slow_sink_burst: bursts of records to a sink that takes as long as a
+ * UART of the given baud rate, which the caller waits for in a sync build.
+ *
+ * Usage:
+ *     bench_libc [--records N] [--baud N] [--format json|csv] [--output FILE]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "serial_log_mock.h"
+
+#ifndef SERIAL_LOG_BENCH_CONFIG
+#define SERIAL_LOG_BENCH_CONFIG "default"
+#endif
+
+/* Distinct tag pointers for the cache miss and tag fallback cases */
+#define BENCH_TAG_COUNT     1024
+
+/* Bytes per buffer dump */
+#define BENCH_DUMP_SIZE     4096
+
+/* Most threads of the contention cases */
+#define BENCH_THREADS_MAX   8
+
+/* Records per burst to the slow sink, they fit the default async queue */
+#define BENCH_BURST         8
+
+/* Bytes per line of the legacy dump, as in serial_log.c */
+#ifndef BYTES_PER_LINE
+#define BYTES_PER_LINE      16
+#endif
+
+typedef struct {
+    const char *name;
+    double ns_per_op;
+} bench_result_t;
+
+static bench_result_t bench_results[32];
+static int bench_result_count = 0;
+static uint32_t bench_records = 200000;
+static uint32_t bench_baud = 921600;
+
+static char bench_tags[BENCH_TAG_COUNT][8];
+static SERIAL_LOG_TAG_DEFINE(bench_tag, "bench");
+static char bench_dump[BENCH_DUMP_SIZE];
+
+static void bench_add(const char *name, uint64_t ns, uint32_t ops)
+{
+    bench_results[bench_result_count].name = name;
+    bench_results[bench_result_count].ns_per_op = (double)ns / ops;
+    bench_result_count++;
+}
+
+static void bench_filtered(void)
+{
+    /* Level below the global limit, rejected by the inline check */
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    uint64_t start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGV("bench", "filtered %u", i);
+    }
+    bench_add("filtered_level", mock_time_ns() - start, bench_records);
+
+    /* Level the global limit lets through, rejected by the tag level */
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+    serial_log_level_set("bench", SERIAL_LOG_WARN);
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI("bench", "filtered %u", i);
+    }
+    bench_add("filtered_tag", mock_time_ns() - start, bench_records);
+
+    /* Same through a descriptor, rejected by its level alone */
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI_TAG(&bench_tag, "filtered %u", i);
+    }
+    bench_add("filtered_descriptor", mock_time_ns() - start, bench_records);
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+}
+
+static void bench_cache(void)
+{
+    uint64_t start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI("bench", "hit");
+    }
+    bench_add("cache_hit", mock_time_ns() - start, bench_records);
+
+    /* More tag pointers than cache entries, each lookup misses */
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI(bench_tags[i % BENCH_TAG_COUNT], "miss");
+    }
+    bench_add("cache_miss", mock_time_ns() - start, bench_records);
+}
+
+static void bench_tag_fallback(void)
+{
+    /* Misses resolved from a table of N tags with their own level */
+    static const struct {
+        const char *name;
+        uint32_t tags;
+    } cases[] = {
+        { "tag_fallback_16", 16 },
+        { "tag_fallback_256", 256 },
+        { "tag_fallback_1024", 1024 },
+    };
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+        for (uint32_t t = 0; t < cases[c].tags; t++)
+        {
+            serial_log_level_set(bench_tags[t], SERIAL_LOG_INFO);
+        }
+        uint64_t start = mock_time_ns();
+        for (uint32_t i = 0; i < bench_records; i++)
+        {
+            SERIAL_LOGI(bench_tags[i % BENCH_TAG_COUNT], "fallback");
+        }
+        bench_add(cases[c].name, mock_time_ns() - start, bench_records);
+    }
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+}
+
+static void bench_format(void)
+{
+    uint64_t start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI("bench", "value %d", (int)i);
+    }
+    bench_add("format_int", mock_time_ns() - start, bench_records);
+
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < bench_records; i++)
+    {
+        SERIAL_LOGI("bench", "%s %u bytes from %08x: %-6d|%c", "packet", i, i * 2654435761u, -(int)i, 'x');
+    }
+    bench_add("format_mixed", mock_time_ns() - start, bench_records);
+}
+
+/* Hex dump as the library did before dumps were formatted in place: a
+   sprintf per byte and a whole record per line. The loop bound is the line,
+   the original ran over the rest of the buffer. */
+static void bench_dump_legacy(const char *tag, const char *buffer, uint16_t buff_len,
+                              serial_log_level_t log_level)
+{
+    char hex_buffer[3 * BYTES_PER_LINE + 1];
+    int bytes_current_line;
+
+    do {
+        bytes_current_line = buff_len > BYTES_PER_LINE ? BYTES_PER_LINE : buff_len;
+        for (int i = 0; i < bytes_current_line; i++)
+        {
+            sprintf(&hex_buffer[i * 3], "%02x ", (uint8_t)buffer[i]);
+        }
+        SERIAL_LOG_LEVEL(log_level, tag, "%s", hex_buffer);
+        buff_len -= bytes_current_line;
+        buffer += bytes_current_line;
+    } while (buff_len);
+}
+
+static void bench_buffer_dump(void)
+{
+    /* Fewer dumps than records, each is 256 lines */
+    uint32_t dumps = bench_records / 256 ? bench_records / 256 : 1;
+    uint64_t start = mock_time_ns();
+    for (uint32_t i = 0; i < dumps; i++)
+    {
+        SERIAL_LOG_BUFFER_HEX("bench", bench_dump, BENCH_DUMP_SIZE);
+    }
+    bench_add("dump_hex_4k", mock_time_ns() - start, dumps);
+
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < dumps; i++)
+    {
+        bench_dump_legacy("bench", bench_dump, BENCH_DUMP_SIZE, SERIAL_LOG_INFO);
+    }
+    bench_add("dump_hex_4k_legacy", mock_time_ns() - start, dumps);
+
+    start = mock_time_ns();
+    for (uint32_t i = 0; i < dumps; i++)
+    {
+        SERIAL_LOG_BUFFER_CHAR("bench", bench_dump, BENCH_DUMP_SIZE);
+    }
+    bench_add("dump_char_4k", mock_time_ns() - start, dumps);
+}
+
+static void bench_uart_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    /* Busy for the time the bytes take on the wire, 10 bits a byte */
+    (void)data;
+    (void)timeout_ms;
+    uint64_t end = mock_time_ns() + (uint64_t)len * 10 * 1000000000u / bench_baud;
+    while (mock_time_ns() < end);
+}
+
+static void bench_slow_sink(void)
+{
+    /* Caller time of the bursts only, the queue is written out in between */
+    uint32_t bursts = bench_records / 2000 ? bench_records / 2000 : 1;
+    uint64_t total = 0;
+    serial_log_flush();
+    serial_log_function_set(bench_uart_log, mock_tick);
+    for (uint32_t b = 0; b < bursts; b++)
+    {
+        uint64_t start = mock_time_ns();
+        for (int i = 0; i < BENCH_BURST; i++)
+        {
+            SERIAL_LOGI("bench", "burst %u record %d", b, i);
+        }
+        total += mock_time_ns() - start;
+        serial_log_flush();
+    }
+    bench_add("slow_sink_burst", total, bursts * BENCH_BURST);
+    serial_log_function_set(mock_log_null, mock_tick);
+}
+
+#ifdef USE_PTHREAD
+static void *bench_thread(void *arg)
+{
+    uint32_t records = *(uint32_t*)arg;
+    for (uint32_t i = 0; i < records; i++)
+    {
+        SERIAL_LOGI("bench", "thread record %u", i);
+    }
+    return NULL;
+}
+
+static void bench_contention(void)
+{
+    /* Wall time over the records of all threads */
+    static const char *names[] = { "contention_1", "contention_2", "contention_4", "contention_8" };
+    int index = 0;
+
+    for (int threads = 1; threads <= BENCH_THREADS_MAX; threads *= 2, index++)
+    {
+        pthread_t thread[BENCH_THREADS_MAX];
+        uint32_t records = bench_records / threads;
+        uint64_t start = mock_time_ns();
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_create(&thread[t], NULL, bench_thread, &records);
+        }
+        for (int t = 0; t < threads; t++)
+        {
+            pthread_join(thread[t], NULL);
+        }
+        bench_add(names[index], mock_time_ns() - start, records * threads);
+    }
+}
+#endif
+
+static void bench_print(FILE *out, bool csv)
+{
+    if (csv)
+    {
+        fprintf(out, "config,records,case,ns_per_op\n");
+        for (int i = 0; i < bench_result_count; i++)
+        {
+            fprintf(out, "%s,%u,%s,%.1f\n", SERIAL_LOG_BENCH_CONFIG, bench_records,
+                    bench_results[i].name, bench_results[i].ns_per_op);
+        }
+        return;
+    }
+
+    fprintf(out, "{\"config\": \"%s\", \"records\": %u, \"results\": [", SERIAL_LOG_BENCH_CONFIG, bench_records);
+    for (int i = 0; i < bench_result_count; i++)
+    {
+        fprintf(out, "%s\n  {\"case\": \"%s\", \"ns_per_op\": %.1f}", i ? "," : "",
+                bench_results[i].name, bench_results[i].ns_per_op);
+    }
+    fprintf(out, "\n]}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    bool csv = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--records") == 0 && i + 1 < argc)
+        {
+            bench_records = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc)
+        {
+            bench_baud = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            csv = strcmp(argv[++i], "csv") == 0;
+        }
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--records N] [--baud N] [--format json|csv] [--output FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (bench_records == 0)
+    {
+        bench_records = 1;
+    }
+    if (bench_baud == 0)
+    {
+        bench_baud = 921600;
+    }
+
+    for (int i = 0; i < BENCH_TAG_COUNT; i++)
+    {
+        snprintf(bench_tags[i], sizeof(bench_tags[i]), "t%d", i);
+    }
+    for (int i = 0; i < BENCH_DUMP_SIZE; i++)
+    {
+        bench_dump[i] = (char)(' ' + i % 95);
+    }
+
+    serial_log_function_set(mock_log_null, mock_tick);
+    bench_filtered();
+    bench_cache();
+    bench_tag_fallback();
+    bench_format();
+    bench_buffer_dump();
+    bench_slow_sink();
+#ifdef USE_PTHREAD
+    bench_contention();
+#endif
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out)
+    {
+        perror(output);
+        return 1;
+    }
+    bench_print(out, csv);
+    if (output)
+    {
+        fclose(out);
+    }
+    return 0;
+}
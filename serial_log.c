@@ -1,276 +1,4432 @@
+/* POSIX calls of the host build, also declared under -std=c11 */
+#if defined(__linux__) && !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
+#include <float.h>
 
 //#define USE_RTOS
+//#define USE_PTHREAD
 
-#ifdef USE_RTOS
-#include "FreeRTOS.h"
-#include "queue.h"
-#include "task.h"
-#include "semphr.h"
-#endif
+/* Format records with the built-in formatter instead of libc vsnprintf */
+//#define USE_LOG_FORMATTER
+
+/* Support %f in the built-in formatter, as fixed point with up to 9 decimals
+   for values below 2^128 */
+//#define LOG_FORMATTER_FLOAT
+
+/* With USE_LOG_COMPACT, stamp records with the hex difference to the record
+   stamped before instead of the time. Every LOG_COMPACT_RESYNC-th record
+   still takes the time, which the reader adds the differences up from. */
+//#define LOG_COMPACT_DELTA
+
+/* With USE_LOG_COMPACT, output tags as "#" and a 16 bit hash in hex, which
+   tools/serial_log_compact.py turns back into names */
+//#define LOG_COMPACT_TAG_ID
+
+/* Queue records in a ring buffer and output them from a drain task instead of
+   calling the log function from the caller's context */
+//#define USE_LOG_ASYNC
+
+/* Allow sinks to hand filled buffers to a DMA transfer and keep formatting
+   into the next buffer while it runs, see serial_log_dma_complete */
+//#define USE_LOG_DMA
+
+/* Allow sinks to compress their output, see tools/serial_log_decompress.py */
+//#define USE_LOG_COMPRESS
+
+/* Take tag entries from a static pool of LOG_TAG_POOL_SIZE bytes instead of
+   malloc, for builds without a heap */
+//#define USE_LOG_STATIC
+
+/* Count records, bytes and cache use for serial_log_stats_get */
+//#define USE_LOG_STATS
 
 #include "sys/queue.h"
 #include "serial_log.h"
+#include "serial_log_port.h"
+
+/* Sizes and counts below can be set from the build, for example
+   -DLOG_BUF_SIZE=128. See tools/serial_log_footprint.py for the memory each
+   configuration takes. */
 
 /* Print number of bytes per line for serial_log_buffer_char and serial_log_buffer_hex */
+#ifndef BYTES_PER_LINE
 #define BYTES_PER_LINE      16
+#endif
+
+/* Number of tags to be cached. Must be 2**n. */
+#ifndef TAG_CACHE_SIZE
+#define TAG_CACHE_SIZE      32
+#endif
 
-/* Number of tags to be cached. Must be 2**n - 1, n >= 2. */
-#define TAG_CACHE_SIZE      31
+/* Number of hash buckets for tags set with serial_log_level_set. Must be 2**n. */
+#ifndef TAG_HASH_SIZE
+#define TAG_HASH_SIZE       64
+#endif
+
+/* Bytes of tag entries and tag strings with USE_LOG_STATIC. An entry takes
+   about 20 bytes plus its tag, tags beyond the pool keep the default level. */
+#ifndef LOG_TAG_POOL_SIZE
+#define LOG_TAG_POOL_SIZE   512
+#endif
 
 /* Buffer for UART */
+#ifndef LOG_BUF_SIZE
 #define LOG_BUF_SIZE        256
+#endif
 
+/* Longest record prefix of a buffer dump, longer tags are cut */
+#ifndef LOG_DUMP_PREFIX_SIZE
+#define LOG_DUMP_PREFIX_SIZE        48
+#endif
 
-/* Maximum time to wait for the mutex in a logging statement */
-#ifdef USE_RTOS
-#define MAX_MUTEX_WAIT_MS   10
-#define MAX_MUTEX_WAIT_TICKS ((MAX_MUTEX_WAIT_MS + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS)
+/* Space reserved in front of the message for the formatted timestamp */
+#define LOG_STAMP_SIZE              24
+
+/* With LOG_COMPACT_DELTA, records between two that are stamped with the
+   time. Records a sink filters or drops shift the times read back until the
+   next of these. */
+#ifndef LOG_COMPACT_RESYNC
+#define LOG_COMPACT_RESYNC          32
+#endif
+
+/* Room for a tag turned into its id by log_tag_text */
+#define LOG_TAG_TEXT_SIZE           6
+
+/* Most segments passed to the vectored log function in one call */
+#define LOG_SINK_IOV_MAX            8
+
+/* Longest message of a text record, longer ones are cut and end with
+   LOG_TRUNCATED_MARK. Messages longer than the buffer are output in pieces,
+   formatted again for each piece, which needs the built-in formatter: libc
+   vsnprintf can not start in the middle of a message. */
+#ifndef LOG_RECORD_MAX
+#ifdef USE_LOG_FORMATTER
+#define LOG_RECORD_MAX              (4 * LOG_BUF_SIZE)
+#else
+#define LOG_RECORD_MAX              (LOG_BUF_SIZE - LOG_STAMP_SIZE - 1)
+#endif
+#endif
+#ifndef LOG_TRUNCATED_MARK
+#define LOG_TRUNCATED_MARK          "[...]"
+#endif
+
+/* Binary record header: sync, level, argument length, timestamp, format and tag address */
+#define LOG_BINARY_SYNC             0xA5
+#define LOG_BINARY_HEADER_SIZE      16
+
+/* Set in the level byte of a binary record whose timestamp is in microseconds */
+#define LOG_BINARY_LEVEL_US         0x80
+
+/* Set in the level byte of a binary record whose arguments are a CBOR map of fields */
+#define LOG_BINARY_LEVEL_KV         0x40
+
+/* CBOR record: the self-describe tag 55799 marks the start of each record for
+   resync, then a map with these integer keys */
+#define LOG_CBOR_SYNC               "\xD9\xD9\xF7"
+#define LOG_CBOR_KEY_LEVEL          0
+#define LOG_CBOR_KEY_TICK           1
+#define LOG_CBOR_KEY_TAG            2
+#define LOG_CBOR_KEY_MESSAGE        3
+#define LOG_CBOR_KEY_FIELDS         4
+#define LOG_CBOR_KEY_TIME_US        5
+
+/* CBOR major types */
+#define LOG_CBOR_UINT               0
+#define LOG_CBOR_NEGINT             1
+#define LOG_CBOR_BYTES              2
+#define LOG_CBOR_TEXT               3
+#define LOG_CBOR_MAP                5
+
+/* Room for the CBOR record head, the parts around tag and message */
+#define LOG_CBOR_HEAD_SIZE          40
+
+/* Number of formatting buffers shared by all callers when thread local storage
+   is not available. Callers which find none free drop their record. Max 32. */
+#ifndef LOG_BUF_POOL_SIZE
+#define LOG_BUF_POOL_SIZE           4
+#endif
+
+/* Number of records in the async ring buffer. Must be 2**n. */
+#ifndef LOG_ASYNC_RING_SIZE
+#define LOG_ASYNC_RING_SIZE         16
+#endif
+
+/* Slots of each async ring only ERROR and WARN records may take under
+   SERIAL_LOG_OVERFLOW_PRIORITY */
+#ifndef LOG_ASYNC_RESERVE
+#define LOG_ASYNC_RESERVE           4
+#endif
+
+/* Room for the notice of dropped records the drain task outputs */
+#define LOG_ASYNC_NOTICE_SIZE       96
+
+/* Most slots one record takes, records longer than a slot take consecutive ones */
+#define LOG_ASYNC_PARTS_MAX         ((LOG_ASYNC_RING_SIZE - LOG_ASYNC_RESERVE < 255) ? \
+                                     LOG_ASYNC_RING_SIZE - LOG_ASYNC_RESERVE : 255)
+
+/* Records the drain task copies out of the ring for one call to the log
+   function, so slow output never holds ring slots. At least LOG_BUF_SIZE. */
+#ifndef LOG_ASYNC_BATCH_SIZE
+#define LOG_ASYNC_BATCH_SIZE        (2 * LOG_BUF_SIZE)
+#endif
+
+/* Drain task configuration */
+#ifndef LOG_ASYNC_TASK_STACK
+#define LOG_ASYNC_TASK_STACK        512
+#endif
+#ifndef LOG_ASYNC_TASK_PRIORITY
+#define LOG_ASYNC_TASK_PRIORITY     1
+#endif
+
+
+/* Number of sinks, including the default sink set by serial_log_function_set. Max 32. */
+#ifndef LOG_SINK_MAX
+#define LOG_SINK_MAX                4
+#endif
+
+/* Transfer buffers of each sink with a DMA function. The count must be 2**n
+   and at least 2, a record may span buffers. */
+#ifndef LOG_DMA_BUF_COUNT
+#define LOG_DMA_BUF_COUNT           2
+#endif
+#ifndef LOG_DMA_BUF_SIZE
+#define LOG_DMA_BUF_SIZE            LOG_BUF_SIZE
+#endif
+
+/* DMA buffer state: a record is being copied into the open buffer, the
+   completion interrupt is closing it, or asks the writer to close it */
+#define LOG_DMA_WRITING             0x1
+#define LOG_DMA_CLOSING             0x2
+#define LOG_DMA_FLUSH               0x4
+
+/* Compression history per sink. Must be 2**n, at most 32768. */
+#ifndef LOG_COMPRESS_WINDOW
+#define LOG_COMPRESS_WINDOW         1024
+#endif
+
+/* Compression hash table size, as a power of 2 */
+#ifndef LOG_COMPRESS_HASH_BITS
+#define LOG_COMPRESS_HASH_BITS      8
+#endif
+
+/* Largest input compressed into one frame, at most half the window */
+#define LOG_COMPRESS_PIECE          (LOG_COMPRESS_WINDOW / 2)
+
+/* Input bytes between history resets, where a decoder can join the stream */
+#ifndef LOG_COMPRESS_RESET
+#define LOG_COMPRESS_RESET          4096
+#endif
+
+/* Compressed frame: sync byte, then 15 bit payload length and reset flag */
+#define LOG_COMPRESS_SYNC           0x5A
+#define LOG_COMPRESS_FRAME_HEADER   3
+#define LOG_COMPRESS_MIN_MATCH      4
+
+/* Number of call sites tracked for duplicate suppression. Must be 2**n. */
+#ifndef LOG_DEDUP_SIZE
+#define LOG_DEDUP_SIZE              16
+#endif
+
+/* Payload frame: sync, level, tag length, reserved, payload id, chunk length,
+   offset and total length of the payload, timestamp. Tag, chunk and a CRC-32
+   of everything before it follow. */
+#define LOG_PAYLOAD_SYNC            0xA6
+#define LOG_PAYLOAD_HEADER_SIZE     20
+#define LOG_PAYLOAD_CRC_SIZE        4
+
+/* Longest tag kept in a payload frame, longer tags are cut */
+#define LOG_PAYLOAD_TAG_MAX         32
+
+/* Payload bytes per frame, so a frame fits a log buffer and an async ring slot */
+#define LOG_PAYLOAD_FRAME_DATA      (LOG_BUF_SIZE - LOG_PAYLOAD_HEADER_SIZE - LOG_PAYLOAD_TAG_MAX - LOG_PAYLOAD_CRC_SIZE)
+
+/* Payload bytes per base64 line of a text sink: room for the record prefix,
+   the line header and the suffix, in whole 3 byte groups */
+#define LOG_PAYLOAD_LINE_DATA       ((LOG_BUF_SIZE - LOG_DUMP_PREFIX_SIZE - 48) / 4 * 3)
+
+/* Flight recorder region marker, and the length field in front of each chunk */
+#define LOG_RECORDER_MAGIC          0x52474F4C
+#define LOG_RECORDER_CHUNK_HEADER   2
+
+#define LOG_IS_POWER_OF_2(n)        ((n) > 0 && ((n) & ((n) - 1)) == 0)
+
+#if !LOG_IS_POWER_OF_2(TAG_CACHE_SIZE) || !LOG_IS_POWER_OF_2(TAG_HASH_SIZE)
+#error "TAG_CACHE_SIZE and TAG_HASH_SIZE must be 2**n"
+#endif
+#if !LOG_IS_POWER_OF_2(LOG_ASYNC_RING_SIZE) || !LOG_IS_POWER_OF_2(LOG_DEDUP_SIZE)
+#error "LOG_ASYNC_RING_SIZE and LOG_DEDUP_SIZE must be 2**n"
+#endif
+#if !LOG_IS_POWER_OF_2(LOG_COMPRESS_WINDOW) || LOG_COMPRESS_WINDOW > 32768
+#error "LOG_COMPRESS_WINDOW must be 2**n, at most 32768"
+#endif
+#if LOG_BUF_POOL_SIZE > 32 || LOG_SINK_MAX > 32
+#error "LOG_BUF_POOL_SIZE and LOG_SINK_MAX are at most 32"
+#endif
+#if LOG_BUF_SIZE < 64 || LOG_BUF_SIZE > 16384
+#error "LOG_BUF_SIZE must be 64 to 16384"
+#endif
+#if BYTES_PER_LINE < 1 || LOG_DUMP_PREFIX_SIZE + 4 * BYTES_PER_LINE + 16 > LOG_BUF_SIZE
+#error "A buffer dump line of BYTES_PER_LINE bytes does not fit LOG_BUF_SIZE"
+#endif
+#if !LOG_IS_POWER_OF_2(LOG_DMA_BUF_COUNT) || LOG_DMA_BUF_COUNT < 2 || LOG_DMA_BUF_SIZE < 16 || LOG_DMA_BUF_SIZE > 65535
+#error "LOG_DMA_BUF_COUNT must be 2**n and at least 2, LOG_DMA_BUF_SIZE 16 to 65535"
+#endif
+#if LOG_PAYLOAD_LINE_DATA < 3
+#error "LOG_BUF_SIZE leaves no room for a payload line after LOG_DUMP_PREFIX_SIZE"
+#endif
+#if LOG_ASYNC_BATCH_SIZE < LOG_BUF_SIZE || LOG_ASYNC_RESERVE >= LOG_ASYNC_RING_SIZE
+#error "LOG_ASYNC_BATCH_SIZE must be at least LOG_BUF_SIZE, LOG_ASYNC_RESERVE less than LOG_ASYNC_RING_SIZE"
+#endif
+#if LOG_RECORD_MAX < 1 || LOG_RECORD_MAX > 32768
+#error "LOG_RECORD_MAX must be 1 to 32768"
+#endif
+#if !defined(USE_LOG_FORMATTER) && LOG_RECORD_MAX > LOG_BUF_SIZE - LOG_STAMP_SIZE - 1
+#error "Messages longer than the buffer need USE_LOG_FORMATTER"
+#endif
+#if defined(USE_LOG_ASYNC) && LOG_RECORD_MAX + LOG_BUF_SIZE > LOG_ASYNC_PARTS_MAX * LOG_BUF_SIZE
+#error "A record of LOG_RECORD_MAX does not fit the async ring, raise LOG_ASYNC_RING_SIZE"
 #endif
 
-/* FreeRTOS mutex macros */
-#define mutex_lock(x)       while (xSemaphoreTake(x, portMAX_DELAY) != pdPASS);
-#define mutex_unlock(x)     xSemaphoreGive(x)
-#define mutex_create()      xSemaphoreCreateMutex()
-#define mutex_destroy(x)    vQueueDelete(x)
 
 /* UART */
-static char log_buf[LOG_BUF_SIZE];
-func_log FuncLog;
+#ifdef USE_PTHREAD
+/* Each thread formats into its own buffer */
+static __thread char log_buf[LOG_BUF_SIZE];
+#else
+/* Buffers are reserved lock-free, so tasks and ISRs can format in parallel */
+static char log_buf_pool[LOG_BUF_POOL_SIZE][LOG_BUF_SIZE];
+static uint32_t log_buf_pool_used = 0;
+#endif
+
 func_get_tick FuncGetTick;
+static func_get_time_us FuncGetTimeUs;
+
+/* Caller-side latency measurement */
+static func_get_tick FuncGetCounter;
+static serial_log_latency_t log_latency;
+
+/* Statistics, and the period and tick of their last output as a record */
+static serial_log_stats_t log_stats;
+static uint32_t log_stats_period = 0;
+static uint32_t log_stats_tick = 0;
+
+#ifdef USE_LOG_STATS
+#define LOG_STAT_ADD(field, value)      atomic_add(&log_stats.field, (uint32_t)(value))
+#define LOG_STAT_MAX(field, value)      log_stat_max(&log_stats.field, (uint32_t)(value))
+#else
+#define LOG_STAT_ADD(field, value)      do { } while (0)
+#define LOG_STAT_MAX(field, value)      do { } while (0)
+#endif
+
+#ifdef USE_LOG_ASYNC
+/*
+ * Async ring buffer slot. The sequence number tells producers and the drain
+ * task who owns the slot (bounded MPMC queue, used here with one consumer).
+ */
+typedef struct {
+    uint32_t sequence;
+    uint32_t dropped;               /* Records dropped before this one */
+    uint16_t length;
+    uint8_t level;
+    uint8_t parts;                  /* Slots of the record in its first one, 0 in the others */
+    char data[LOG_BUF_SIZE];
+} log_ring_slot_t;
+
+/*
+ * Async ring buffer of one sink, drained by its own task. The drain task
+ * copies records out before dequeuing them, and producers evicting the oldest
+ * record dequeue it the same way, with a CAS on tail.
+ */
+typedef struct {
+    log_ring_slot_t slots[LOG_ASYNC_RING_SIZE];
+    uint32_t head;                  /* Enqueue position, shared by producers */
+    uint32_t tail;                  /* Dequeue position */
+    uint32_t done;                  /* Records output or evicted */
+    uint32_t dropped;               /* Records dropped since the last queued one */
+    char notice[LOG_ASYNC_NOTICE_SIZE];
+    char batch[LOG_ASYNC_BATCH_SIZE];
+    bool initialized;
+#ifdef USE_RTOS
+    TaskHandle_t drain_task;
+#ifdef USE_LOG_STATIC
+    StackType_t drain_stack[LOG_ASYNC_TASK_STACK];
+    StaticTask_t drain_tcb;
+#endif
+#elif defined(USE_PTHREAD)
+    pthread_t drain_thread;
+    sem_t drain_sem;
+#endif
+} log_ring_t;
+#endif
+
+#ifdef USE_LOG_COMPRESS
+/*
+ * Compressor state of a sink. LZ77 over a window of the recent output, with
+ * LZ4 style sequences. Frames are output as soon as their input arrives, and
+ * the decoder keeps the same window.
+ */
+typedef struct {
+    uint8_t window[LOG_COMPRESS_WINDOW];
+    uint32_t table[1 << LOG_COMPRESS_HASH_BITS];    /* Last position of each hash */
+    uint32_t pos;                   /* Bytes compressed so far */
+    uint32_t reset_pos;             /* Position of the last history reset */
+    bool started;
+    bool enabled;
+    uint8_t out[LOG_COMPRESS_FRAME_HEADER + LOG_COMPRESS_PIECE + LOG_COMPRESS_PIECE / 255 + 8];
+} log_compress_t;
+#endif
+
+#ifdef USE_LOG_DMA
+/*
+ * Transfer buffers of a DMA sink, used in turn. The open buffer takes records,
+ * closed ones wait for their transfer or are in it. The writer holds the sink
+ * lock and the completion interrupt does not, so they agree through state on
+ * who closes the open buffer.
+ */
+typedef struct {
+    uint8_t buf[LOG_DMA_BUF_COUNT][LOG_DMA_BUF_SIZE];
+    uint16_t len[LOG_DMA_BUF_COUNT];
+    uint32_t closed;                /* Buffers closed so far, the open one is next */
+    uint32_t done;                  /* Buffers transferred so far */
+    uint32_t busy;                  /* A transfer is in flight */
+    uint32_t state;                 /* LOG_DMA_WRITING, LOG_DMA_CLOSING, LOG_DMA_FLUSH */
+} log_dma_t;
+#endif
+
+/*
+ * Registered sink. Loggers read the fields without a lock, so they are only
+ * changed while the sink is out of log_sink_active.
+ */
+typedef struct {
+    func_log log;
+    func_log_vec log_vec;
+    const char *tag;
+    uint8_t level;
+    log_mutex_t lock;               /* Serializes calls to the log function */
+    uint8_t overflow;               /* serial_log_overflow_t */
+    uint32_t block_timeout;
+#ifdef USE_LOG_ASYNC
+    log_ring_t ring;
+#endif
+#ifdef USE_LOG_COMPRESS
+    log_compress_t compress;
+#endif
+#ifdef USE_LOG_DMA
+    func_log_dma log_dma;
+    log_dma_t dma;
+#endif
+} log_sink_t;
+
+static log_sink_t log_sinks[LOG_SINK_MAX];
+static uint32_t log_sink_active = 0;        /* Bit per sink in use */
+static uint32_t log_sink_binary = 0;        /* Bit per sink with binary format */
+static uint32_t log_sink_cbor = 0;          /* Bit per sink with CBOR format */
+static uint8_t log_sink_level = SERIAL_LOG_NONE;   /* Most verbose level of all sinks */
+
+/* Most verbose level any record can be output at, checked inline by the
+   SERIAL_LOGx macros before the arguments are evaluated */
+uint8_t serial_log_level_limit = SERIAL_LOG_NONE;
+
+/*
+ * Flight recorder header. Two copies are written in turn, so a reset in the
+ * middle of an update leaves the other one intact. Head and tail count bytes
+ * written since start, the ring offset is taken modulo the capacity.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t capacity;
+    uint32_t head;          /* End of the newest chunk */
+    uint32_t tail;          /* Start of the oldest chunk */
+    uint32_t crc;           /* CRC-32 of the fields above */
+} log_recorder_header_t;
+
+/*
+ * Flight recorder region, laid over the memory passed by the application.
+ * The ring holds chunks of a 16 bit little endian length followed by data.
+ */
+typedef struct {
+    log_recorder_header_t header[2];
+    uint8_t data[];
+} log_recorder_region_t;
+
+/* Flight recorder state, only changed from its sink, which is serialized */
+static struct {
+    log_recorder_region_t *region;
+    uint32_t capacity;
+    uint32_t sequence;
+    uint32_t head;
+    uint32_t tail;
+    int sink;
+} log_recorder = { NULL, 0, 0, 0, 0, -1 };
+
+/*
+ * Record made of segments around a message longer than a buffer. The message
+ * is formatted again for each piece of it that is output, over the piece
+ * held in the buffer or straight into async ring slots.
+ */
+typedef struct {
+    const serial_log_iovec_t *head;     /* Segments in front of the message */
+    uint8_t head_cnt;
+    const serial_log_iovec_t *tail;     /* Segments behind it */
+    uint8_t tail_cnt;
+    const char *format;
+    va_list list;
+    uint32_t message_len;               /* Characters output, at most LOG_RECORD_MAX */
+    char *piece;                        /* Holds the message from piece_offset */
+    uint32_t piece_offset;
+    uint16_t piece_len;
+    uint16_t piece_size;
+} log_record_t;
+
+/*
+ * Constant part of a record, passed to the sink by reference.
+ */
+typedef struct {
+    const char *str;
+    uint8_t len;
+} log_const_str_t;
+
+#define LOG_CONST_STR(s)    { s, sizeof(s) - 1 }
+
+#ifdef USE_LOG_COMPACT
+/* Level letter indexed by serial_log_level_t */
+static const log_const_str_t log_level_prefix[] = {
+    LOG_CONST_STR(""),
+    LOG_CONST_STR("E"),
+    LOG_CONST_STR("W"),
+    LOG_CONST_STR("I"),
+    LOG_CONST_STR("D"),
+    LOG_CONST_STR("V"),
+};
+#define LOG_SUFFIX          "\n"
+#else
+/* Color and level letter indexed by serial_log_level_t */
+static const log_const_str_t log_level_prefix[] = {
+    LOG_CONST_STR(""),
+    LOG_CONST_STR(LOG_COLOR_E "E"),
+    LOG_CONST_STR(LOG_COLOR_W "W"),
+    LOG_CONST_STR(LOG_COLOR_I "I"),
+    LOG_CONST_STR(LOG_COLOR_D "D"),
+    LOG_CONST_STR(LOG_COLOR_V "V"),
+};
+#define LOG_SUFFIX          LOG_RESET_COLOR "\r\n"
+#endif
+static const log_const_str_t log_separator = LOG_CONST_STR(": ");
+static const log_const_str_t log_suffix = LOG_CONST_STR(LOG_SUFFIX);
+
+/* End of a message cut at LOG_RECORD_MAX, the suffix follows on text sinks */
+static const serial_log_iovec_t log_truncated_tail[] = {
+    { LOG_TRUNCATED_MARK, sizeof(LOG_TRUNCATED_MARK) - 1 },
+    { LOG_SUFFIX, sizeof(LOG_SUFFIX) - 1 },
+};
+
+/* Digits for the buffer dump */
+static const char hex_digits[] = "0123456789abcdef";
 
 /*
- * Cached tag entry.
+ * Cached tag entry. Direct mapped by tag pointer and guarded by a per entry
+ * sequence counter, so loggers can read and fill it without a lock. The entry
+ * is valid only while its epoch matches set_log_epoch.
  */
 typedef struct {
+    uint32_t sequence;
+    uint32_t epoch;
     const char* tag;
-    uint32_t level : 3;
-    uint32_t generation : 29;
+    struct uncached_tag_entry_ *entry;
+    uint8_t level;
 } cached_tag_entry_t;
 
 /*
- * Uncached tag entry.
+ * Uncached tag entry. Entries are published with a release store and never
+ * freed, so loggers can walk the list while serial_log_level_set runs.
  */
 typedef struct uncached_tag_entry_ {
     SLIST_ENTRY(uncached_tag_entry_) entries;
     uint8_t level;
+    uint32_t limit;         /* Records per second and burst, 0 for no limit */
+    uint32_t tokens;        /* Token bucket, in thousandths of a record */
+    uint32_t tokens_tick;   /* Tick of the last refill */
     char tag[0];
 } uncached_tag_entry_t;
 
+/* Level of a tag entry which follows the default level */
+#define TAG_LEVEL_DEFAULT   0xFF
+
+/*
+ * Tag pattern set with serial_log_level_set, such as "net.*". Kept in a list
+ * published like the tag entries and never freed. Results are cached per tag,
+ * so the list is only walked on a cache miss.
+ */
+typedef struct log_tag_pattern_ {
+    struct log_tag_pattern_ *next;
+    uint8_t level;          /* TAG_LEVEL_DEFAULT once cleared */
+    uint8_t literals;       /* Characters other than wildcards, the highest wins */
+    char pattern[0];
+} log_tag_pattern_t;
+
 /* Variable for set log level */
-static serial_log_level_t set_log_default_level = SERIAL_LOG_VERBOSE;
-static SLIST_HEAD(log_tags_head, uncached_tag_entry_) set_log_tags = SLIST_HEAD_INITIALIZER(set_log_tags);
-static uint32_t set_log_cache_max_generation = 0;
-static uint32_t set_log_cache_entry_count = 0;
+static uint8_t set_log_default_level = SERIAL_LOG_VERBOSE;
+static SLIST_HEAD(log_tags_head, uncached_tag_entry_) set_log_tags[TAG_HASH_SIZE];
+static log_tag_pattern_t *set_log_patterns = NULL;
+static serial_log_tag_t *set_log_registered_tags = NULL;
+static uint32_t set_log_epoch = 0;
 static cached_tag_entry_t set_log_cache[TAG_CACHE_SIZE];
 
-#ifdef USE_RTOS
-static SemaphoreHandle_t set_log_lock = NULL;
+/* Serializes configuration writers */
+static log_mutex_t set_log_lock = LOG_MUTEX_INIT;
+
+/* Set once the mutexes are created, see log_init */
+static bool log_initialized = false;
+
+/* Set once any tag has a rate limit, so tag descriptors look their tag up */
+static bool set_log_rate_used = false;
+
+#ifdef USE_LOG_STATIC
+/* Tag entries and their strings, handed out in order and never freed */
+static uintptr_t log_tag_pool[LOG_TAG_POOL_SIZE / sizeof(uintptr_t)];
+#endif
+static uint32_t log_tag_memory = 0;         /* Bytes taken by tag entries */
+
+/*
+ * Duplicate suppression entry, direct mapped by format pointer. Loggers
+ * which find it busy output their record instead of waiting.
+ */
+typedef struct {
+    uint32_t busy;
+    const char *format;
+    const char *tag;        /* Tag of the suppressed records */
+    uint32_t tick;          /* First record of the window */
+    uint32_t count;         /* Records suppressed in the window */
+    uint8_t level;          /* Level of the suppressed records */
+} log_dedup_entry_t;
+
+static log_dedup_entry_t log_dedup[LOG_DEDUP_SIZE];
+static uint32_t log_dedup_window = 0;
+
+/* Number of the next payload, the decoder tells payloads of a tag apart by it */
+static uint32_t log_payload_id = 0;
+
+#if defined(USE_LOG_COMPACT) && defined(LOG_COMPACT_DELTA)
+/* Time of the record stamped last, truncated to 32 bits, and the number of
+   records stamped */
+static uint32_t log_stamp_last = 0;
+static uint32_t log_stamp_count = 0;
 #endif
 
 /* Static functions */
-static inline bool get_cached_log_level(const char* tag, serial_log_level_t* level);
-static inline bool get_uncached_log_level(const char* tag, serial_log_level_t* level);
-static inline void add_to_cache(const char* tag, serial_log_level_t level);
-static void heap_bubble_down(int index);
-static inline void heap_swap(int i, int j);
+static inline bool get_cached_log_level(const char* tag, uint32_t epoch, serial_log_level_t* level, uncached_tag_entry_t **entry);
+static inline bool get_uncached_log_level(const char* tag, serial_log_level_t* level, uncached_tag_entry_t **entry);
+static inline void add_to_cache(const char* tag, uint32_t epoch, serial_log_level_t level, uncached_tag_entry_t *entry);
 static inline bool should_output(serial_log_level_t level_for_message, serial_log_level_t level_for_tag);
 static inline void clear_log_level_list();
+static inline uint32_t tag_hash(const char *tag);
+static void update_registered_tags(const char *tag, serial_log_level_t level);
+static void log_latency_update(uint32_t start);
+static inline serial_log_level_t log_level_normalize(serial_log_level_t level);
+static inline void log_stat_max(uint32_t *stat, uint32_t value);
+static void log_stats_emit(void);
+static char *log_buf_acquire(void);
+static void log_buf_release(char *buf);
+static uint32_t log_sink_select(serial_log_level_t level, const char *tag);
+static void log_sink_dispatch(uint32_t sinks, serial_log_level_t level, const serial_log_iovec_t *iov, uint8_t iovcnt);
+static void log_record_dispatch(uint32_t sinks, serial_log_level_t level, log_record_t *rec);
+static bool log_record_init(log_record_t *rec, char *piece, uint16_t piece_size, int length,
+                            const char *format, va_list list);
+static void log_record_message(log_record_t *rec, uint32_t offset, char *dst, uint32_t size);
+#ifdef USE_LOG_ASYNC
+static uint32_t log_record_length(const log_record_t *rec);
+static uint32_t log_record_read(log_record_t *rec, uint32_t offset, char *dst, uint32_t size);
+#endif
+static void log_record_write(log_sink_t *sink, log_record_t *rec);
+static void log_sink_writev(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt);
+static void log_sink_emit(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt);
+static void log_sink_output(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt);
+static void log_sink_configure(uint8_t index, const serial_log_sink_t *config);
+static void log_sink_update_level(void);
+static void log_init(void);
+static inline void log_config_lock(void);
+static void log_default_sink_set(func_log log, func_log_vec log_vec);
+static void log_output_record(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, va_list list);
+static bool log_output_binary(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, va_list list);
+static void log_output_render(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format,
+                              serial_log_render_t render, const void *ctx);
+static void log_output_text_record(uint32_t sinks, serial_log_level_t level, const char *tag,
+                                   char *buf, int stamp_len, int body_len);
+static void log_output_long(uint32_t sinks, serial_log_level_t level, const char *tag, char *buf,
+                            int stamp_len, int body_len, const char *format, va_list list);
+static uint32_t log_binary_timestamp(serial_log_level_t *level);
+static void log_output_kv(uint32_t sinks, serial_log_level_t level, const char *tag, const char *message,
+                          const serial_log_field_t *fields, uint8_t count);
+static void log_output_cbor(uint32_t sinks, serial_log_level_t level, const char *tag,
+                            const char *message, uint16_t message_len, const uint8_t *fields, uint16_t fields_len);
+static uint8_t log_cbor_record(uint8_t *head, serial_log_iovec_t *iov, serial_log_level_t level, const char *tag,
+                               const char *message, uint16_t message_len, const uint8_t *fields, uint16_t fields_len);
+static uint8_t *log_cbor_head(uint8_t *p, uint8_t major, uint64_t value);
+static uint16_t log_kv_encode(uint8_t *buf, uint16_t size, const serial_log_field_t *fields, uint8_t count, bool *truncated);
+static uint16_t log_kv_text(char *buf, uint16_t size, const char *message,
+                            const serial_log_field_t *fields, uint8_t count, bool *truncated);
+static uint32_t log_record_select(serial_log_level_t level, const char *tag, const char *format);
+static uint32_t log_record_tag_select(serial_log_level_t level, serial_log_tag_t *tag, const char *format);
+static inline uint32_t log_isr_filter(uint32_t sinks, serial_log_level_t level);
+#ifdef USE_LOG_COMPRESS
+static void log_compress_write(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt);
+#endif
+#ifdef USE_LOG_DMA
+static void log_dma_write(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt);
+static uint32_t log_dma_room(log_dma_t *dma);
+static void log_dma_enter(log_dma_t *dma);
+static void log_dma_leave(log_sink_t *sink);
+static void log_dma_close(log_dma_t *dma);
+static void log_dma_request_close(log_dma_t *dma);
+static void log_dma_kick(log_sink_t *sink);
+static bool log_dma_wait(log_sink_t *sink, uint32_t wait_start);
+static void log_dma_drain(log_sink_t *sink);
+static void log_dma_flush(void);
+#endif
+#ifdef USE_LOG_ASYNC
+static void log_async_init(log_sink_t *sink);
+static void log_async_write(log_sink_t *sink, serial_log_level_t level, log_record_t *rec);
+static void log_async_drain(log_sink_t *sink);
+static bool log_async_overflow(log_sink_t *sink, serial_log_level_t level, uint32_t pos, uint32_t need,
+                               uint32_t wait_start);
+static bool log_async_wait(log_sink_t *sink, uint32_t wait_start);
+static bool log_async_evict(log_sink_t *sink, serial_log_level_t min_level, uint32_t pos, uint32_t need);
+static void log_async_drop(log_ring_t *ring, serial_log_level_t level);
+static void log_async_wake(log_ring_t *ring);
+static uint16_t log_async_notice(log_sink_t *sink, uint32_t dropped);
+#endif
+static bool log_level_check(serial_log_level_t level, const char *tag);
+static bool log_rate_take(uncached_tag_entry_t *entry);
+static serial_log_level_t log_tag_level(const char *tag, uncached_tag_entry_t **entry);
+static void log_level_limit_update(void);
+static int log_stamp_format(char *buf, int size);
+static inline const char *log_tag_text(const char *tag, char *buf);
+static uint32_t log_dedup_filter(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format);
+static void log_dedup_notice(serial_log_level_t level, const char *tag, uint32_t repeated);
+static void log_dedup_flush(void);
+static uncached_tag_entry_t *add_tag_entry(const char *tag);
+static void *log_tag_alloc(size_t size);
+static log_tag_pattern_t *add_tag_pattern(const char *pattern);
+static bool log_pattern_level(const char *tag, serial_log_level_t *level);
+static bool log_pattern_match(const char *pattern, const char *tag);
+static serial_log_level_t log_tag_resolve(const char *tag, uncached_tag_entry_t **entry);
+static void resolve_registered_tags(void);
+static uint32_t log_crc32(const void *data, uint32_t length);
+static uint32_t log_crc32_update(uint32_t crc, const void *data, uint32_t length);
+static void log_recorder_header_commit(uint32_t head, uint32_t tail);
+static void log_recorder_write(const serial_log_iovec_t *iov, uint8_t iovcnt, uint32_t timeout_ms);
+static void log_buffer_dump(const char *tag, const char *buffer, uint16_t buff_len,
+                            serial_log_level_t log_level, bool hex);
+static void log_payload_frames(uint32_t sinks, serial_log_level_t level, const char *tag, uint16_t id,
+                               const uint8_t *data, uint32_t len);
+static void log_payload_text(uint32_t sinks, serial_log_level_t level, const char *tag, uint16_t id,
+                             const uint8_t *data, uint32_t len);
+static char *log_base64(char *out, const uint8_t *in, uint32_t len);
+static uint16_t log_binary_encode(uint8_t *buf, uint16_t size,
+                                  serial_log_level_t level,
+                                  const char *tag,
+                                  uint32_t timestamp,
+                                  const char *format,
+                                  va_list list);
+#ifdef USE_LOG_ASYNC
+static uint16_t log_binary_format(uint8_t *buf, uint16_t size, serial_log_level_t level,
+                                  const char *tag, const char *format, ...);
+#endif
+
+static void log_init(void)
+{
+    /* Create the configuration and sink mutexes once, before any of them is
+       taken: loggers only take the lock of a sink configured since. Under
+       RTOS the first task to get here does it with the scheduler suspended,
+       so no other task creates them a second time. */
+    if (atomic_load(&log_initialized))
+    {
+        return;
+    }
+#ifdef USE_RTOS
+    vTaskSuspendAll();
+#endif
+    if (!log_initialized)
+    {
+        log_mutex_create(&set_log_lock);
+        for (uint8_t i = 0; i < LOG_SINK_MAX; i++)
+        {
+            log_mutex_create(&log_sinks[i].lock);
+        }
+        atomic_store(&log_initialized, true);
+    }
+#ifdef USE_RTOS
+    xTaskResumeAll();
+#endif
+}
+
+static inline void log_config_lock(void)
+{
+    log_init();
+    log_mutex_lock(&set_log_lock);
+}
 
 void serial_log_level_set(const char *tag, serial_log_level_t level)
 {
-#ifdef USE_RTOS
-    if (!set_log_lock)
+    log_config_lock();
+
+    /* For wildcard tag, make every tag follow the new default level */
+    if (strcmp(tag, "*") == 0)
+    {
+        atomic_store(&set_log_default_level, (uint8_t)level);
+        clear_log_level_list();
+        update_registered_tags(NULL, level);
+    }
+    else if (strpbrk(tag, "*?"))
+    {
+        /* Pattern, registered tag descriptors are matched again */
+        log_tag_pattern_t *pattern = add_tag_pattern(tag);
+        if (!pattern)
+        {
+            log_mutex_unlock(&set_log_lock);
+            return;
+        }
+        atomic_store(&pattern->level, (uint8_t)level);
+        resolve_registered_tags();
+    }
+    else
+    {
+        /* Update level for tag already been in linked list, or append new one */
+        uncached_tag_entry_t *entry = add_tag_entry(tag);
+        if (!entry)
+        {
+            log_mutex_unlock(&set_log_lock);
+            return;
+        }
+        atomic_store(&entry->level, (uint8_t)level);
+
+        /* Update registered tag descriptors */
+        update_registered_tags(tag, level);
+    }
+
+    /* Invalidate every cached entry */
+    atomic_add(&set_log_epoch, 1);
+    log_level_limit_update();
+
+    log_mutex_unlock(&set_log_lock);
+}
+
+void serial_log_rate_set(const char *tag, uint16_t rate, uint16_t burst)
+{
+    log_config_lock();
+
+    uncached_tag_entry_t *entry = add_tag_entry(tag);
+    if (entry)
+    {
+        /* Start with a full bucket */
+        uint32_t limit = rate ? rate | ((uint32_t)(burst ? burst : 1) << 16) : 0;
+        atomic_store(&entry->tokens, (limit >> 16) * 1000);
+        atomic_store(&entry->tokens_tick, FuncGetTick ? FuncGetTick() : 0);
+        atomic_store(&entry->limit, limit);
+        atomic_store(&set_log_rate_used, true);
+
+        /* Cached entries of this tag may not point at it yet */
+        atomic_add(&set_log_epoch, 1);
+    }
+
+    log_mutex_unlock(&set_log_lock);
+}
+
+static uncached_tag_entry_t *add_tag_entry(const char *tag)
+{
+    /* Searching exist tag */
+    struct log_tags_head *bucket = &set_log_tags[tag_hash(tag)];
+    uncached_tag_entry_t *it = NULL;
+    SLIST_FOREACH(it, bucket, entries)
+    {
+        if (strcmp(it->tag, tag) == 0)
+        {
+            return it;
+        }
+    }
+
+    /* Allocate memory for linked list entry and publish it at the head of the list */
+    size_t entry_size = offsetof(uncached_tag_entry_t, tag) + strlen(tag) + 1;
+    uncached_tag_entry_t *new_entry = (uncached_tag_entry_t*)log_tag_alloc(entry_size);
+    if (!new_entry)
+    {
+        return NULL;
+    }
+    new_entry->level = TAG_LEVEL_DEFAULT;
+    new_entry->limit = 0;
+    new_entry->tokens = 0;
+    new_entry->tokens_tick = 0;
+    strcpy(new_entry->tag, tag);
+    SLIST_NEXT(new_entry, entries) = SLIST_FIRST(bucket);
+    atomic_store(&SLIST_FIRST(bucket), new_entry);
+    return new_entry;
+}
+
+static void *log_tag_alloc(size_t size)
+{
+    /* Called with set_log_lock held. Entries are never freed, loggers may
+       still be walking them. */
+#ifdef USE_LOG_STATIC
+    size = (size + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1);
+    if (size > sizeof(log_tag_pool) - log_tag_memory)
+    {
+        return NULL;
+    }
+    void *mem = (uint8_t*)log_tag_pool + log_tag_memory;
+#else
+    void *mem = malloc(size);
+    if (!mem)
+    {
+        return NULL;
+    }
+#endif
+    atomic_store(&log_tag_memory, log_tag_memory + (uint32_t)size);
+    return mem;
+}
+
+static log_tag_pattern_t *add_tag_pattern(const char *pattern)
+{
+    for (log_tag_pattern_t *it = set_log_patterns; it != NULL; it = it->next)
+    {
+        if (strcmp(it->pattern, pattern) == 0)
+        {
+            return it;
+        }
+    }
+
+    size_t length = strlen(pattern);
+    log_tag_pattern_t *new_pattern = (log_tag_pattern_t*)log_tag_alloc(offsetof(log_tag_pattern_t, pattern) + length + 1);
+    if (!new_pattern)
+    {
+        return NULL;
+    }
+    uint8_t literals = 0;
+    for (size_t i = 0; i < length && literals < UINT8_MAX; i++)
+    {
+        literals += (pattern[i] != '*' && pattern[i] != '?');
+    }
+    new_pattern->level = TAG_LEVEL_DEFAULT;
+    new_pattern->literals = literals;
+    strcpy(new_pattern->pattern, pattern);
+    new_pattern->next = set_log_patterns;
+    atomic_store(&set_log_patterns, new_pattern);
+    return new_pattern;
+}
+
+static bool log_pattern_level(const char *tag, serial_log_level_t *level)
+{
+    /* Level of the most specific pattern matching the tag. Among equally
+       specific ones the latest added wins, it is first in the list. */
+    log_tag_pattern_t *best = NULL;
+    uint8_t best_level = TAG_LEVEL_DEFAULT;
+    for (log_tag_pattern_t *it = atomic_load(&set_log_patterns); it != NULL; it = it->next)
+    {
+        uint8_t pattern_level = atomic_load(&it->level);
+        if (pattern_level == TAG_LEVEL_DEFAULT || (best && it->literals <= best->literals))
+        {
+            continue;
+        }
+        if (log_pattern_match(it->pattern, tag))
+        {
+            best = it;
+            best_level = pattern_level;
+        }
+    }
+    if (!best)
+    {
+        return false;
+    }
+    *level = (serial_log_level_t)best_level;
+    return true;
+}
+
+static bool log_pattern_match(const char *pattern, const char *tag)
+{
+    /* Glob match, '*' for any characters and '?' for one. On a mismatch the
+       last '*' takes one more character. */
+    const char *star = NULL;
+    const char *resume = NULL;
+    while (*tag)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            resume = tag;
+        }
+        else if (*pattern == '?' || *pattern == *tag)
+        {
+            pattern++;
+            tag++;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            tag = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+    {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+static serial_log_level_t log_tag_resolve(const char *tag, uncached_tag_entry_t **entry)
+{
+    /* The tag itself, then the most specific pattern, then the default level */
+    serial_log_level_t level;
+    if (get_uncached_log_level(tag, &level, entry) || log_pattern_level(tag, &level))
+    {
+        return level;
+    }
+    return (serial_log_level_t)atomic_load(&set_log_default_level);
+}
+
+static void resolve_registered_tags(void)
+{
+    uncached_tag_entry_t *entry;
+    for (serial_log_tag_t *it = set_log_registered_tags; it != NULL; it = it->next)
+    {
+        atomic_store(&it->level, (uint8_t)log_tag_resolve(it->name, &entry));
+    }
+}
+
+static void clear_log_level_list(void)
+{
+    /* Entries are kept because loggers may still be walking them */
+    uncached_tag_entry_t *it;
+    for (int i = 0; i < TAG_HASH_SIZE; i++)
+    {
+        SLIST_FOREACH(it, &set_log_tags[i], entries)
+        {
+            atomic_store(&it->level, TAG_LEVEL_DEFAULT);
+        }
+    }
+    for (log_tag_pattern_t *pattern = set_log_patterns; pattern != NULL; pattern = pattern->next)
+    {
+        atomic_store(&pattern->level, TAG_LEVEL_DEFAULT);
+    }
+}
+
+static inline uint32_t tag_hash(const char *tag)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    while (*tag)
+    {
+        hash = (hash ^ (uint8_t)*tag++) * 16777619u;
+    }
+    return hash & (TAG_HASH_SIZE - 1);
+}
+
+static void update_registered_tags(const char *tag, serial_log_level_t level)
+{
+    /* NULL tag means the default level changed, so every tag follows it */
+    for (serial_log_tag_t *it = set_log_registered_tags; it != NULL; it = it->next)
+    {
+        if (tag == NULL || strcmp(it->name, tag) == 0)
+        {
+            atomic_store(&it->level, (uint8_t)level);
+        }
+    }
+}
+
+void serial_log_tag_register(serial_log_tag_t *tag)
+{
+    log_config_lock();
+
+    /* Another task may have registered it while we were waiting */
+    if (atomic_load(&tag->level) == SERIAL_LOG_TAG_UNRESOLVED)
+    {
+        uncached_tag_entry_t *entry;
+        serial_log_level_t level = log_tag_resolve(tag->name, &entry);
+        tag->next = set_log_registered_tags;
+        set_log_registered_tags = tag;
+        atomic_store(&tag->level, (uint8_t)level);
+    }
+
+    log_mutex_unlock(&set_log_lock);
+}
+
+static serial_log_level_t log_tag_level(const char *tag, uncached_tag_entry_t **entry)
+{
+    /* Read the epoch before the table, so a level set while we look up makes
+       the entry we cache stale rather than wrong */
+    uint32_t epoch = atomic_load(&set_log_epoch);
+
+    /* Look or the tag in cache first, then in the hashed list of all tags
+       and the patterns. The cache keeps the result of the pattern match. */
+    serial_log_level_t level_for_tag;
+    if (!get_cached_log_level(tag, epoch, &level_for_tag, entry))
+    {
+        level_for_tag = log_tag_resolve(tag, entry);
+        add_to_cache(tag, epoch, level_for_tag, *entry);
+    }
+    return level_for_tag;
+}
+
+static bool log_level_check(serial_log_level_t level, const char *tag)
+{
+    uncached_tag_entry_t *entry;
+    if (!should_output(level, log_tag_level(tag, &entry)))
+    {
+        return false;
+    }
+    return !entry || log_rate_take(entry);
+}
+
+bool serial_log_enabled_internal(const char *tag, serial_log_level_t level)
+{
+    /* Same filters as a write, without taking rate limit tokens */
+    uncached_tag_entry_t *entry;
+    if (should_output(level, log_tag_level(tag, &entry)) && log_sink_select(level, tag) != 0)
+    {
+        return true;
+    }
+    LOG_STAT_ADD(filtered[log_level_normalize(level)], 1);
+    return false;
+}
+
+static bool log_rate_take(uncached_tag_entry_t *entry)
+{
+    uint32_t limit = atomic_load_relaxed(&entry->limit);
+    if (!limit)
+    {
+        return true;
+    }
+
+    /* Refill by the ticks passed since the last refill. Rate is records per
+       second, which is thousandths of a record per millisecond tick. */
+    uint32_t now = FuncGetTick ? FuncGetTick() : 0;
+    uint32_t last = atomic_load(&entry->tokens_tick);
+    uint32_t elapsed = now - last;
+    uint32_t full = (limit >> 16) * 1000;
+    if (elapsed && atomic_cas(&entry->tokens_tick, &last, now))
+    {
+        uint64_t refill = (uint64_t)elapsed * (limit & 0xFFFF);
+        uint32_t tokens = atomic_load(&entry->tokens);
+        while (!atomic_cas(&entry->tokens, &tokens, (tokens + refill < full) ? tokens + (uint32_t)refill : full));
+    }
+
+    /* Take one record worth of tokens */
+    uint32_t tokens = atomic_load(&entry->tokens);
+    while (tokens >= 1000)
+    {
+        if (atomic_cas(&entry->tokens, &tokens, tokens - 1000))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef USE_LOG_FORMATTER
+#ifdef LOG_FORMATTER_FLOAT
+/* %f values from here on are output as "%f", the integer part would take
+   more than 128 bits. Infinity and NaN are output as libc does. */
+#define LOG_FORMAT_FLOAT_MAX        3.4028236692093846e38
+
+/* Scratch of a conversion: 39 integer digits, the point and 9 decimals */
+#define LOG_FORMAT_TMP_SIZE         52
+#else
+/* Scratch of a conversion: a 64 bit integer in octal */
+#define LOG_FORMAT_TMP_SIZE         24
+#endif
+
+/*
+ * Built-in formatter. Covers the conversions used with this library:
+ * %d %i %u %x %X %o %c %s %p %% with flags "-0+ #", width, precision and the
+ * hh h l ll z j t L length modifiers, plus fixed point %f below
+ * LOG_FORMAT_FLOAT_MAX when LOG_FORMATTER_FLOAT is enabled. Other floating
+ * point conversions are output as is, their argument skipped. Reentrant and never allocates. Like
+ * vsnprintf it returns the length of the whole message, and it can also
+ * output a piece from the middle of it.
+ */
+typedef struct {
+    char *p;
+    char *end;
+    uint32_t skip;                  /* Characters left out before the output starts */
+    uint32_t count;                 /* Characters of the message so far */
+} log_format_out_t;
+
+static inline void log_format_put(log_format_out_t *out, char c)
+{
+    out->count++;
+    if (out->skip)
+    {
+        out->skip--;
+    }
+    else if (out->p < out->end)
+    {
+        *out->p++ = c;
+    }
+}
+
+static inline void log_format_fill(log_format_out_t *out, char c, int count)
+{
+    while (count-- > 0)
+    {
+        log_format_put(out, c);
+    }
+}
+
+static void log_format_field(log_format_out_t *out, const char *prefix, int prefix_len,
+                             const char *digits, int digits_len,
+                             int zeros, int width, bool left, bool zero_pad)
+{
+    int len = prefix_len + zeros + digits_len;
+    int pad = (width > len) ? width - len : 0;
+
+    if (!left && !zero_pad)
+    {
+        log_format_fill(out, ' ', pad);
+    }
+    for (int i = 0; i < prefix_len; i++)
+    {
+        log_format_put(out, prefix[i]);
+    }
+    if (!left && zero_pad)
+    {
+        log_format_fill(out, '0', pad);
+    }
+    log_format_fill(out, '0', zeros);
+    for (int i = 0; i < digits_len; i++)
+    {
+        log_format_put(out, digits[i]);
+    }
+    if (left)
+    {
+        log_format_fill(out, ' ', pad);
+    }
+}
+
+static int log_format_digits(char *end, unsigned long long value, unsigned base, bool upper)
+{
+    const char *digits = upper ? "0123456789ABCDEF" : hex_digits;
+    char *p = end;
+
+    /* Stay in 32 bits when possible, 64 bit division is a library call on Cortex-M */
+    if (value <= UINT32_MAX)
+    {
+        uint32_t v = (uint32_t)value;
+        do {
+            *--p = digits[v % base];
+            v /= base;
+        } while (v);
+    }
+    else
+    {
+        do {
+            *--p = digits[value % base];
+            value /= base;
+        } while (value);
+    }
+    return end - p;
+}
+
+#ifdef LOG_FORMATTER_FLOAT
+static int log_format_wide(char *end, double value)
+{
+    /* Integer value from 1e19 to LOG_FORMAT_FLOAT_MAX, exact like libc: the
+       mantissa shifted into 32 bit words, divided by 1e9 for 9 digits at a
+       time. A double this large has no fraction. */
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t mantissa = (bits & ((1ULL << 52) - 1)) | (1ULL << 52);
+    int shift = (int)((bits >> 52) & 0x7FF) - 1075;
+    uint64_t high = (shift >= 64) ? mantissa << (shift - 64) : mantissa >> (64 - shift);
+    uint64_t low = (shift >= 64) ? 0 : mantissa << shift;
+    uint32_t words[4] = { (uint32_t)(high >> 32), (uint32_t)high, (uint32_t)(low >> 32), (uint32_t)low };
+
+    char *p = end;
+    bool more;
+    do {
+        uint64_t rest = 0;
+        more = false;
+        for (int i = 0; i < 4; i++)
+        {
+            uint64_t part = (rest << 32) | words[i];
+            words[i] = (uint32_t)(part / 1000000000u);
+            rest = part % 1000000000u;
+            more |= (words[i] != 0);
+        }
+        int digits = log_format_digits(p, rest, 10, false);
+        p -= digits;
+        while (more && digits++ < 9)
+        {
+            *--p = '0';
+        }
+    } while (more);
+    return end - p;
+}
+#endif
+
+static void log_format_run(log_format_out_t *out, const char *format, va_list list)
+{
+    char tmp[LOG_FORMAT_TMP_SIZE];
+    char *tmp_end = tmp + sizeof(tmp);
+
+    for (const char *f = format; *f; f++)
+    {
+        if (*f != '%')
+        {
+            log_format_put(out, *f);
+            continue;
+        }
+        f++;
+
+        /* Flags */
+        bool left = false, zero_pad = false, plus = false, space = false, alt = false;
+        for (;; f++)
+        {
+            if (*f == '-') left = true;
+            else if (*f == '0') zero_pad = true;
+            else if (*f == '+') plus = true;
+            else if (*f == ' ') space = true;
+            else if (*f == '#') alt = true;
+            else break;
+        }
+
+        /* Width */
+        int width = 0;
+        if (*f == '*')
+        {
+            width = va_arg(list, int);
+            if (width < 0)
+            {
+                left = true;
+                width = -width;
+            }
+            f++;
+        }
+        while (*f >= '0' && *f <= '9')
+        {
+            width = width * 10 + (*f++ - '0');
+        }
+
+        /* Precision */
+        int precision = -1;
+        if (*f == '.')
+        {
+            f++;
+            precision = 0;
+            if (*f == '*')
+            {
+                precision = va_arg(list, int);
+                f++;
+            }
+            while (*f >= '0' && *f <= '9')
+            {
+                precision = precision * 10 + (*f++ - '0');
+            }
+        }
+
+        /* Length modifier */
+        int length = 0;     /* 0 int, 1 long, 2 long long, -1 short, -2 char, 3 long double */
+        if (*f == 'h')
+        {
+            length = (f[1] == 'h') ? -2 : -1;
+            f -= length;
+        }
+        else if (*f == 'l')
+        {
+            length = (f[1] == 'l') ? 2 : 1;
+            f += length;
+        }
+        else if (*f == 'j')
+        {
+            length = 2;
+            f++;
+        }
+        else if (*f == 'z' || *f == 't')
+        {
+            length = (sizeof(size_t) == sizeof(long long)) ? 2 : 1;
+            f++;
+        }
+        else if (*f == 'L')
+        {
+            length = 3;
+            f++;
+        }
+
+        char sign[2];
+        int sign_len = 0;
+        int digits_len;
+        switch (*f)
+        {
+        case 'd':
+        case 'i':
+        {
+            long long value = (length == 2) ? va_arg(list, long long)
+                            : (length == 1) ? va_arg(list, long)
+                            : va_arg(list, int);
+            if (length == -1) value = (short)value;
+            if (length == -2) value = (signed char)value;
+            unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+            if (value < 0) sign[sign_len++] = '-';
+            else if (plus) sign[sign_len++] = '+';
+            else if (space) sign[sign_len++] = ' ';
+            digits_len = (precision == 0 && magnitude == 0) ? 0 : log_format_digits(tmp_end, magnitude, 10, false);
+            int zeros = (precision > digits_len) ? precision - digits_len : 0;
+            log_format_field(out, sign, sign_len, tmp_end - digits_len, digits_len, zeros,
+                             width, left, zero_pad && precision < 0);
+            break;
+        }
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        {
+            unsigned long long value = (length == 2) ? va_arg(list, unsigned long long)
+                                     : (length == 1) ? va_arg(list, unsigned long)
+                                     : va_arg(list, unsigned int);
+            if (length == -1) value = (unsigned short)value;
+            if (length == -2) value = (unsigned char)value;
+            unsigned base = (*f == 'u') ? 10 : (*f == 'o') ? 8 : 16;
+            digits_len = (precision == 0 && value == 0) ? 0 : log_format_digits(tmp_end, value, base, *f == 'X');
+            int zeros = (precision > digits_len) ? precision - digits_len : 0;
+
+            /* Alternate form: 0x before non-zero hex, a leading 0 for octal */
+            const char *prefix = NULL;
+            if (alt && base == 16 && value)
+            {
+                prefix = (*f == 'X') ? "0X" : "0x";
+            }
+            else if (alt && base == 8 && zeros == 0 && (digits_len == 0 || tmp_end[-digits_len] != '0'))
+            {
+                zeros = 1;
+            }
+            log_format_field(out, prefix, prefix ? 2 : 0, tmp_end - digits_len, digits_len, zeros,
+                             width, left, zero_pad && precision < 0);
+            break;
+        }
+        case 'p':
+        {
+            uintptr_t value = (uintptr_t)va_arg(list, void*);
+            digits_len = log_format_digits(tmp_end, value, 16, false);
+            log_format_field(out, "0x", 2, tmp_end - digits_len, digits_len, 0, width, left, false);
+            break;
+        }
+        case 'c':
+            tmp[0] = (char)va_arg(list, int);
+            log_format_field(out, NULL, 0, tmp, 1, 0, width, left, false);
+            break;
+        case 's':
+        {
+            const char *value = va_arg(list, const char*);
+            if (!value)
+            {
+                value = "(null)";
+            }
+            int len = 0;
+            while (value[len] && (precision < 0 || len < precision))
+            {
+                len++;
+            }
+            log_format_field(out, NULL, 0, value, len, 0, width, left, false);
+            break;
+        }
+#ifdef LOG_FORMATTER_FLOAT
+        case 'f':
+        case 'F':
+        {
+            /* Fixed point: integer part and scaled fraction, both as integers */
+            static const uint32_t scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+            double value = (length == 3) ? (double)va_arg(list, long double) : va_arg(list, double);
+            if (precision < 0) precision = 6;
+            if (precision > 9) precision = 9;
+            if (value < 0) { sign[sign_len++] = '-'; value = -value; }
+            else if (plus) sign[sign_len++] = '+';
+            else if (space) sign[sign_len++] = ' ';
+
+            if (value != value || value > DBL_MAX)
+            {
+                const char *text = (value != value) ? "nan" : "inf";
+                if (*f == 'F')
+                {
+                    text = (value != value) ? "NAN" : "INF";
+                }
+                log_format_field(out, sign, sign_len, text, 3, 0, width, left, false);
+                break;
+            }
+            if (value >= LOG_FORMAT_FLOAT_MAX)
+            {
+                /* Past the digits formatted, output as is like the other
+                   floating point conversions */
+                log_format_put(out, '%');
+                log_format_put(out, *f);
+                break;
+            }
+            /* Round half to even like libc. From 1e19 the integer part
+               takes more than 64 bits and there is no fraction. */
+            unsigned long long integer = 0;
+            unsigned long long fraction = 0;
+            if (value < 1e19)
+            {
+                integer = (unsigned long long)value;
+                double scaled = (value - (double)integer) * scale[precision];
+                fraction = (unsigned long long)scaled;
+                double rest = scaled - (double)fraction;
+                unsigned long long last = precision ? fraction : integer;
+                if (rest > 0.5 || (rest == 0.5 && (last & 1)))
+                {
+                    fraction++;
+                }
+                if (fraction >= scale[precision])
+                {
+                    integer++;
+                    fraction -= scale[precision];
+                }
+            }
+            char *p = tmp_end;
+            if (precision > 0)
+            {
+                p -= log_format_digits(p, fraction, 10, false);
+                while (p > tmp_end - precision)
+                {
+                    *--p = '0';
+                }
+                *--p = '.';
+            }
+            else if (alt)
+            {
+                *--p = '.';
+            }
+            p -= (value < 1e19) ? log_format_digits(p, integer, 10, false) : log_format_wide(p, value);
+            log_format_field(out, sign, sign_len, p, tmp_end - p, 0, width, left, zero_pad);
+            break;
+        }
+#endif
+        case '%':
+            log_format_put(out, '%');
+            break;
+        case '\0':
+            f--;
+            break;
+        case 'e':
+        case 'E':
+#ifndef LOG_FORMATTER_FLOAT
+        case 'f':
+        case 'F':
+#endif
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            /* Floating point without LOG_FORMATTER_FLOAT, output as is. The
+               argument is still taken, as promoted, so the next ones line up. */
+            if (length == 3)
+            {
+                (void)va_arg(list, long double);
+            }
+            else
+            {
+                (void)va_arg(list, double);
+            }
+            log_format_put(out, '%');
+            log_format_put(out, *f);
+            break;
+        default:
+            /* Unsupported conversion, output it as is */
+            log_format_put(out, '%');
+            log_format_put(out, *f);
+            break;
+        }
+    }
+}
+
+static int log_vformat(char *buf, size_t size, const char *format, va_list list)
+{
+    log_format_out_t out = { buf, buf + (size ? size - 1 : 0), 0, 0 };
+    log_format_run(&out, format, list);
+    if (size)
+    {
+        *out.p = '\0';
+    }
+    return (int)out.count;
+}
+
+static uint32_t log_vformat_piece(char *buf, uint32_t size, uint32_t offset, const char *format, va_list list)
+{
+    /* Characters offset to offset + size of the message, without a NUL */
+    log_format_out_t out = { buf, buf + size, offset, 0 };
+    log_format_run(&out, format, list);
+    return out.p - buf;
+}
+
+#define log_vsnprintf       log_vformat
+#else
+#define log_vsnprintf       vsnprintf
+#endif
+
+static int log_snprintf(char *buf, size_t size, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    int length = log_vsnprintf(buf, size, format, list);
+    va_end(list);
+    return length;
+}
+
+static inline serial_log_level_t log_level_normalize(serial_log_level_t level)
+{
+    /* Levels out of range are output as INFO */
+    if (level < SERIAL_LOG_ERROR || level > SERIAL_LOG_VERBOSE)
+    {
+        return SERIAL_LOG_INFO;
+    }
+    return level;
+}
+
+static inline int log_clamp(int length, int size)
+{
+    /* snprintf returns the length it wanted to write */
+    if (length < 0)
+    {
+        return 0;
+    }
+    return (length < size) ? length : size - 1;
+}
+
+static int log_stamp_format(char *buf, int size)
+{
+#ifdef USE_LOG_COMPACT
+    /* Microseconds or ticks in hex, or with LOG_COMPACT_DELTA "+" and the hex
+       difference to the record stamped before. Records reach the sinks in
+       another order than they are stamped in or not at all, so every
+       LOG_COMPACT_RESYNC-th record takes the time truncated to 32 bits. */
+    uint64_t now = FuncGetTimeUs ? FuncGetTimeUs() : FuncGetTick();
+#ifdef LOG_COMPACT_DELTA
+    uint32_t last = atomic_load_relaxed(&log_stamp_last);
+    while (!atomic_cas(&log_stamp_last, &last, (uint32_t)now));
+    bool resync = atomic_add(&log_stamp_count, 1) % LOG_COMPACT_RESYNC == 0;
+    uint64_t value = resync ? (uint32_t)now : (uint32_t)now - last;
+    const char *lead = resync ? " " : " +";
+#else
+    uint64_t value = now;
+    const char *lead = " ";
+#endif
+    char digits[16];
+    int count = 0;
+    do {
+        digits[count++] = hex_digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+
+    int length = (int)strlen(lead);
+    memcpy(buf, lead, length);
+    while (count && length < size - 2)
+    {
+        buf[length++] = digits[--count];
+    }
+    buf[length++] = ' ';
+    buf[length] = '\0';
+    return length;
+#else
+    if (FuncGetTimeUs)
+    {
+        uint64_t time_us = FuncGetTimeUs();
+        return log_clamp(log_snprintf(buf, size, " (%lu.%06lu) ", (unsigned long)(time_us / 1000000),
+                                      (unsigned long)(time_us % 1000000)), size);
+    }
+    return log_clamp(log_snprintf(buf, size, " (%d) ", (int)FuncGetTick()), size);
+#endif
+}
+
+static inline const char *log_tag_text(const char *tag, char *buf)
+{
+#if defined(USE_LOG_COMPACT) && defined(LOG_COMPACT_TAG_ID)
+    /* "#" and the FNV-1a hash of the tag folded to 16 bits, buf takes
+       LOG_TAG_TEXT_SIZE bytes */
+    uint32_t hash = 2166136261u;
+    for (const char *p = tag; *p; p++)
+    {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    hash = (hash >> 16) ^ (hash & 0xFFFF);
+    buf[0] = '#';
+    for (int i = 0; i < 4; i++)
+    {
+        buf[1 + i] = hex_digits[(hash >> (12 - 4 * i)) & 0xF];
+    }
+    buf[5] = '\0';
+    return buf;
+#else
+    (void)buf;
+    return tag;
+#endif
+}
+
+static void log_output_text(uint32_t sinks, serial_log_level_t level, const char *format, va_list list)
+{
+    level = log_level_normalize(level);
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        return;
+    }
+    LOG_STAT_ADD(emitted[level], 1);
+
+    /* The arguments are read again for the pieces of a long message */
+    va_list again;
+    va_copy(again, list);
+    int length = log_vsnprintf(buf, LOG_BUF_SIZE, format, list);
+    if (length < LOG_BUF_SIZE && length <= LOG_RECORD_MAX)
+    {
+        serial_log_iovec_t iov = { buf, (uint16_t)log_clamp(length, LOG_BUF_SIZE) };
+        log_sink_dispatch(sinks, level, &iov, 1);
+    }
+    else
+    {
+        log_record_t rec;
+        if (log_record_init(&rec, buf, LOG_BUF_SIZE - 1, length, format, again))
+        {
+            LOG_STAT_ADD(truncated[level], 1);
+            rec.tail = log_truncated_tail;
+            rec.tail_cnt = 1;
+        }
+        log_record_dispatch(sinks, level, &rec);
+        va_end(rec.list);
+    }
+    va_end(again);
+    log_buf_release(buf);
+}
+
+static void log_output_record(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, va_list list)
+{
+    level = log_level_normalize(level);
+    uint32_t binary_sinks = sinks & atomic_load_relaxed(&log_sink_binary);
+    uint32_t text_sinks = sinks & ~binary_sinks;
+
+    /* Counted once however many formats the sinks take */
+    bool sent = false;
+    if (binary_sinks)
+    {
+        /* The arguments are read twice when text sinks want the record too */
+        va_list copy;
+        va_copy(copy, list);
+        sent = log_output_binary(binary_sinks, level, tag, format, copy);
+        va_end(copy);
+    }
+    if (!text_sinks)
+    {
+        if (sent)
+        {
+            LOG_STAT_ADD(emitted[level], 1);
+        }
+        return;
+    }
+
+    /* Only the timestamp and the message are formatted, the constant parts
+       and the tag are passed to the sink by reference */
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        if (sent)
+        {
+            LOG_STAT_ADD(emitted[level], 1);
+        }
+        return;
+    }
+    LOG_STAT_ADD(emitted[level], 1);
+    va_list again;
+    va_copy(again, list);
+    char *body = buf + LOG_STAMP_SIZE;
+    int stamp_len = log_stamp_format(buf, LOG_STAMP_SIZE);
+    int body_len = log_vsnprintf(body, LOG_BUF_SIZE - LOG_STAMP_SIZE, format, list);
+    if (body_len < LOG_BUF_SIZE - LOG_STAMP_SIZE && body_len <= LOG_RECORD_MAX)
+    {
+        log_output_text_record(text_sinks, level, tag, buf, stamp_len, log_clamp(body_len, LOG_BUF_SIZE - LOG_STAMP_SIZE));
+    }
+    else
+    {
+        log_output_long(text_sinks, level, tag, buf, stamp_len, body_len, format, again);
+    }
+    va_end(again);
+    log_buf_release(buf);
+}
+
+static void log_output_long(uint32_t sinks, serial_log_level_t level, const char *tag, char *buf,
+                            int stamp_len, int body_len, const char *format, va_list list)
+{
+    /* Same segments as log_output_text_record, around a message that goes
+       out in pieces. The first piece is at LOG_STAMP_SIZE already. */
+    log_record_t rec;
+    bool cut = log_record_init(&rec, buf + LOG_STAMP_SIZE, LOG_BUF_SIZE - LOG_STAMP_SIZE - 1, body_len, format, list);
+    if (cut)
+    {
+        LOG_STAT_ADD(truncated[level], 1);
+    }
+
+    uint32_t cbor_sinks = sinks & atomic_load_relaxed(&log_sink_cbor);
+    if (cbor_sinks)
+    {
+        /* The marker is part of the message text, so its length is too */
+        uint8_t head[LOG_CBOR_HEAD_SIZE];
+        serial_log_iovec_t iov[6];
+        uint16_t text_len = (uint16_t)(rec.message_len + (cut ? log_truncated_tail[0].len : 0));
+        log_cbor_record(head, iov, level, tag, NULL, text_len, NULL, 0);
+        rec.head = iov;
+        rec.head_cnt = 3;
+        rec.tail = log_truncated_tail;
+        rec.tail_cnt = cut ? 1 : 0;
+        log_record_dispatch(cbor_sinks, level, &rec);
+        sinks &= ~cbor_sinks;
+    }
+    if (sinks)
+    {
+        const log_const_str_t *prefix = &log_level_prefix[level];
+        char tag_id[LOG_TAG_TEXT_SIZE];
+        tag = log_tag_text(tag, tag_id);
+        serial_log_iovec_t head[] = {
+            { prefix->str, prefix->len },
+            { buf, (uint16_t)stamp_len },
+            { tag, (uint16_t)strlen(tag) },
+            { log_separator.str, log_separator.len },
+        };
+        rec.head = head;
+        rec.head_cnt = sizeof(head) / sizeof(head[0]);
+        rec.tail = cut ? log_truncated_tail : log_truncated_tail + 1;
+        rec.tail_cnt = cut ? 2 : 1;
+        log_record_dispatch(sinks, level, &rec);
+    }
+    va_end(rec.list);
+}
+
+static void log_output_text_record(uint32_t sinks, serial_log_level_t level, const char *tag,
+                                   char *buf, int stamp_len, int body_len)
+{
+    /* CBOR sinks take the formatted message without prefix */
+    uint32_t cbor_sinks = sinks & atomic_load_relaxed(&log_sink_cbor);
+    if (cbor_sinks)
+    {
+        log_output_cbor(cbor_sinks, level, tag, buf + LOG_STAMP_SIZE, (uint16_t)body_len, NULL, 0);
+        sinks &= ~cbor_sinks;
+        if (!sinks)
+        {
+            return;
+        }
+    }
+
+    /* The stamp is at the start of buf, the message at LOG_STAMP_SIZE */
+    const log_const_str_t *prefix = &log_level_prefix[level];
+    char tag_id[LOG_TAG_TEXT_SIZE];
+    tag = log_tag_text(tag, tag_id);
+    serial_log_iovec_t iov[] = {
+        { prefix->str, prefix->len },
+        { buf, (uint16_t)stamp_len },
+        { tag, (uint16_t)strlen(tag) },
+        { log_separator.str, log_separator.len },
+        { buf + LOG_STAMP_SIZE, (uint16_t)body_len },
+        { log_suffix.str, log_suffix.len },
+    };
+    log_sink_dispatch(sinks, level, iov, sizeof(iov) / sizeof(iov[0]));
+}
+
+static void log_output_render(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format,
+                              serial_log_render_t render, const void *ctx)
+{
+    level = log_level_normalize(level);
+    uint32_t binary_sinks = sinks & atomic_load_relaxed(&log_sink_binary);
+    uint32_t text_sinks = sinks & ~binary_sinks;
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        return;
+    }
+    LOG_STAT_ADD(emitted[level], 1);
+
+    bool truncated = false;
+    if (binary_sinks)
+    {
+        /* Same header as log_binary_encode, the callback writes the argument values */
+        serial_log_level_t flagged = level;
+        uint32_t timestamp = log_binary_timestamp(&flagged);
+        uint32_t format_addr = (uint32_t)(uintptr_t)format;
+        uint32_t tag_addr = (uint32_t)(uintptr_t)tag;
+        uint16_t args_len = render(ctx, SERIAL_LOG_FORMAT_BINARY, buf + LOG_BINARY_HEADER_SIZE,
+                                   LOG_BUF_SIZE - LOG_BINARY_HEADER_SIZE, &truncated);
+        buf[0] = (char)LOG_BINARY_SYNC;
+        buf[1] = (char)flagged;
+        memcpy(&buf[2], &args_len, sizeof(args_len));
+        memcpy(&buf[4], &timestamp, sizeof(timestamp));
+        memcpy(&buf[8], &format_addr, sizeof(format_addr));
+        memcpy(&buf[12], &tag_addr, sizeof(tag_addr));
+        serial_log_iovec_t iov = { buf, (uint16_t)(LOG_BINARY_HEADER_SIZE + args_len) };
+        log_sink_dispatch(binary_sinks, level, &iov, 1);
+    }
+    if (text_sinks)
+    {
+        int stamp_len = log_stamp_format(buf, LOG_STAMP_SIZE);
+        uint16_t body_len = render(ctx, SERIAL_LOG_FORMAT_TEXT, buf + LOG_STAMP_SIZE,
+                                   LOG_BUF_SIZE - LOG_STAMP_SIZE, &truncated);
+        log_output_text_record(text_sinks, level, tag, buf, stamp_len, body_len);
+    }
+    if (truncated)
+    {
+        LOG_STAT_ADD(truncated[level], 1);
+    }
+    log_buf_release(buf);
+}
+
+static void log_output_kv(uint32_t sinks, serial_log_level_t level, const char *tag, const char *message,
+                          const serial_log_field_t *fields, uint8_t count)
+{
+    level = log_level_normalize(level);
+    uint32_t binary_sinks = sinks & atomic_load_relaxed(&log_sink_binary);
+    uint32_t cbor_sinks = sinks & atomic_load_relaxed(&log_sink_cbor);
+    uint32_t text_sinks = sinks & ~binary_sinks & ~cbor_sinks;
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        return;
+    }
+    LOG_STAT_ADD(emitted[level], 1);
+
+    /* Binary and CBOR sinks share the encoded fields, text sinks reuse the
+       buffer afterwards */
+    bool truncated = false;
+    if (binary_sinks || cbor_sinks)
+    {
+        uint8_t *encoded = (uint8_t*)buf + LOG_BINARY_HEADER_SIZE;
+        uint16_t encoded_len = log_kv_encode(encoded, LOG_BUF_SIZE - LOG_BINARY_HEADER_SIZE, fields, count, &truncated);
+        if (binary_sinks)
+        {
+            /* Header of log_binary_encode with the message as format */
+            serial_log_level_t flagged = (serial_log_level_t)(level | LOG_BINARY_LEVEL_KV);
+            uint32_t timestamp = log_binary_timestamp(&flagged);
+            uint32_t message_addr = (uint32_t)(uintptr_t)message;
+            uint32_t tag_addr = (uint32_t)(uintptr_t)tag;
+            buf[0] = (char)LOG_BINARY_SYNC;
+            buf[1] = (char)flagged;
+            memcpy(&buf[2], &encoded_len, sizeof(encoded_len));
+            memcpy(&buf[4], &timestamp, sizeof(timestamp));
+            memcpy(&buf[8], &message_addr, sizeof(message_addr));
+            memcpy(&buf[12], &tag_addr, sizeof(tag_addr));
+            serial_log_iovec_t iov = { buf, (uint16_t)(LOG_BINARY_HEADER_SIZE + encoded_len) };
+            log_sink_dispatch(binary_sinks, level, &iov, 1);
+        }
+        if (cbor_sinks)
+        {
+            log_output_cbor(cbor_sinks, level, tag, message, (uint16_t)strlen(message), encoded, encoded_len);
+        }
+    }
+    if (text_sinks)
+    {
+        int stamp_len = log_stamp_format(buf, LOG_STAMP_SIZE);
+        uint16_t body_len = log_kv_text(buf + LOG_STAMP_SIZE, LOG_BUF_SIZE - LOG_STAMP_SIZE,
+                                        message, fields, count, &truncated);
+        log_output_text_record(text_sinks, level, tag, buf, stamp_len, body_len);
+    }
+    if (truncated)
+    {
+        LOG_STAT_ADD(truncated[level], 1);
+    }
+    log_buf_release(buf);
+}
+
+static void log_output_cbor(uint32_t sinks, serial_log_level_t level, const char *tag,
+                            const char *message, uint16_t message_len, const uint8_t *fields, uint16_t fields_len)
+{
+    uint8_t head[LOG_CBOR_HEAD_SIZE];
+    serial_log_iovec_t iov[6];
+    uint8_t iovcnt = log_cbor_record(head, iov, level, tag, message, message_len, fields, fields_len);
+    log_sink_dispatch(sinks, level, iov, iovcnt);
+}
+
+static uint8_t log_cbor_record(uint8_t *head, serial_log_iovec_t *iov, serial_log_level_t level, const char *tag,
+                               const char *message, uint16_t message_len, const uint8_t *fields, uint16_t fields_len)
+{
+    /* Segments of one CBOR record. The head holds everything but the tag,
+       the message and the fields, which are passed by reference. */
+    uint16_t tag_len = (uint16_t)strlen(tag);
+    uint8_t *p = head;
+    memcpy(p, LOG_CBOR_SYNC, sizeof(LOG_CBOR_SYNC) - 1);
+    p += sizeof(LOG_CBOR_SYNC) - 1;
+    p = log_cbor_head(p, LOG_CBOR_MAP, fields_len ? 5 : 4);
+    p = log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_LEVEL);
+    p = log_cbor_head(p, LOG_CBOR_UINT, level);
+    if (FuncGetTimeUs)
+    {
+        p = log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_TIME_US);
+        p = log_cbor_head(p, LOG_CBOR_UINT, FuncGetTimeUs());
+    }
+    else
+    {
+        p = log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_TICK);
+        p = log_cbor_head(p, LOG_CBOR_UINT, FuncGetTick());
+    }
+    p = log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_TAG);
+    p = log_cbor_head(p, LOG_CBOR_TEXT, tag_len);
+    iov[0].data = head;
+    iov[0].len = (uint16_t)(p - head);
+    iov[1].data = tag;
+    iov[1].len = tag_len;
+
+    uint8_t *mid = p;
+    p = log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_MESSAGE);
+    p = log_cbor_head(p, LOG_CBOR_TEXT, message_len);
+    iov[2].data = mid;
+    iov[2].len = (uint16_t)(p - mid);
+    iov[3].data = message;
+    iov[3].len = message_len;
+    if (!fields_len)
+    {
+        return 4;
+    }
+
+    /* The fields are an encoded map already */
+    iov[4].data = p;
+    iov[4].len = (uint16_t)(log_cbor_head(p, LOG_CBOR_UINT, LOG_CBOR_KEY_FIELDS) - p);
+    iov[5].data = fields;
+    iov[5].len = fields_len;
+    return 6;
+}
+
+static uint8_t *log_cbor_head(uint8_t *p, uint8_t major, uint64_t value)
+{
+    /* Major type and argument, big endian in the shortest form */
+    major = (uint8_t)(major << 5);
+    if (value < 24)
+    {
+        *p++ = major | (uint8_t)value;
+        return p;
+    }
+
+    int bytes;
+    if (value <= UINT8_MAX)
+    {
+        *p++ = major | 24;
+        bytes = 1;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        *p++ = major | 25;
+        bytes = 2;
+    }
+    else if (value <= UINT32_MAX)
+    {
+        *p++ = major | 26;
+        bytes = 4;
+    }
+    else
+    {
+        *p++ = major | 27;
+        bytes = 8;
+    }
+    while (bytes--)
+    {
+        *p++ = (uint8_t)(value >> (8 * bytes));
+    }
+    return p;
+}
+
+static uint16_t log_kv_encode(uint8_t *buf, uint16_t size, const serial_log_field_t *fields, uint8_t count, bool *truncated)
+{
+    /* CBOR map of the fields, only whole fields are kept. Room for the map
+       head, at most 2 bytes, is left in front and closed up at the end. */
+    uint8_t *p = buf + 2;
+    const uint8_t *end = buf + size;
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const serial_log_field_t *field = &fields[i];
+        uint8_t key_head[9];
+        uint8_t value_head[9];
+        size_t key_len = strlen(field->key);
+        uint8_t key_head_len = (uint8_t)(log_cbor_head(key_head, LOG_CBOR_TEXT, key_len) - key_head);
+        uint8_t value_head_len;
+        const void *payload = NULL;
+        size_t payload_len = 0;
+
+        switch (field->type)
+        {
+        case SERIAL_LOG_FIELD_INT:
+            if (field->value.i < 0)
+            {
+                value_head_len = (uint8_t)(log_cbor_head(value_head, LOG_CBOR_NEGINT, (uint64_t)(-1 - field->value.i)) - value_head);
+            }
+            else
+            {
+                value_head_len = (uint8_t)(log_cbor_head(value_head, LOG_CBOR_UINT, (uint64_t)field->value.i) - value_head);
+            }
+            break;
+        case SERIAL_LOG_FIELD_UINT:
+            value_head_len = (uint8_t)(log_cbor_head(value_head, LOG_CBOR_UINT, field->value.u) - value_head);
+            break;
+        case SERIAL_LOG_FIELD_FLOAT:
+        {
+            /* Single precision when it holds the value exactly */
+            float single = (float)field->value.f;
+            uint64_t bits;
+            if ((double)single == field->value.f)
+            {
+                uint32_t bits32;
+                memcpy(&bits32, &single, sizeof(bits32));
+                bits = bits32;
+                value_head_len = 5;
+                value_head[0] = 0xFA;
+            }
+            else
+            {
+                memcpy(&bits, &field->value.f, sizeof(bits));
+                value_head_len = 9;
+                value_head[0] = 0xFB;
+            }
+            for (int b = 1; b < value_head_len; b++)
+            {
+                value_head[b] = (uint8_t)(bits >> (8 * (value_head_len - 1 - b)));
+            }
+            break;
+        }
+        case SERIAL_LOG_FIELD_BOOL:
+            value_head[0] = field->value.b ? 0xF5 : 0xF4;
+            value_head_len = 1;
+            break;
+        case SERIAL_LOG_FIELD_STR:
+            payload = field->value.s ? field->value.s : "";
+            payload_len = strlen((const char*)payload);
+            value_head_len = (uint8_t)(log_cbor_head(value_head, LOG_CBOR_TEXT, payload_len) - value_head);
+            break;
+        case SERIAL_LOG_FIELD_BYTES:
+            payload = field->value.bytes.data;
+            payload_len = field->value.bytes.len;
+            value_head_len = (uint8_t)(log_cbor_head(value_head, LOG_CBOR_BYTES, payload_len) - value_head);
+            break;
+        default:
+            continue;
+        }
+
+        if (key_head_len + key_len + value_head_len + payload_len > (size_t)(end - p))
+        {
+            *truncated = true;
+            break;
+        }
+        memcpy(p, key_head, key_head_len);
+        p += key_head_len;
+        memcpy(p, field->key, key_len);
+        p += key_len;
+        memcpy(p, value_head, value_head_len);
+        p += value_head_len;
+        if (payload_len)
+        {
+            memcpy(p, payload, payload_len);
+            p += payload_len;
+        }
+        kept++;
+    }
+
+    uint8_t map_head[2];
+    uint8_t map_head_len = (uint8_t)(log_cbor_head(map_head, LOG_CBOR_MAP, kept) - map_head);
+    uint16_t length = (uint16_t)(p - buf - 2);
+    memmove(buf + map_head_len, buf + 2, length);
+    memcpy(buf, map_head, map_head_len);
+    return (uint16_t)(map_head_len + length);
+}
+
+static uint16_t log_kv_text(char *buf, uint16_t size, const char *message,
+                            const serial_log_field_t *fields, uint8_t count, bool *truncated)
+{
+    /* Message followed by " key=value" per field, strings in quotes and
+       bytes in hex */
+    int n = log_snprintf(buf, size, "%s", message);
+    int length = log_clamp(n, size);
+    *truncated |= (n >= size);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const serial_log_field_t *field = &fields[i];
+        char *p = buf + length;
+        int room = size - length;
+        switch (field->type)
+        {
+        case SERIAL_LOG_FIELD_INT:
+            n = log_snprintf(p, room, " %s=%lld", field->key, (long long)field->value.i);
+            break;
+        case SERIAL_LOG_FIELD_UINT:
+            n = log_snprintf(p, room, " %s=%llu", field->key, (unsigned long long)field->value.u);
+            break;
+        case SERIAL_LOG_FIELD_FLOAT:
+            n = log_snprintf(p, room, " %s=%f", field->key, field->value.f);
+            break;
+        case SERIAL_LOG_FIELD_BOOL:
+            n = log_snprintf(p, room, " %s=%s", field->key, field->value.b ? "true" : "false");
+            break;
+        case SERIAL_LOG_FIELD_STR:
+            n = log_snprintf(p, room, " %s=\"%s\"", field->key, field->value.s ? field->value.s : "");
+            break;
+        case SERIAL_LOG_FIELD_BYTES:
+        {
+            n = log_snprintf(p, room, " %s=", field->key);
+            const uint8_t *data = (const uint8_t*)field->value.bytes.data;
+            for (uint16_t b = 0; b < field->value.bytes.len; b++)
+            {
+                if (n + 2 >= room)
+                {
+                    n = room;
+                    break;
+                }
+                p[n++] = hex_digits[data[b] >> 4];
+                p[n++] = hex_digits[data[b] & 0xF];
+            }
+            break;
+        }
+        default:
+            n = 0;
+            break;
+        }
+        length += log_clamp(n, room);
+        *truncated |= (n >= room);
+    }
+    return (uint16_t)length;
+}
+
+static uint32_t log_binary_timestamp(serial_log_level_t *level)
+{
+    /* Microsecond timestamps are cut to 32 bits and flagged in the level */
+    if (FuncGetTimeUs)
+    {
+        *level = (serial_log_level_t)(*level | LOG_BINARY_LEVEL_US);
+        return (uint32_t)FuncGetTimeUs();
+    }
+    return FuncGetTick();
+}
+
+static bool log_output_binary(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, va_list list)
+{
+    level = log_level_normalize(level);
+    serial_log_level_t flagged = level;
+    uint32_t timestamp = log_binary_timestamp(&flagged);
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        return false;
+    }
+
+    serial_log_iovec_t iov = { buf, log_binary_encode((uint8_t*)buf, LOG_BUF_SIZE, flagged, tag, timestamp, format, list) };
+    log_sink_dispatch(sinks, level, &iov, 1);
+    log_buf_release(buf);
+    return true;
+}
+
+static char *log_buf_acquire(void)
+{
+#ifdef USE_PTHREAD
+    return log_buf;
+#else
+    /* Claim the lowest free buffer of the pool */
+    uint32_t used = atomic_load(&log_buf_pool_used);
+    for (;;)
+    {
+        uint32_t available = ~used & (uint32_t)((1ULL << LOG_BUF_POOL_SIZE) - 1);
+        if (!available)
+        {
+            return NULL;
+        }
+        uint32_t bit = available & (~available + 1);
+        if (atomic_cas(&log_buf_pool_used, &used, used | bit))
+        {
+            return log_buf_pool[__builtin_ctz(bit)];
+        }
+    }
+#endif
+}
+
+static void log_buf_release(char *buf)
+{
+#ifdef USE_PTHREAD
+    (void)buf;
+#else
+    uint32_t bit = 1u << ((buf - log_buf_pool[0]) / LOG_BUF_SIZE);
+    uint32_t used = atomic_load(&log_buf_pool_used);
+    while (!atomic_cas(&log_buf_pool_used, &used, used & ~bit));
+#endif
+}
+
+static uint32_t log_sink_select(serial_log_level_t level, const char *tag)
+{
+    /* Sinks whose level and tag filter accept the record */
+    uint32_t active = atomic_load(&log_sink_active);
+    uint32_t selected = 0;
+    while (active)
+    {
+        uint32_t index = __builtin_ctz(active);
+        log_sink_t *sink = &log_sinks[index];
+        active &= active - 1;
+
+        if (level > atomic_load_relaxed(&sink->level))
+        {
+            continue;
+        }
+        if (sink->tag && sink->tag != tag && strcmp(sink->tag, tag) != 0)
+        {
+            continue;
+        }
+        selected |= 1u << index;
+    }
+    return selected;
+}
+
+static void log_sink_dispatch(uint32_t sinks, serial_log_level_t level, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+    (void)level;
+    while (sinks)
+    {
+        log_sink_t *sink = &log_sinks[__builtin_ctz(sinks)];
+        sinks &= sinks - 1;
+#ifdef USE_LOG_ASYNC
+        /* A sink without its drain task is written from the caller */
+        if (atomic_load_relaxed(&sink->ring.initialized))
+        {
+            log_record_t rec = { .head = iov, .head_cnt = iovcnt };
+            log_async_write(sink, level, &rec);
+            continue;
+        }
+#endif
+        log_sink_writev(sink, iov, iovcnt);
+    }
+}
+
+static void log_record_dispatch(uint32_t sinks, serial_log_level_t level, log_record_t *rec)
+{
+    (void)level;
+    while (sinks)
+    {
+        log_sink_t *sink = &log_sinks[__builtin_ctz(sinks)];
+        sinks &= sinks - 1;
+#ifdef USE_LOG_ASYNC
+        if (atomic_load_relaxed(&sink->ring.initialized))
+        {
+            log_async_write(sink, level, rec);
+            continue;
+        }
+#endif
+        log_record_write(sink, rec);
+    }
+}
+
+static bool log_record_init(log_record_t *rec, char *piece, uint16_t piece_size, int length,
+                            const char *format, va_list list)
+{
+    /* piece holds the start of the message from the first pass. Returns true
+       when the message is cut at LOG_RECORD_MAX. */
+    uint32_t message_len = (length < 0) ? 0 : (uint32_t)length;
+    if (message_len > LOG_RECORD_MAX)
+    {
+        message_len = LOG_RECORD_MAX;
+    }
+    rec->head_cnt = 0;
+    rec->tail_cnt = 0;
+    rec->format = format;
+    va_copy(rec->list, list);
+    rec->message_len = message_len;
+    rec->piece = piece;
+    rec->piece_offset = 0;
+    rec->piece_len = (uint16_t)((message_len < piece_size) ? message_len : piece_size);
+    rec->piece_size = piece_size;
+    return length > LOG_RECORD_MAX;
+}
+
+static void log_record_message(log_record_t *rec, uint32_t offset, char *dst, uint32_t size)
+{
+    /* From the piece held when it has these characters, else formatted again */
+    if (offset >= rec->piece_offset && offset + size <= rec->piece_offset + rec->piece_len)
+    {
+        memcpy(dst, rec->piece + (offset - rec->piece_offset), size);
+        return;
+    }
+#ifdef USE_LOG_FORMATTER
+    va_list list;
+    va_copy(list, rec->list);
+    uint32_t length = log_vformat_piece(dst, size, offset, rec->format, list);
+    va_end(list);
+    /* Shorter when an argument changed since the first pass */
+    memset(dst + length, ' ', size - length);
+#endif
+}
+
+#ifdef USE_LOG_ASYNC
+static uint32_t log_record_length(const log_record_t *rec)
+{
+    uint32_t length = rec->message_len;
+    for (uint8_t i = 0; i < rec->head_cnt; i++)
+    {
+        length += rec->head[i].len;
+    }
+    for (uint8_t i = 0; i < rec->tail_cnt; i++)
+    {
+        length += rec->tail[i].len;
+    }
+    return length;
+}
+
+static uint32_t log_record_read(log_record_t *rec, uint32_t offset, char *dst, uint32_t size)
+{
+    /* Bytes offset to offset + size of the record, the head, the message and
+       the tail one after another */
+    uint32_t done = 0;
+    uint32_t start = 0;
+    uint8_t count = rec->head_cnt + 1 + rec->tail_cnt;
+    for (uint8_t i = 0; i < count && done < size; i++)
+    {
+        const serial_log_iovec_t *segment = (i < rec->head_cnt) ? &rec->head[i]
+                                          : (i > rec->head_cnt) ? &rec->tail[i - rec->head_cnt - 1] : NULL;
+        uint32_t len = segment ? segment->len : rec->message_len;
+        if (offset + done < start + len)
+        {
+            uint32_t skip = offset + done - start;
+            uint32_t n = (len - skip < size - done) ? len - skip : size - done;
+            if (segment)
+            {
+                memcpy(dst + done, (const char*)segment->data + skip, n);
+            }
+            else
+            {
+                log_record_message(rec, skip, dst + done, n);
+            }
+            done += n;
+        }
+        start += len;
+    }
+    return done;
+}
+#endif
+
+static void log_record_write(log_sink_t *sink, log_record_t *rec)
+{
+    /* The segments are passed by reference and the message a piece at a
+       time, all under the lock so other records do not come in between */
+    serial_log_iovec_t iov[LOG_SINK_IOV_MAX];
+    uint8_t iovcnt = rec->head_cnt;
+    memcpy(iov, rec->head, iovcnt * sizeof(iov[0]));
+    log_mutex_lock(&sink->lock);
+    uint32_t offset = 0;
+    do
+    {
+        if (rec->piece_offset != offset)
+        {
+            uint16_t len = (uint16_t)((rec->message_len - offset < rec->piece_size) ?
+                                      rec->message_len - offset : rec->piece_size);
+            rec->piece_len = 0;
+            log_record_message(rec, offset, rec->piece, len);
+            rec->piece_offset = offset;
+            rec->piece_len = len;
+        }
+        iov[iovcnt].data = rec->piece;
+        iov[iovcnt++].len = rec->piece_len;
+        offset += rec->piece_len;
+        if (offset >= rec->message_len)
+        {
+            memcpy(iov + iovcnt, rec->tail, rec->tail_cnt * sizeof(iov[0]));
+            iovcnt += rec->tail_cnt;
+        }
+        log_sink_emit(sink, iov, iovcnt);
+        iovcnt = 0;
+    } while (offset < rec->message_len);
+    log_mutex_unlock(&sink->lock);
+}
+
+static void log_sink_writev(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+    log_mutex_lock(&sink->lock);
+    log_sink_emit(sink, iov, iovcnt);
+    log_mutex_unlock(&sink->lock);
+}
+
+static void log_sink_emit(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+    /* Called with the sink lock held */
+#ifdef USE_LOG_COMPRESS
+    if (sink->compress.enabled)
+    {
+        log_compress_write(sink, iov, iovcnt);
+    }
+    else
+#endif
+    {
+        log_sink_output(sink, iov, iovcnt);
+    }
+}
+
+static void log_sink_output(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+#ifdef USE_LOG_STATS
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    for (uint8_t i = 0; i < iovcnt; i++)
+    {
+        LOG_STAT_ADD(bytes, iov[i].len);
+    }
+#endif
+#ifdef USE_LOG_DMA
+    if (sink->log_dma)
+    {
+        log_dma_write(sink, iov, iovcnt);
+    }
+    else
+#endif
+    if (sink->log_vec)
+    {
+        sink->log_vec(iov, iovcnt, 100);
+    }
+    else if (sink->log)
+    {
+        /* Adapt onto the plain log function, one call per segment */
+        for (uint8_t i = 0; i < iovcnt; i++)
+        {
+            sink->log((uint8_t*)iov[i].data, iov[i].len, 100);
+        }
+    }
+#ifdef USE_LOG_STATS
+    if (FuncGetCounter)
+    {
+        LOG_STAT_ADD(sink_time, FuncGetCounter() - start);
+    }
+#endif
+}
+
+#ifdef USE_LOG_DMA
+static void log_dma_write(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+    /* Called with the sink lock held, so there is one writer. A record is
+       copied whole or dropped, transfers never carry a cut one. */
+    log_dma_t *dma = &sink->dma;
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < iovcnt; i++)
+    {
+        total += iov[i].len;
+    }
+
+    uint32_t wait_start = FuncGetTick ? FuncGetTick() : 0;
+    for (;;)
+    {
+        log_dma_enter(dma);
+        if (log_dma_room(dma) >= total)
+        {
+            break;
+        }
+        log_dma_leave(sink);
+        if (atomic_load_relaxed(&sink->overflow) != SERIAL_LOG_OVERFLOW_BLOCK || !log_dma_wait(sink, wait_start))
+        {
+            LOG_STAT_ADD(dma_dropped, 1);
+            return;
+        }
+    }
+
+    for (uint8_t i = 0; i < iovcnt; i++)
+    {
+        const uint8_t *data = iov[i].data;
+        uint16_t len = iov[i].len;
+        while (len)
+        {
+            uint32_t index = atomic_load_relaxed(&dma->closed) & (LOG_DMA_BUF_COUNT - 1);
+            uint16_t space = LOG_DMA_BUF_SIZE - dma->len[index];
+            uint16_t n = (len < space) ? len : space;
+            memcpy(dma->buf[index] + dma->len[index], data, n);
+            dma->len[index] += n;
+            data += n;
+            len -= n;
+            if (dma->len[index] == LOG_DMA_BUF_SIZE)
+            {
+                log_dma_close(dma);
+                log_dma_kick(sink);
+            }
+        }
+    }
+    log_dma_leave(sink);
+}
+
+static uint32_t log_dma_room(log_dma_t *dma)
+{
+    /* Bytes the writer can copy before it runs out of free buffers */
+    uint32_t closed = atomic_load_relaxed(&dma->closed);
+    uint32_t queued = closed - atomic_load(&dma->done);
+    if (queued >= LOG_DMA_BUF_COUNT)
+    {
+        return 0;
+    }
+    return (LOG_DMA_BUF_COUNT - 1 - queued) * LOG_DMA_BUF_SIZE +
+           LOG_DMA_BUF_SIZE - dma->len[closed & (LOG_DMA_BUF_COUNT - 1)];
+}
+
+static void log_dma_enter(log_dma_t *dma)
+{
+    /* Take the open buffer. The completion interrupt only holds it for a
+       moment, and only on another core can the writer see that. */
+    uint32_t state = 0;
+    while (!atomic_cas(&dma->state, &state, LOG_DMA_WRITING))
+    {
+        state = 0;
+    }
+}
+
+static void log_dma_leave(log_sink_t *sink)
+{
+    /* Release the open buffer. It is closed when no transfer is in flight, or
+       when the completion interrupt asked for it meanwhile, so records wait
+       in it only while the transport is busy. */
+    log_dma_t *dma = &sink->dma;
+    uint32_t state = LOG_DMA_WRITING;
+    do
+    {
+        atomic_fence();
+        if ((state & LOG_DMA_FLUSH) || !atomic_load(&dma->busy))
+        {
+            log_dma_close(dma);
+        }
+    } while (!atomic_cas(&dma->state, &state, 0));
+    log_dma_kick(sink);
+}
+
+static void log_dma_close(log_dma_t *dma)
+{
+    /* Called by the holder of the open buffer, queues it for transfer */
+    uint32_t closed = atomic_load_relaxed(&dma->closed);
+    if (closed - atomic_load(&dma->done) < LOG_DMA_BUF_COUNT && dma->len[closed & (LOG_DMA_BUF_COUNT - 1)])
+    {
+        atomic_store(&dma->closed, closed + 1);
+    }
+}
+
+static void log_dma_request_close(log_dma_t *dma)
+{
+    /* Close the open buffer now, or have the writer close it on its way out */
+    uint32_t state = atomic_load(&dma->state);
+    for (;;)
+    {
+        if (state == 0)
+        {
+            if (atomic_cas(&dma->state, &state, LOG_DMA_CLOSING))
+            {
+                log_dma_close(dma);
+                atomic_store(&dma->state, 0);
+                return;
+            }
+        }
+        else if ((state & (LOG_DMA_CLOSING | LOG_DMA_FLUSH)) ||
+                 atomic_cas(&dma->state, &state, state | LOG_DMA_FLUSH))
+        {
+            return;
+        }
+    }
+}
+
+static void log_dma_kick(log_sink_t *sink)
+{
+    /* Start the oldest closed buffer unless a transfer is in flight. The
+       writer and the completion interrupt both call this, busy picks one. */
+    log_dma_t *dma = &sink->dma;
+    for (;;)
+    {
+        atomic_fence();
+        if (atomic_load(&dma->done) == atomic_load(&dma->closed))
+        {
+            return;
+        }
+        uint32_t busy = 0;
+        if (!atomic_cas(&dma->busy, &busy, 1))
+        {
+            if (busy)
+            {
+                return;
+            }
+            continue;
+        }
+
+        /* No transfer in flight, so done holds still */
+        uint32_t done = atomic_load(&dma->done);
+        if (done != atomic_load(&dma->closed))
+        {
+            uint32_t index = done & (LOG_DMA_BUF_COUNT - 1);
+            sink->log_dma(dma->buf[index], dma->len[index]);
+            return;
+        }
+        atomic_store(&dma->busy, 0);
+    }
+}
+
+static bool log_dma_wait(log_sink_t *sink, uint32_t wait_start)
+{
+    /* Let transfers complete, returns false when the timeout is over or the
+       caller can not wait */
+    if (!FuncGetTick || FuncGetTick() - wait_start >= atomic_load_relaxed(&sink->block_timeout))
+    {
+        return false;
+    }
+#ifdef USE_RTOS
+    if (xPortIsInsideInterrupt() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    {
+        return false;
+    }
+    vTaskDelay(1);
+#elif defined(USE_PTHREAD)
+    sched_yield();
+#endif
+    return true;
+}
+
+static void log_dma_drain(log_sink_t *sink)
+{
+    /* Called with the sink lock held. Hands over the open buffer and waits
+       for every transfer to complete. */
+    log_dma_t *dma = &sink->dma;
+    log_dma_enter(dma);
+    log_dma_close(dma);
+    log_dma_leave(sink);
+    while (atomic_load(&dma->done) != atomic_load(&dma->closed))
+    {
+#ifdef USE_RTOS
+        if (!xPortIsInsideInterrupt() && xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+        {
+            vTaskDelay(1);
+        }
+#elif defined(USE_PTHREAD)
+        sched_yield();
+#endif
+    }
+}
+#endif
+
+#ifdef USE_LOG_COMPRESS
+static inline uint32_t log_compress_hash(const log_compress_t *lz, uint32_t pos)
+{
+    /* Hash of the 4 bytes at pos */
+    uint32_t value = lz->window[pos & (LOG_COMPRESS_WINDOW - 1)] |
+                     (lz->window[(pos + 1) & (LOG_COMPRESS_WINDOW - 1)] << 8) |
+                     (lz->window[(pos + 2) & (LOG_COMPRESS_WINDOW - 1)] << 16) |
+                     ((uint32_t)lz->window[(pos + 3) & (LOG_COMPRESS_WINDOW - 1)] << 24);
+    return (value * 2654435761u) >> (32 - LOG_COMPRESS_HASH_BITS);
+}
+
+static inline uint8_t *log_compress_length(uint8_t *out, uint32_t length)
+{
+    /* Length above the 4 bits of the token, in bytes of 255 and a remainder */
+    while (length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+static uint8_t *log_compress_sequence(log_compress_t *lz, uint8_t *out, uint32_t literal, uint32_t literal_len,
+                                      uint32_t offset, uint32_t match_len)
+{
+    /* Token with literal and match length, literals, offset and the rest of
+       the match length. The last sequence of a frame has no match. */
+    uint8_t *token = out++;
+    *token = (uint8_t)(((literal_len < 15) ? literal_len : 15) << 4);
+    if (literal_len >= 15)
+    {
+        out = log_compress_length(out, literal_len - 15);
+    }
+    for (uint32_t i = 0; i < literal_len; i++)
+    {
+        *out++ = lz->window[(literal + i) & (LOG_COMPRESS_WINDOW - 1)];
+    }
+    if (match_len)
+    {
+        match_len -= LOG_COMPRESS_MIN_MATCH;
+        *token |= (match_len < 15) ? match_len : 15;
+        *out++ = (uint8_t)offset;
+        *out++ = (uint8_t)(offset >> 8);
+        if (match_len >= 15)
+        {
+            out = log_compress_length(out, match_len - 15);
+        }
+    }
+    return out;
+}
+
+static void log_compress_piece(log_sink_t *sink, const uint8_t *data, uint32_t length)
+{
+    log_compress_t *lz = &sink->compress;
+
+    /* Start a new history now and then, a decoder joining the stream or
+       recovering from lost bytes picks up from there */
+    bool reset = (lz->pos - lz->reset_pos >= LOG_COMPRESS_RESET) || !lz->started;
+    if (reset)
+    {
+        lz->reset_pos = lz->pos;
+        lz->started = true;
+    }
+
+    /* Append the input to the window first, matches are searched there */
+    uint32_t start = lz->pos;
+    uint32_t end = start + length;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        lz->window[(start + i) & (LOG_COMPRESS_WINDOW - 1)] = data[i];
+    }
+    lz->pos = end;
+
+    /* Oldest position still in the window and known to the decoder */
+    uint32_t oldest = end - LOG_COMPRESS_WINDOW;
+    if ((int32_t)(lz->reset_pos - oldest) > 0)
+    {
+        oldest = lz->reset_pos;
+    }
+
+    uint8_t *out = lz->out + LOG_COMPRESS_FRAME_HEADER;
+    uint32_t anchor = start;
+    uint32_t p = start;
+    while (end - p >= LOG_COMPRESS_MIN_MATCH)
+    {
+        uint32_t *slot = &lz->table[log_compress_hash(lz, p)];
+        uint32_t candidate = *slot;
+        *slot = p;
+
+        uint32_t match_len = 0;
+        if ((int32_t)(candidate - oldest) >= 0 && (int32_t)(p - candidate) > 0)
+        {
+            while (p + match_len < end &&
+                   lz->window[(candidate + match_len) & (LOG_COMPRESS_WINDOW - 1)] ==
+                   lz->window[(p + match_len) & (LOG_COMPRESS_WINDOW - 1)])
+            {
+                match_len++;
+            }
+        }
+        if (match_len < LOG_COMPRESS_MIN_MATCH)
+        {
+            p++;
+            continue;
+        }
+
+        out = log_compress_sequence(lz, out, anchor, p - anchor, p - candidate, match_len);
+        p += match_len;
+        anchor = p;
+    }
+    out = log_compress_sequence(lz, out, anchor, end - anchor, 0, 0);
+
+    /* Frame header: sync byte, then the payload length with the reset flag */
+    uint16_t frame_len = (uint16_t)(out - lz->out - LOG_COMPRESS_FRAME_HEADER);
+    lz->out[0] = LOG_COMPRESS_SYNC;
+    lz->out[1] = (uint8_t)frame_len;
+    lz->out[2] = (uint8_t)((frame_len >> 8) | (reset ? 0x80 : 0));
+
+    serial_log_iovec_t frame = { lz->out, (uint16_t)(out - lz->out) };
+    log_sink_output(sink, &frame, 1);
+}
+
+static void log_compress_write(log_sink_t *sink, const serial_log_iovec_t *iov, uint8_t iovcnt)
+{
+    /* Each piece must leave room in the window for the history it refers to */
+    for (uint8_t i = 0; i < iovcnt; i++)
+    {
+        const uint8_t *data = (const uint8_t*)iov[i].data;
+        uint32_t length = iov[i].len;
+        while (length)
+        {
+            uint32_t piece = (length < LOG_COMPRESS_PIECE) ? length : LOG_COMPRESS_PIECE;
+            log_compress_piece(sink, data, piece);
+            data += piece;
+            length -= piece;
+        }
+    }
+}
+#endif
+
+static void log_sink_configure(uint8_t index, const serial_log_sink_t *config)
+{
+    /* Called with set_log_lock held. Take the sink out of use and wait for a
+       call in progress, so loggers never see it half changed. */
+    log_sink_t *sink = &log_sinks[index];
+    uint32_t bit = 1u << index;
+    atomic_store(&log_sink_active, log_sink_active & ~bit);
+
+    log_mutex_lock(&sink->lock);
+#ifdef USE_LOG_DMA
+    /* Transfers in flight complete through the old function */
+    if (sink->log_dma)
+    {
+        log_dma_drain(sink);
+    }
+    sink->log_dma = config ? config->log_dma : NULL;
+#endif
+    sink->log = config ? config->log : NULL;
+    sink->log_vec = config ? config->log_vec : NULL;
+    sink->tag = config ? config->tag : NULL;
+    if (config)
+    {
+        sink->overflow = (uint8_t)config->overflow;
+        sink->block_timeout = config->block_timeout_ms;
+    }
+#ifdef USE_LOG_COMPRESS
+    /* The decoder starts over with the first frame */
+    sink->compress.enabled = config ? config->compress : false;
+    sink->compress.started = false;
+#endif
+    atomic_store(&sink->level, config ? (uint8_t)config->level : (uint8_t)SERIAL_LOG_NONE);
+    log_mutex_unlock(&sink->lock);
+
+    if (config)
+    {
+#ifdef USE_LOG_ASYNC
+        log_async_init(sink);
+#endif
+        if (config->format == SERIAL_LOG_FORMAT_BINARY)
+        {
+            atomic_store(&log_sink_binary, log_sink_binary | bit);
+        }
+        else
+        {
+            atomic_store(&log_sink_binary, log_sink_binary & ~bit);
+        }
+        if (config->format == SERIAL_LOG_FORMAT_CBOR)
+        {
+            atomic_store(&log_sink_cbor, log_sink_cbor | bit);
+        }
+        else
+        {
+            atomic_store(&log_sink_cbor, log_sink_cbor & ~bit);
+        }
+        atomic_store(&log_sink_active, log_sink_active | bit);
+    }
+    log_sink_update_level();
+}
+
+static void log_sink_update_level(void)
+{
+    /* Records above every sink level are dropped before the tag lookup */
+    uint8_t level = SERIAL_LOG_NONE;
+    for (uint32_t active = log_sink_active; active; active &= active - 1)
+    {
+        uint8_t sink_level = log_sinks[__builtin_ctz(active)].level;
+        if (sink_level > level)
+        {
+            level = sink_level;
+        }
+    }
+    atomic_store(&log_sink_level, level);
+    log_level_limit_update();
+}
+
+static void log_level_limit_update(void)
+{
+    /* Most verbose of the default level and the levels set per tag, capped
+       by the sinks */
+    uint8_t level = set_log_default_level;
+    uncached_tag_entry_t *it;
+    for (int i = 0; i < TAG_HASH_SIZE; i++)
+    {
+        SLIST_FOREACH(it, &set_log_tags[i], entries)
+        {
+            if (it->level != TAG_LEVEL_DEFAULT && it->level > level)
+            {
+                level = it->level;
+            }
+        }
+    }
+    for (log_tag_pattern_t *pattern = set_log_patterns; pattern != NULL; pattern = pattern->next)
+    {
+        if (pattern->level != TAG_LEVEL_DEFAULT && pattern->level > level)
+        {
+            level = pattern->level;
+        }
+    }
+    if (level > log_sink_level)
+    {
+        level = log_sink_level;
+    }
+    atomic_store(&serial_log_level_limit, level);
+}
+
+int serial_log_sink_add(const serial_log_sink_t *sink)
+{
+    log_config_lock();
+
+    /* The first sink is kept for serial_log_function_set */
+    int index = -1;
+    for (uint8_t i = 1; i < LOG_SINK_MAX; i++)
+    {
+        if (!(log_sink_active & (1u << i)))
+        {
+            log_sink_configure(i, sink);
+            index = i;
+            break;
+        }
+    }
+
+    log_mutex_unlock(&set_log_lock);
+    return index;
+}
+
+void serial_log_sink_remove(int sink)
+{
+    if (sink <= 0 || sink >= LOG_SINK_MAX)
+    {
+        return;
+    }
+
+    log_config_lock();
+    log_sink_configure(sink, NULL);
+    log_mutex_unlock(&set_log_lock);
+}
+
+void serial_log_sink_level_set(int sink, serial_log_level_t level)
+{
+    if (sink < 0 || sink >= LOG_SINK_MAX)
+    {
+        return;
+    }
+
+    log_config_lock();
+    atomic_store(&log_sinks[sink].level, (uint8_t)level);
+    log_sink_update_level();
+    log_mutex_unlock(&set_log_lock);
+}
+
+void serial_log_sink_overflow_set(int sink, serial_log_overflow_t overflow, uint32_t block_timeout_ms)
+{
+    if (sink < 0 || sink >= LOG_SINK_MAX)
+    {
+        return;
+    }
+
+    /* Loggers read the two fields separately, a record racing with the change
+       may see the new policy with the old timeout */
+    log_config_lock();
+    atomic_store(&log_sinks[sink].block_timeout, block_timeout_ms);
+    atomic_store(&log_sinks[sink].overflow, (uint8_t)overflow);
+    log_mutex_unlock(&set_log_lock);
+}
+
+void serial_log_dma_complete(int sink)
+{
+#ifdef USE_LOG_DMA
+    if (sink < 0 || sink >= LOG_SINK_MAX)
+    {
+        return;
+    }
+
+    /* Recycle the buffer, then start the next one. When none is queued, the
+       records gathered during the transfer go out now. */
+    log_sink_t *dma_sink = &log_sinks[sink];
+    log_dma_t *dma = &dma_sink->dma;
+    if (!atomic_load(&dma->busy))
+    {
+        return;
+    }
+    uint32_t done = atomic_load_relaxed(&dma->done);
+    dma->len[done & (LOG_DMA_BUF_COUNT - 1)] = 0;
+    atomic_store(&dma->done, done + 1);
+    atomic_store(&dma->busy, 0);
+    atomic_fence();
+    if (done + 1 == atomic_load(&dma->closed))
+    {
+        log_dma_request_close(dma);
+    }
+    log_dma_kick(dma_sink);
+#else
+    (void)sink;
+#endif
+}
+
+void serial_log_write(serial_log_level_t level, const char* tag, const char* format, ...)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    va_list list;
+    va_start(list, format);
+    log_output_text(sinks, level, format, list);
+    va_end(list);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_write_binary(serial_log_level_t level, const char *tag, const char *format, ...)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    va_list list;
+    va_start(list, format);
+    if (log_output_binary(sinks, level, tag, format, list))
+    {
+        LOG_STAT_ADD(emitted[log_level_normalize(level)], 1);
+    }
+    va_end(list);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record(serial_log_level_t level, const char *tag, const char *format, ...)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    va_list list;
+    va_start(list, format);
+    log_output_record(sinks, level, tag, format, list);
+    va_end(list);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record_tag(serial_log_level_t level, serial_log_tag_t *tag, const char *format, ...)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_tag_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    va_list list;
+    va_start(list, format);
+    log_output_record(sinks, level, tag->name, format, list);
+    va_end(list);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record_kv(serial_log_level_t level, const char *tag, const char *message,
+                          const serial_log_field_t *fields, uint8_t count)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_select(level, tag, message);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    log_output_kv(sinks, level, tag, message, fields, count);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record_render(serial_log_level_t level, const char *tag, const char *format,
+                              serial_log_render_t render, const void *ctx)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    log_output_render(sinks, level, tag, format, render, ctx);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record_tag_render(serial_log_level_t level, serial_log_tag_t *tag, const char *format,
+                                  serial_log_render_t render, const void *ctx)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    uint32_t sinks = log_record_tag_select(level, tag, format);
+    if (!sinks)
+    {
+        log_latency_update(start);
+        return;
+    }
+
+    log_output_render(sinks, level, tag->name, format, render, ctx);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+uint32_t serial_log_select(serial_log_level_t level, const char *tag, const char *format)
+{
+    return log_record_select(level, tag, format);
+}
+
+void serial_log_record_sinks(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, ...)
+{
+    /* Sinks from serial_log_select, the record is not filtered again */
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    va_list list;
+    va_start(list, format);
+    log_output_record(sinks, level, tag, format, list);
+    va_end(list);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+void serial_log_record_kv_sinks(uint32_t sinks, serial_log_level_t level, const char *tag, const char *message,
+                                const serial_log_field_t *fields, uint8_t count)
+{
+    uint32_t start = FuncGetCounter ? FuncGetCounter() : 0;
+    log_output_kv(sinks, level, tag, message, fields, count);
+    log_latency_update(start);
+    log_stats_emit();
+}
+
+static uint32_t log_record_select(serial_log_level_t level, const char *tag, const char *format)
+{
+    /* Sinks a record goes to after the level, tag, rate and duplicate
+       filters. Records stopped are counted here. */
+    uint32_t sinks = 0;
+    if (level <= atomic_load_relaxed(&serial_log_level_limit) && log_level_check(level, tag))
+    {
+        sinks = log_sink_select(level, tag);
+        if (sinks && !(sinks = log_isr_filter(sinks, level)))
+        {
+            return 0;
+        }
+        sinks = log_dedup_filter(sinks, level, tag, format);
+    }
+    if (!sinks)
+    {
+        LOG_STAT_ADD(filtered[log_level_normalize(level)], 1);
+    }
+    return sinks;
+}
+
+static uint32_t log_record_tag_select(serial_log_level_t level, serial_log_tag_t *tag, const char *format)
+{
+    if (atomic_load(&tag->level) == SERIAL_LOG_TAG_UNRESOLVED)
+    {
+        serial_log_tag_register(tag);
+    }
+    uint32_t sinks = 0;
+    if (should_output(level, (serial_log_level_t)atomic_load(&tag->level)) &&
+        (!atomic_load_relaxed(&set_log_rate_used) || log_level_check(level, tag->name)))
+    {
+        sinks = log_sink_select(level, tag->name);
+        if (sinks && !(sinks = log_isr_filter(sinks, level)))
+        {
+            return 0;
+        }
+        sinks = log_dedup_filter(sinks, level, tag->name, format);
+    }
+    if (!sinks)
+    {
+        LOG_STAT_ADD(filtered[log_level_normalize(level)], 1);
+    }
+    return sinks;
+}
+
+static inline uint32_t log_isr_filter(uint32_t sinks, serial_log_level_t level)
+{
+#ifdef USE_RTOS
+    /* Sinks are written under a mutex, which an ISR cannot take. A record
+       logged from an ISR only goes to the sinks with an async queue to defer
+       to, and is dropped when there is none. */
+    if (xPortIsInsideInterrupt())
+    {
+        uint32_t queued = 0;
+#ifdef USE_LOG_ASYNC
+        for (uint32_t rest = sinks; rest; rest &= rest - 1)
+        {
+            if (atomic_load_relaxed(&log_sinks[__builtin_ctz(rest)].ring.initialized))
+            {
+                queued |= rest & -rest;
+            }
+        }
+#endif
+        if (!queued)
+        {
+            LOG_STAT_ADD(dropped[log_level_normalize(level)], 1);
+        }
+        return queued;
+    }
+#endif
+    (void)level;
+    return sinks;
+}
+
+void serial_log_dedup_set(uint32_t window_ms)
+{
+    atomic_store(&log_dedup_window, window_ms);
+}
+
+static void log_output_record_args(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list list;
+    va_start(list, format);
+    log_output_record(sinks, level, tag, format, list);
+    va_end(list);
+}
+
+static uint32_t log_dedup_filter(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format)
+{
+    uint32_t window = atomic_load_relaxed(&log_dedup_window);
+    if (!sinks || !window)
+    {
+        return sinks;
+    }
+
+    uintptr_t addr = (uintptr_t)format;
+    log_dedup_entry_t *entry = &log_dedup[((addr >> 2) ^ (addr >> 7)) & (LOG_DEDUP_SIZE - 1)];
+    uint32_t busy = 0;
+    if (!atomic_cas(&entry->busy, &busy, 1))
+    {
+        return sinks;
+    }
+
+    /* Records from the same call site within the window are only counted.
+       The count left by the record before, of this call site or of another
+       one taking the entry, is output first. */
+    uint32_t now = FuncGetTick ? FuncGetTick() : 0;
+    uint32_t repeated = 0;
+    serial_log_level_t repeated_level = SERIAL_LOG_NONE;
+    const char *repeated_tag = NULL;
+    if (entry->format == format && now - entry->tick < window)
+    {
+        entry->count++;
+        entry->level = (uint8_t)level;
+        entry->tag = tag;
+        sinks = 0;
+    }
+    else
+    {
+        repeated = entry->count;
+        repeated_level = (serial_log_level_t)entry->level;
+        repeated_tag = entry->tag;
+        entry->format = format;
+        entry->tick = now;
+        entry->count = 0;
+    }
+    atomic_store(&entry->busy, 0);
+
+    if (repeated)
+    {
+        log_dedup_notice(repeated_level, repeated_tag, repeated);
+    }
+    return sinks;
+}
+
+static void log_dedup_notice(serial_log_level_t level, const char *tag, uint32_t repeated)
+{
+    /* At the level and tag of the suppressed records, to the sinks they
+       would have gone to */
+    uint32_t sinks = log_sink_select(level, tag);
+    if (sinks)
+    {
+        log_output_record_args(sinks, level, tag, "last message repeated %u times", (unsigned)repeated);
+    }
+}
+
+static void log_dedup_flush(void)
+{
+    /* Output the counts still pending, the call sites stay suppressed for
+       the rest of their window */
+    if (!atomic_load_relaxed(&log_dedup_window))
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < LOG_DEDUP_SIZE; i++)
+    {
+        log_dedup_entry_t *entry = &log_dedup[i];
+        uint32_t busy = 0;
+        if (!atomic_load_relaxed(&entry->count) || !atomic_cas(&entry->busy, &busy, 1))
+        {
+            continue;
+        }
+        uint32_t repeated = entry->count;
+        serial_log_level_t level = (serial_log_level_t)entry->level;
+        const char *tag = entry->tag;
+        entry->count = 0;
+        atomic_store(&entry->busy, 0);
+
+        if (repeated)
+        {
+            log_dedup_notice(level, tag, repeated);
+        }
+    }
+}
+
+static inline uint8_t *log_binary_put(uint8_t *p, const uint8_t *end, const void *data, size_t len)
+{
+    if (!p || p + len > end)
+    {
+        return NULL;
+    }
+    if (len)
+    {
+        memcpy(p, data, len);
+    }
+    return p + len;
+}
+
+static uint16_t log_binary_encode(uint8_t *buf, uint16_t size,
+                                  serial_log_level_t level,
+                                  const char *tag,
+                                  uint32_t timestamp,
+                                  const char *format,
+                                  va_list list)
+{
+    const uint8_t *end = buf + size;
+    uint32_t format_addr = (uint32_t)(uintptr_t)format;
+    uint32_t tag_addr = (uint32_t)(uintptr_t)tag;
+
+    /* Record header, the argument length is filled in at the end */
+    buf[0] = LOG_BINARY_SYNC;
+    buf[1] = (uint8_t)level;
+    memcpy(&buf[4], &timestamp, sizeof(timestamp));
+    memcpy(&buf[8], &format_addr, sizeof(format_addr));
+    memcpy(&buf[12], &tag_addr, sizeof(tag_addr));
+    uint8_t *p = buf + LOG_BINARY_HEADER_SIZE;
+    uint8_t *last = p;
+
+    /* Walk the format string only to learn argument types, copy raw values */
+    for (const char *f = format; *f && p; f++)
+    {
+        if (*f != '%')
+        {
+            continue;
+        }
+        f++;
+        if (*f == '%')
+        {
+            continue;
+        }
+
+        /* Flags, width and precision. A '*' consumes an int argument. */
+        while (*f && strchr("-+ #0", *f))
+        {
+            f++;
+        }
+        while (*f == '*' || *f == '.' || (*f >= '0' && *f <= '9'))
+        {
+            if (*f == '*')
+            {
+                int value = va_arg(list, int);
+                p = log_binary_put(p, end, &value, sizeof(value));
+            }
+            f++;
+        }
+
+        /* Length modifier */
+        size_t int_size = sizeof(int);
+        if (*f == 'h')
+        {
+            f += (f[1] == 'h') ? 2 : 1;
+        }
+        else if (*f == 'l' && f[1] == 'l')
+        {
+            int_size = sizeof(long long);
+            f += 2;
+        }
+        else if (*f == 'l')
+        {
+            int_size = sizeof(long);
+            f++;
+        }
+        else if (*f == 'j')
+        {
+            int_size = sizeof(intmax_t);
+            f++;
+        }
+        else if (*f == 'z' || *f == 't')
+        {
+            int_size = sizeof(size_t);
+            f++;
+        }
+
+        switch (*f)
+        {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+            if (int_size == sizeof(long long))
+            {
+                long long value = va_arg(list, long long);
+                p = log_binary_put(p, end, &value, sizeof(value));
+            }
+            else if (int_size == sizeof(long))
+            {
+                long value = va_arg(list, long);
+                p = log_binary_put(p, end, &value, sizeof(value));
+            }
+            else
+            {
+                int value = va_arg(list, int);
+                p = log_binary_put(p, end, &value, sizeof(value));
+            }
+            break;
+        case 'p':
+        {
+            uint32_t value = (uint32_t)(uintptr_t)va_arg(list, void*);
+            p = log_binary_put(p, end, &value, sizeof(value));
+            break;
+        }
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        {
+            double value = va_arg(list, double);
+            p = log_binary_put(p, end, &value, sizeof(value));
+            break;
+        }
+        case 's':
+        {
+            /* Strings can not be resolved off-target, copy them with a length
+               byte. NULL is copied as the text formatters output it. */
+            const char *value = va_arg(list, const char*);
+            if (!value)
+            {
+                value = "(null)";
+            }
+            size_t len = strlen(value);
+            if (len > UINT8_MAX)
+            {
+                len = UINT8_MAX;
+            }
+            uint8_t len8 = (uint8_t)len;
+            p = log_binary_put(p, end, &len8, sizeof(len8));
+            p = log_binary_put(p, end, value, len);
+            break;
+        }
+        default:
+            /* Unknown conversion, stop here to keep the record decodable */
+            p = NULL;
+            break;
+        }
+
+        if (p)
+        {
+            last = p;
+        }
+        if (!*f)
+        {
+            break;
+        }
+    }
+
+    /* Only whole arguments are kept, the decoder marks missing ones */
+    if (!p)
+    {
+        LOG_STAT_ADD(truncated[log_level_normalize((serial_log_level_t)(level & ~LOG_BINARY_LEVEL_US))], 1);
+    }
+    uint16_t args_len = (uint16_t)(last - buf - LOG_BINARY_HEADER_SIZE);
+    memcpy(&buf[2], &args_len, sizeof(args_len));
+    return (uint16_t)(last - buf);
+}
+
+#ifdef USE_LOG_ASYNC
+static uint16_t log_binary_format(uint8_t *buf, uint16_t size, serial_log_level_t level,
+                                  const char *tag, const char *format, ...)
+{
+    /* Binary record generated by the library itself, stamped like the others */
+    uint32_t timestamp = log_binary_timestamp(&level);
+    va_list list;
+    va_start(list, format);
+    uint16_t length = log_binary_encode(buf, size, level, tag, timestamp, format, list);
+    va_end(list);
+    return length;
+}
+#endif
+
+static void log_latency_update(uint32_t start)
+{
+    if (!FuncGetCounter)
+    {
+        return;
+    }
+
+    uint32_t elapsed = FuncGetCounter() - start;
+    atomic_add(&log_latency.count, 1);
+    atomic_add(&log_latency.total, elapsed);
+
+    uint32_t max = atomic_load(&log_latency.max);
+    while (elapsed > max && !atomic_cas(&log_latency.max, &max, elapsed));
+}
+
+void serial_log_latency_counter_set(func_get_tick get_counter)
+{
+    FuncGetCounter = get_counter;
+    serial_log_latency_reset();
+}
+
+void serial_log_latency_get(serial_log_latency_t *latency)
+{
+    latency->count = atomic_load(&log_latency.count);
+    latency->total = atomic_load(&log_latency.total);
+    latency->max = atomic_load(&log_latency.max);
+}
+
+void serial_log_latency_reset(void)
+{
+    atomic_store(&log_latency.count, 0);
+    atomic_store(&log_latency.total, 0);
+    atomic_store(&log_latency.max, 0);
+}
+
+static inline void log_stat_max(uint32_t *stat, uint32_t value)
+{
+    uint32_t max = atomic_load(stat);
+    while (value > max && !atomic_cas(stat, &max, value));
+}
+
+void serial_log_stats_get(serial_log_stats_t *stats)
+{
+    /* Each counter is read atomically, the set as a whole is not a snapshot */
+    const uint32_t *src = (const uint32_t*)&log_stats;
+    uint32_t *dst = (uint32_t*)stats;
+    for (size_t i = 0; i < sizeof(log_stats) / sizeof(uint32_t); i++)
+    {
+        dst[i] = atomic_load(&src[i]);
+    }
+    stats->tag_memory = atomic_load_relaxed(&log_tag_memory);
+}
+
+void serial_log_stats_reset(void)
+{
+    uint32_t *stat = (uint32_t*)&log_stats;
+    for (size_t i = 0; i < sizeof(log_stats) / sizeof(uint32_t); i++)
+    {
+        atomic_store(&stat[i], 0);
+    }
+}
+
+void serial_log_stats_period_set(uint32_t period_ms)
+{
+    atomic_store(&log_stats_tick, FuncGetTick ? FuncGetTick() : 0);
+    atomic_store(&log_stats_period, period_ms);
+}
+
+static void log_stats_emit(void)
+{
+    uint32_t period = atomic_load_relaxed(&log_stats_period);
+    if (!period)
+    {
+        return;
+    }
+
+    /* One caller wins the period and outputs the record */
+    uint32_t now = FuncGetTick();
+    uint32_t last = atomic_load(&log_stats_tick);
+    if (now - last < period || !atomic_cas(&log_stats_tick, &last, now))
+    {
+        return;
+    }
+
+    serial_log_stats_t stats;
+    serial_log_stats_get(&stats);
+    uint32_t emitted = 0, filtered = 0, dropped = 0, truncated = 0;
+    for (int i = SERIAL_LOG_ERROR; i <= SERIAL_LOG_VERBOSE; i++)
+    {
+        emitted += stats.emitted[i];
+        filtered += stats.filtered[i];
+        dropped += stats.dropped[i];
+        truncated += stats.truncated[i];
+    }
+    dropped += stats.dma_dropped;
+    serial_log_record(SERIAL_LOG_INFO, "serial_log",
+                      "emitted %u filtered %u dropped %u truncated %u bytes %u cache %u/%u queue %u",
+                      (unsigned)emitted, (unsigned)filtered, (unsigned)dropped, (unsigned)truncated,
+                      (unsigned)stats.bytes, (unsigned)stats.cache_hits,
+                      (unsigned)(stats.cache_hits + stats.cache_misses), (unsigned)stats.queue_high_water);
+}
+
+#ifdef USE_LOG_ASYNC
+static void log_async_write(log_sink_t *sink, serial_log_level_t level, log_record_t *rec)
+{
+    log_ring_t *ring = &sink->ring;
+    uint8_t overflow = atomic_load_relaxed(&sink->overflow);
+    uint32_t wait_start = 0;
+    bool full = false;
+
+    /* Records longer than a slot take consecutive ones */
+    uint32_t length = log_record_length(rec);
+    uint32_t count = (length + LOG_BUF_SIZE - 1) / LOG_BUF_SIZE;
+    if (count == 0)
+    {
+        count = 1;
+    }
+    else if (count > LOG_ASYNC_PARTS_MAX)
+    {
+        count = LOG_ASYNC_PARTS_MAX;
+        length = count * LOG_BUF_SIZE;
+    }
+
+    /* Claim the slots. A slot is free for position pos when its sequence equals pos */
+    uint32_t pos = atomic_load(&ring->head);
+    for (;;)
+    {
+        uint32_t i = 0;
+        int32_t diff;
+        do {
+            diff = (int32_t)(atomic_load(&ring->slots[(pos + i) & (LOG_ASYNC_RING_SIZE - 1)].sequence) - (pos + i));
+        } while (diff == 0 && ++i < count);
+        if (diff == 0)
+        {
+            /* Less urgent records leave the last slots to ERROR and WARN */
+            if (overflow == SERIAL_LOG_OVERFLOW_PRIORITY && level > SERIAL_LOG_WARN &&
+                (int32_t)(pos + count - atomic_load(&ring->tail)) > LOG_ASYNC_RING_SIZE - LOG_ASYNC_RESERVE)
+            {
+                log_async_drop(ring, level);
+                return;
+            }
+            if (atomic_cas(&ring->head, &pos, pos + count))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            /* Ring is full, make room as the policy says or drop the record.
+               Other sinks are not held up. */
+            if (!full)
+            {
+                wait_start = FuncGetTick ? FuncGetTick() : 0;
+                full = true;
+            }
+            if (!log_async_overflow(sink, level, pos, pos + i, wait_start))
+            {
+                log_async_drop(ring, level);
+                return;
+            }
+            pos = atomic_load(&ring->head);
+        }
+        else
+        {
+            pos = atomic_load(&ring->head);
+        }
+    }
+
+    LOG_STAT_MAX(queue_high_water, pos + count - atomic_load(&ring->tail));
+
+    /* The slots are output later, so the whole record is copied into them,
+       a long message formatted straight into them. The first slot is
+       published last, the drain task and producers evicting the record then
+       find it whole. */
+    for (uint32_t i = count; i-- > 0;)
+    {
+        log_ring_slot_t *slot = &ring->slots[(pos + i) & (LOG_ASYNC_RING_SIZE - 1)];
+        uint32_t offset = i * LOG_BUF_SIZE;
+        slot->length = (uint16_t)log_record_read(rec, offset, slot->data,
+                                                 (length - offset < LOG_BUF_SIZE) ? length - offset : LOG_BUF_SIZE);
+        slot->level = (uint8_t)level;
+        slot->parts = i ? 0 : (uint8_t)count;
+        slot->dropped = 0;
+        if (i == 0)
+        {
+            /* Records dropped so far are reported in front of this one */
+            uint32_t dropped = atomic_load(&ring->dropped);
+            while (dropped && !atomic_cas(&ring->dropped, &dropped, 0));
+            slot->dropped = dropped;
+        }
+        atomic_store(&slot->sequence, pos + i + 1);
+    }
+    log_async_wake(ring);
+}
+
+static void log_async_wake(log_ring_t *ring)
+{
+#ifdef USE_RTOS
+    if (xPortIsInsideInterrupt())
+    {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(ring->drain_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+    else
+    {
+        xTaskNotifyGive(ring->drain_task);
+    }
+#elif defined(USE_PTHREAD)
+    sem_post(&ring->drain_sem);
+#else
+    (void)ring;
+#endif
+}
+
+static bool log_async_overflow(log_sink_t *sink, serial_log_level_t level, uint32_t pos, uint32_t need,
+                               uint32_t wait_start)
+{
+    /* Returns true when the claim should be tried again */
+    switch (atomic_load_relaxed(&sink->overflow))
+    {
+    case SERIAL_LOG_OVERFLOW_DROP_OLDEST:
+        return log_async_evict(sink, SERIAL_LOG_ERROR, pos, need);
+
+    case SERIAL_LOG_OVERFLOW_PRIORITY:
+        /* Urgent records wait when the oldest record is urgent too */
+        if (level > SERIAL_LOG_WARN)
+        {
+            return false;
+        }
+        return log_async_evict(sink, SERIAL_LOG_DEBUG, pos, need) || log_async_wait(sink, wait_start);
+
+    case SERIAL_LOG_OVERFLOW_BLOCK:
+        return log_async_wait(sink, wait_start);
+
+    default:
+        return false;
+    }
+}
+
+static bool log_async_wait(log_sink_t *sink, uint32_t wait_start)
+{
+    /* Let the drain task make room, returns false when the timeout is over or
+       the caller can not wait */
+    if (!FuncGetTick || FuncGetTick() - wait_start >= atomic_load_relaxed(&sink->block_timeout))
+    {
+        return false;
+    }
+#ifdef USE_RTOS
+    if (xPortIsInsideInterrupt() || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    {
+        return false;
+    }
+    vTaskDelay(1);
+#elif defined(USE_PTHREAD)
+    sched_yield();
+#else
+    /* Nobody else drains the ring until the main loop runs again */
+    log_async_drain(sink);
+#endif
+    return true;
+}
+
+static bool log_async_evict(log_sink_t *sink, serial_log_level_t min_level, uint32_t pos, uint32_t need)
+{
+    /* Dequeue the oldest record when it is min_level or more verbose and holds
+       the slot position need, which a claim from pos waits for. Returns false
+       when it stays, true when the claim should be tried again. */
+    log_ring_t *ring = &sink->ring;
+    if (atomic_load(&ring->head) != pos)
+    {
+        return true;
+    }
+    uint32_t tail = atomic_load(&ring->tail);
+    if (need - tail != LOG_ASYNC_RING_SIZE)
+    {
+        /* The slot is being handed back by the drain task */
+        return false;
+    }
+    log_ring_slot_t *slot = &ring->slots[tail & (LOG_ASYNC_RING_SIZE - 1)];
+    if (atomic_load(&slot->sequence) != tail + 1)
+    {
+        /* Still being written, or already dequeued */
+        return atomic_load(&ring->tail) != tail;
+    }
+    uint8_t level = slot->level;
+    uint8_t parts = slot->parts;
+    uint32_t dropped = slot->dropped;
+    if (level < min_level || parts == 0)
+    {
+        /* Too urgent, or the rest of a record the drain task is outputting */
+        return false;
+    }
+    if (!atomic_cas(&ring->tail, &tail, tail + parts))
+    {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < parts; i++)
+    {
+        atomic_store(&ring->slots[(tail + i) & (LOG_ASYNC_RING_SIZE - 1)].sequence, tail + i + LOG_ASYNC_RING_SIZE);
+    }
+    atomic_add(&ring->done, parts);
+    atomic_add(&ring->dropped, dropped + 1);
+    LOG_STAT_ADD(dropped[level], 1);
+    return true;
+}
+
+static void log_async_drop(log_ring_t *ring, serial_log_level_t level)
+{
+    /* Reported in front of the next queued record, or by the drain task once
+       the ring is empty */
+    atomic_add(&ring->dropped, 1);
+    LOG_STAT_ADD(dropped[level], 1);
+    (void)level;
+    log_async_wake(ring);
+}
+
+static uint16_t log_async_notice(log_sink_t *sink, uint32_t dropped)
+{
+    /* WARN record in the format of the sink */
+    char *buf = sink->ring.notice;
+    if (atomic_load_relaxed(&log_sink_binary) & (1u << (sink - log_sinks)))
+    {
+        return log_binary_format((uint8_t*)buf, LOG_ASYNC_NOTICE_SIZE, SERIAL_LOG_WARN,
+                                 "serial_log", "%u records dropped", (unsigned)dropped);
+    }
+    if (atomic_load_relaxed(&log_sink_cbor) & (1u << (sink - log_sinks)))
+    {
+        /* Gather the segments of the CBOR record, the message goes last */
+        uint8_t head[LOG_CBOR_HEAD_SIZE];
+        serial_log_iovec_t iov[6];
+        char message[24];
+        int message_len = log_clamp(log_snprintf(message, sizeof(message), "%u records dropped", (unsigned)dropped),
+                                    sizeof(message));
+        uint8_t iovcnt = log_cbor_record(head, iov, SERIAL_LOG_WARN, "serial_log", message, (uint16_t)message_len, NULL, 0);
+        uint16_t length = 0;
+        for (uint8_t i = 0; i < iovcnt; i++)
+        {
+            memcpy(buf + length, iov[i].data, iov[i].len);
+            length += iov[i].len;
+        }
+        return length;
+    }
+
+    const log_const_str_t *prefix = &log_level_prefix[SERIAL_LOG_WARN];
+    memcpy(buf, prefix->str, prefix->len);
+    int length = prefix->len;
+    length += log_stamp_format(buf + length, LOG_ASYNC_NOTICE_SIZE - length);
+    char tag_id[LOG_TAG_TEXT_SIZE];
+    length += log_clamp(log_snprintf(buf + length, LOG_ASYNC_NOTICE_SIZE - length,
+                                     "%s: %u records dropped" LOG_SUFFIX, log_tag_text("serial_log", tag_id),
+                                     (unsigned)dropped),
+                        LOG_ASYNC_NOTICE_SIZE - length);
+    return (uint16_t)length;
+}
+
+static void log_async_drain(log_sink_t *sink)
+{
+    log_ring_t *ring = &sink->ring;
+    serial_log_iovec_t iov[LOG_SINK_IOV_MAX];
+    for (;;)
+    {
+        /* Copy out the ready records, stop at an empty slot or one still being
+           written. A record after a gap starts the next call, behind the
+           notice of the records dropped. */
+        uint32_t tail = atomic_load(&ring->tail);
+        uint16_t used = 0;
+        uint8_t count = 0;
+        uint8_t notice = 0;
+        while (notice + count < LOG_SINK_IOV_MAX)
+        {
+            log_ring_slot_t *slot = &ring->slots[(tail + count) & (LOG_ASYNC_RING_SIZE - 1)];
+            if (atomic_load(&slot->sequence) != tail + count + 1 || slot->length > LOG_ASYNC_BATCH_SIZE - used)
+            {
+                break;
+            }
+            if (slot->dropped)
+            {
+                if (count)
+                {
+                    break;
+                }
+                iov[0].data = ring->notice;
+                iov[0].len = log_async_notice(sink, slot->dropped);
+                notice = 1;
+            }
+            memcpy(ring->batch + used, slot->data, slot->length);
+            iov[notice + count].data = ring->batch + used;
+            iov[notice + count].len = slot->length;
+            used += slot->length;
+            count++;
+        }
+
+        if (count == 0)
+        {
+            /* Report records dropped after the last queued one. The count is
+               taken under the lock, so serial_log_flush can wait for it. */
+            uint32_t dropped = atomic_load(&ring->dropped);
+            if (dropped)
+            {
+                log_mutex_lock(&sink->lock);
+                if (atomic_cas(&ring->dropped, &dropped, 0))
+                {
+                    iov[0].data = ring->notice;
+                    iov[0].len = log_async_notice(sink, dropped);
+                    log_sink_emit(sink, iov, 1);
+                }
+                log_mutex_unlock(&sink->lock);
+            }
+            return;
+        }
+
+        /* Dequeue the copied records, unless a producer has just evicted the
+           oldest, then the copy may be torn and is taken again */
+        if (!atomic_cas(&ring->tail, &tail, tail + count))
+        {
+            continue;
+        }
+        for (uint8_t i = 0; i < count; i++)
+        {
+            atomic_store(&ring->slots[(tail + i) & (LOG_ASYNC_RING_SIZE - 1)].sequence, tail + i + LOG_ASYNC_RING_SIZE);
+        }
+
+#ifdef USE_LOG_DMA
+        if (sink->log_dma)
+        {
+            /* A DMA sink copies or drops what it is given as a whole, so give
+               it one record at a time and count each record that misses */
+            log_mutex_lock(&sink->lock);
+            for (uint8_t i = 0; i < notice + count; i++)
+            {
+                log_sink_emit(sink, &iov[i], 1);
+            }
+            log_mutex_unlock(&sink->lock);
+        }
+        else
+#endif
+        {
+            log_sink_writev(sink, iov, notice + count);
+        }
+        atomic_add(&ring->done, count);
+    }
+}
+
+void serial_log_process(void)
+{
+    log_dedup_flush();
+    for (uint8_t i = 0; i < LOG_SINK_MAX; i++)
+    {
+        if (log_sinks[i].ring.initialized)
+        {
+            log_async_drain(&log_sinks[i]);
+        }
+    }
+}
+
+#ifdef USE_RTOS
+static void log_drain_task_func(void *param)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        log_async_drain((log_sink_t*)param);
+    }
+}
+#elif defined(USE_PTHREAD)
+static void *log_drain_thread_func(void *param)
+{
+    log_sink_t *sink = (log_sink_t*)param;
+    for (;;)
     {
-        set_log_lock = xSemaphoreCreateMutex();
+        sem_wait(&sink->ring.drain_sem);
+        log_async_drain(sink);
     }
-    xSemaphoreTake(set_log_lock, portMAX_DELAY);
+    return NULL;
+}
 #endif
 
-    /* For wildcard tag, remove all linked list item and clear the cache */
-    if (strcmp(tag, "*") == 0)
+static void log_async_init(log_sink_t *sink)
+{
+    /* The ring and its drain task are kept when the sink is removed. When the
+       drain task can not be created the ring stays uninitialized, records go
+       to the sink from the caller and the next sink_add tries again. */
+    log_ring_t *ring = &sink->ring;
+    if (ring->initialized)
     {
-        set_log_default_level = level;
-        clear_log_level_list();
-#ifdef USE_RTOS
-        xSemaphoreGive(set_log_lock);
-#endif
         return;
     }
 
-    /* Searching exist tag */
-    uncached_tag_entry_t *it = NULL;
-    SLIST_FOREACH(it, &set_log_tags, entries)
+    for (uint32_t i = 0; i < LOG_ASYNC_RING_SIZE; i++)
     {
-        if (strcmp(it->tag, tag) == 0)
-        {
-            /* Update level for tag already been in linked list */
-            it->level = level;
-            break;
-        }
+        ring->slots[i].sequence = i;
+    }
+
+#if defined(USE_RTOS) && defined(USE_LOG_STATIC)
+    ring->drain_task = xTaskCreateStatic(log_drain_task_func, "serial_log", LOG_ASYNC_TASK_STACK, sink,
+                                         LOG_ASYNC_TASK_PRIORITY, ring->drain_stack, &ring->drain_tcb);
+    if (!ring->drain_task)
+    {
+        return;
+    }
+#elif defined(USE_RTOS)
+    if (xTaskCreate(log_drain_task_func, "serial_log", LOG_ASYNC_TASK_STACK, sink,
+                    LOG_ASYNC_TASK_PRIORITY, &ring->drain_task) != pdPASS)
+    {
+        return;
+    }
+#elif defined(USE_PTHREAD)
+    if (sem_init(&ring->drain_sem, 0, 0) != 0)
+    {
+        return;
+    }
+    if (pthread_create(&ring->drain_thread, NULL, log_drain_thread_func, sink) != 0)
+    {
+        sem_destroy(&ring->drain_sem);
+        return;
     }
+#endif
+    atomic_store(&ring->initialized, true);
+}
+
+void serial_log_flush(void)
+{
+#if defined(USE_RTOS) || defined(USE_PTHREAD)
+    log_dedup_flush();
 
-    /* Append new one if have no exist tag */
-    if (it == NULL)
+    /* Wait for each drain task to catch up with every record claimed so far */
+    for (uint8_t i = 0; i < LOG_SINK_MAX; i++)
     {
-        /* Allocate memory for linked list entry and append it to the head of the list */
-        size_t entry_size = offsetof(uncached_tag_entry_t, tag) + strlen(tag) + 1;
-        uncached_tag_entry_t *new_entry = (uncached_tag_entry_t*)malloc(entry_size);
-        if (!new_entry)
+        log_ring_t *ring = &log_sinks[i].ring;
+        if (!atomic_load(&ring->initialized))
+        {
+            continue;
+        }
+        uint32_t head = atomic_load(&ring->head);
+        while ((int32_t)(atomic_load(&ring->done) - head) < 0 || atomic_load(&ring->dropped))
         {
 #ifdef USE_RTOS
-            xSemaphoreGive(set_log_lock);
+            vTaskDelay(1);
+#else
+            sched_yield();
 #endif
-            return;
         }
-        new_entry->level = (uint8_t)level;
-        strcpy(new_entry->tag, tag);
-        SLIST_INSERT_HEAD(&set_log_tags, new_entry, entries);
+
+        /* The notice of the last records dropped is output under the lock */
+        log_mutex_lock(&log_sinks[i].lock);
+        log_mutex_unlock(&log_sinks[i].lock);
     }
+#else
+    serial_log_process();
+#endif
+#ifdef USE_LOG_DMA
+    log_dma_flush();
+#endif
+}
+#else
+void serial_log_process(void)
+{
+    log_dedup_flush();
+}
+
+void serial_log_flush(void)
+{
+    log_dedup_flush();
+#ifdef USE_LOG_DMA
+    log_dma_flush();
+#endif
+}
+#endif
 
-    /* Searching in the cache and update */
-    for (int i = 0; i < set_log_cache_entry_count; ++i)
+#ifdef USE_LOG_DMA
+static void log_dma_flush(void)
+{
+    /* Wait for the transfers of every DMA sink */
+    log_init();
+    for (uint8_t i = 0; i < LOG_SINK_MAX; i++)
     {
-        if (strcmp(set_log_cache[i].tag, tag) == 0)
+        log_sink_t *sink = &log_sinks[i];
+        log_mutex_lock(&sink->lock);
+        if (sink->log_dma)
         {
-            set_log_cache[i].level = level;
-            break;
+            log_dma_drain(sink);
         }
+        log_mutex_unlock(&sink->lock);
     }
-#ifdef USE_RTOS
-    xSemaphoreGive(set_log_lock);
+}
 #endif
+
+static uint32_t log_crc32(const void *data, uint32_t length)
+{
+    return log_crc32_update(0, data, length);
 }
 
-static void clear_log_level_list(void)
+static uint32_t log_crc32_update(uint32_t crc, const void *data, uint32_t length)
 {
-    uncached_tag_entry_t *it;
-    while ((it = SLIST_FIRST(&set_log_tags)) != NULL) {
-        SLIST_REMOVE_HEAD(&set_log_tags, entries);
-        free(it);
+    /* CRC-32 (IEEE), nibble table. Continues crc, the CRC of the data before. */
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *p = (const uint8_t*)data;
+    crc = ~crc;
+    while (length--)
+    {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0xF];
+        crc = (crc >> 4) ^ table[crc & 0xF];
     }
+    return ~crc;
+}
 
-    /* Reset log cache counter */
-    set_log_cache_entry_count = 0;
-    set_log_cache_max_generation = 0;
+static bool log_recorder_header_valid(const log_recorder_header_t *header, uint32_t capacity)
+{
+    return header->magic == LOG_RECORDER_MAGIC &&
+           header->capacity == capacity &&
+           header->crc == log_crc32(header, offsetof(log_recorder_header_t, crc)) &&
+           header->head - header->tail <= capacity;
 }
 
-void serial_log_write(serial_log_level_t level, const char* tag, const char* format, ...)
+static const log_recorder_header_t *log_recorder_header_latest(const log_recorder_region_t *region, uint32_t size)
 {
-#ifdef USE_RTOS
-    if (!set_log_lock)
+    /* Either header may be torn by a reset during its update, the other one is
+       then still valid and at most one record behind */
+    uint32_t capacity = size - sizeof(log_recorder_region_t);
+    const log_recorder_header_t *a = &region->header[0];
+    const log_recorder_header_t *b = &region->header[1];
+    bool a_valid = log_recorder_header_valid(a, capacity);
+    bool b_valid = log_recorder_header_valid(b, capacity);
+    if (a_valid && b_valid)
     {
-        set_log_lock = xSemaphoreCreateMutex();
+        return ((int32_t)(a->sequence - b->sequence) > 0) ? a : b;
     }
+    return a_valid ? a : (b_valid ? b : NULL);
+}
+
+static void log_recorder_header_commit(uint32_t head, uint32_t tail)
+{
+    /* Data reaches memory before the header that covers it */
+    atomic_fence_release();
+    uint32_t sequence = log_recorder.sequence + 1;
+    log_recorder_header_t *header = &log_recorder.region->header[sequence & 1];
+    header->magic = LOG_RECORDER_MAGIC;
+    header->sequence = sequence;
+    header->capacity = log_recorder.capacity;
+    header->head = head;
+    header->tail = tail;
+    header->crc = log_crc32(header, offsetof(log_recorder_header_t, crc));
+    atomic_fence_release();
+    log_recorder.sequence = sequence;
+}
 
-    if (xSemaphoreTake(set_log_lock, MAX_MUTEX_WAIT_TICKS) == pdFALSE)
+static void log_recorder_put(uint32_t pos, const void *data, uint32_t length)
+{
+    uint8_t *ring = log_recorder.region->data;
+    uint32_t offset = pos % log_recorder.capacity;
+    uint32_t first = (length < log_recorder.capacity - offset) ? length : log_recorder.capacity - offset;
+    memcpy(ring + offset, data, first);
+    memcpy(ring, (const uint8_t*)data + first, length - first);
+}
+
+static uint16_t log_recorder_chunk_length(const log_recorder_region_t *region, uint32_t capacity, uint32_t pos)
+{
+    return region->data[pos % capacity] | (region->data[(pos + 1) % capacity] << 8);
+}
+
+static void log_recorder_write(const serial_log_iovec_t *iov, uint8_t iovcnt, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+
+    /* One chunk per call, a record or a batch of queued records */
+    uint32_t length = 0;
+    for (uint8_t i = 0; i < iovcnt; i++)
     {
-        return;
+        length += iov[i].len;
+    }
+    uint32_t limit = log_recorder.capacity - LOG_RECORDER_CHUNK_HEADER;
+    if (limit > UINT16_MAX)
+    {
+        limit = UINT16_MAX;
+    }
+    if (length > limit)
+    {
+        length = limit;
     }
-#endif
 
-    /* Look or the tag in cache first, then in the linked va_list of all tags */
-    serial_log_level_t level_for_tag;
-    if (!get_cached_log_level(tag, &level_for_tag))
+    /* Drop the oldest chunks to make room, and commit that before their
+       bytes are overwritten */
+    uint32_t head = log_recorder.head;
+    uint32_t tail = log_recorder.tail;
+    if (head + LOG_RECORDER_CHUNK_HEADER + length - tail > log_recorder.capacity)
     {
-        if (!get_uncached_log_level(tag, &level_for_tag))
+        while (head + LOG_RECORDER_CHUNK_HEADER + length - tail > log_recorder.capacity)
         {
-            level_for_tag = set_log_default_level;
+            tail += LOG_RECORDER_CHUNK_HEADER + log_recorder_chunk_length(log_recorder.region, log_recorder.capacity, tail);
         }
-        add_to_cache(tag, level_for_tag);
+        log_recorder_header_commit(head, tail);
     }
-#ifdef USE_RTOS
-    xSemaphoreGive(set_log_lock);
-#endif
-    if (!should_output(level, level_for_tag))
+
+    uint8_t chunk_header[LOG_RECORDER_CHUNK_HEADER] = { (uint8_t)length, (uint8_t)(length >> 8) };
+    log_recorder_put(head, chunk_header, sizeof(chunk_header));
+    uint32_t pos = head + LOG_RECORDER_CHUNK_HEADER;
+    for (uint8_t i = 0; i < iovcnt && pos < head + LOG_RECORDER_CHUNK_HEADER + length; i++)
     {
-        return;
+        uint32_t len = head + LOG_RECORDER_CHUNK_HEADER + length - pos;
+        len = (iov[i].len < len) ? iov[i].len : len;
+        log_recorder_put(pos, iov[i].data, len);
+        pos += len;
     }
 
-    va_list list;
-    va_start(list, format);
-    uint16_t length = vsnprintf((char*)log_buf, 128, format, list);
-    FuncLog((uint8_t*)log_buf, length, 100);
-    va_end(list);
+    log_recorder.head = pos;
+    log_recorder.tail = tail;
+    log_recorder_header_commit(pos, tail);
+}
+
+int serial_log_recorder_start(void *mem, uint32_t size, serial_log_level_t level, serial_log_format_t format)
+{
+    if (!mem || size < sizeof(log_recorder_region_t) + LOG_RECORDER_CHUNK_HEADER + 1)
+    {
+        return -1;
+    }
+
+    /* Only one recorder, a second start replaces the first */
+    if (log_recorder.sink > 0)
+    {
+        serial_log_sink_remove(log_recorder.sink);
+        log_recorder.sink = -1;
+    }
+
+    log_recorder.region = (log_recorder_region_t*)mem;
+    log_recorder.capacity = size - sizeof(log_recorder_region_t);
+    log_recorder.sequence = 0;
+    log_recorder.head = 0;
+    log_recorder.tail = 0;
+    memset(log_recorder.region->header, 0, sizeof(log_recorder.region->header));
+    log_recorder_header_commit(0, 0);
+
+    serial_log_sink_t sink = {
+        .log_vec = log_recorder_write,
+        .level = level,
+        .tag = NULL,
+        .format = format,
+    };
+    log_recorder.sink = serial_log_sink_add(&sink);
+    return log_recorder.sink;
 }
 
-static inline bool get_cached_log_level(const char *tag, serial_log_level_t *level)
+bool serial_log_recorder_dump(const void *mem, uint32_t size, func_log out)
 {
-    /* Look for tag in cache */
-    int i;
-    for (i = 0; i < set_log_cache_entry_count; ++i)
+    if (!mem || size < sizeof(log_recorder_region_t) + LOG_RECORDER_CHUNK_HEADER + 1)
+    {
+        return false;
+    }
+
+    const log_recorder_region_t *region = (const log_recorder_region_t*)mem;
+    const log_recorder_header_t *header = log_recorder_header_latest(region, size);
+    if (!header)
+    {
+        return false;
+    }
+
+    /* Output each chunk, in two parts when it wraps around the end */
+    uint32_t capacity = header->capacity;
+    for (uint32_t pos = header->tail; pos != header->head;)
     {
-        if (set_log_cache[i].tag == tag) {
+        uint16_t length = log_recorder_chunk_length(region, capacity, pos);
+        if (length > header->head - pos - LOG_RECORDER_CHUNK_HEADER)
+        {
             break;
         }
+        pos += LOG_RECORDER_CHUNK_HEADER;
+        uint32_t offset = pos % capacity;
+        uint32_t first = (length < capacity - offset) ? length : capacity - offset;
+        out((uint8_t*)&region->data[offset], first, 100);
+        if (length > first)
+        {
+            out((uint8_t*)region->data, length - first, 100);
+        }
+        pos += length;
+    }
+    return true;
+}
+
+#ifdef __linux__
+void *serial_log_recorder_map(const char *path, uint32_t size)
+{
+    /* A file mapping outlives the process, like no-init RAM outlives a reset */
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return NULL;
     }
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (mem == MAP_FAILED) ? NULL : mem;
+}
+#endif
+
+static inline uint32_t cache_index(const char *tag)
+{
+    /* Tags are usually string literals, drop the low bits which vary little */
+    uintptr_t addr = (uintptr_t)tag;
+    return (uint32_t)((addr >> 2) ^ (addr >> 7)) & (TAG_CACHE_SIZE - 1);
+}
+
+static inline bool get_cached_log_level(const char *tag, uint32_t epoch, serial_log_level_t *level, uncached_tag_entry_t **tag_entry)
+{
+    cached_tag_entry_t *entry = &set_log_cache[cache_index(tag)];
 
-    if (i == set_log_cache_entry_count)
+    /* Odd sequence means another logger is filling the entry */
+    uint32_t sequence = atomic_load(&entry->sequence);
+    if (sequence & 1)
     {
         return false;
     }
 
-    /* Return level from cache */
-    *level = (serial_log_level_t) set_log_cache[i].level;
+    const char *cached_tag = atomic_load_relaxed(&entry->tag);
+    uint32_t cached_epoch = atomic_load_relaxed(&entry->epoch);
+    uint8_t cached_level = atomic_load_relaxed(&entry->level);
+    uncached_tag_entry_t *cached_entry = atomic_load_relaxed(&entry->entry);
 
-    /* If cache has been filled, start taking ordering into account
-    (other options are: dynamically resize cache, add "dummy" entries
-     to the cache; this option was chosen because code is much simpler,
-     and the unfair behavior of cache will show it self at most once, when
-     it has just been filled) */
-    if (set_log_cache_entry_count == TAG_CACHE_SIZE)
+    /* Entry changed while we read it */
+    atomic_fence_acquire();
+    if (atomic_load_relaxed(&entry->sequence) != sequence)
     {
-        /* Update item generation */
-        set_log_cache[i].generation = set_log_cache_max_generation++;
+        return false;
+    }
 
-        /* Restore heap odering */
-        heap_bubble_down(i);
+    if (cached_tag != tag || cached_epoch != epoch)
+    {
+        LOG_STAT_ADD(cache_misses, 1);
+        return false;
     }
+
+    /* Return level from cache */
+    LOG_STAT_ADD(cache_hits, 1);
+    *level = (serial_log_level_t)cached_level;
+    *tag_entry = cached_entry;
     return true;
 }
 
-static inline void add_to_cache(const char *tag, serial_log_level_t level)
+static inline void add_to_cache(const char *tag, uint32_t epoch, serial_log_level_t level, uncached_tag_entry_t *tag_entry)
 {
-    uint32_t generation = set_log_cache_max_generation++;
+    cached_tag_entry_t *entry = &set_log_cache[cache_index(tag)];
 
-    /* First consider the case when cache is not filled yet.
-    In this case, just add new entry at the end.
-    This happens to satisfy binary min-heap ordering. */
-    if (set_log_cache_entry_count < TAG_CACHE_SIZE)
+    /* Claim the entry, give up if another logger is filling it */
+    uint32_t sequence = atomic_load(&entry->sequence);
+    if ((sequence & 1) || !atomic_cas(&entry->sequence, &sequence, sequence + 1))
     {
-        set_log_cache[set_log_cache_entry_count] = (cached_tag_entry_t) {
-            .generation = generation,
-             .level = level,
-              .tag = tag
-        };
-        ++set_log_cache_entry_count;
         return;
     }
+    atomic_fence_release();
 
-    /* Cache is full, so we replace the oldest entry (which is at index 0
-    because this is a min-heap) with the new one, and do bubble-down
-    operation to restore min-heap ordering. */
-    set_log_cache[0] = (cached_tag_entry_t) {
-        .tag = tag,
-         .level = level,
-          .generation = generation
-    };
-    heap_bubble_down(0);
+    if (entry->tag && entry->tag != tag)
+    {
+        LOG_STAT_ADD(cache_evictions, 1);
+    }
+    atomic_store_relaxed(&entry->tag, tag);
+    atomic_store_relaxed(&entry->epoch, epoch);
+    atomic_store_relaxed(&entry->level, (uint8_t)level);
+    atomic_store_relaxed(&entry->entry, tag_entry);
+
+    atomic_store(&entry->sequence, sequence + 2);
 }
 
-static inline bool get_uncached_log_level(const char *tag, serial_log_level_t *level)
+static inline bool get_uncached_log_level(const char *tag, serial_log_level_t *level, uncached_tag_entry_t **entry)
 {
-    /* Walk the linked list of all tags and see if given tag is present in the list.
-    This is slow because tags are compared as strings. */
+    /* Walk the hash bucket of the tag and see if given tag is present in the list.
+    Tags are compared as strings, so this is slower than the cache. */
     uncached_tag_entry_t *it;
-    SLIST_FOREACH(it, &set_log_tags, entries)
+    *entry = NULL;
+    for (it = atomic_load(&SLIST_FIRST(&set_log_tags[tag_hash(tag)])); it != NULL; it = SLIST_NEXT(it, entries))
     {
         if (strcmp(tag, it->tag) == 0)
         {
-            *level = it->level;
+            *entry = it;
+            uint8_t level_for_tag = atomic_load(&it->level);
+            if (level_for_tag == TAG_LEVEL_DEFAULT)
+            {
+                return false;
+            }
+            *level = (serial_log_level_t)level_for_tag;
             return true;
         }
     }
@@ -282,61 +4438,293 @@ static inline bool should_output(serial_log_level_t level_for_message, serial_lo
     return level_for_message <= level_for_tag;
 }
 
-static void heap_bubble_down(int index)
+uint32_t serial_log_timestamp(void)
 {
-    while (index < TAG_CACHE_SIZE / 2)
-    {
-        int left_index = index * 2 + 1;
-        int right_index = left_index + 1;
-        int next = (set_log_cache[left_index].generation < set_log_cache[right_index].generation) ? left_index : right_index;
-        heap_swap(index, next);
-        index = next;
-    }
+    return FuncGetTick();
 }
 
-static inline void heap_swap(int i, int j)
+static void log_write_binary_line(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, ...)
 {
-    cached_tag_entry_t tmp = set_log_cache[i];
-    set_log_cache[i] = set_log_cache[j];
-    set_log_cache[j] = tmp;
+    va_list list;
+    va_start(list, format);
+    log_output_binary(sinks, level, tag, format, list);
+    va_end(list);
 }
 
-uint32_t serial_log_timestamp(void)
+static inline char *log_dump_line(char *p, const uint8_t *data, uint16_t offset, int len, bool hex)
 {
-    return FuncGetTick();
+    /* Offset */
+    *p++ = hex_digits[(offset >> 12) & 0xF];
+    *p++ = hex_digits[(offset >> 8) & 0xF];
+    *p++ = hex_digits[(offset >> 4) & 0xF];
+    *p++ = hex_digits[offset & 0xF];
+    *p++ = ' ';
+    *p++ = ' ';
+
+    /* Hex column, padded so the character column stays aligned */
+    if (hex)
+    {
+        for (int i = 0; i < BYTES_PER_LINE; i++)
+        {
+            if (i < len)
+            {
+                *p++ = hex_digits[data[i] >> 4];
+                *p++ = hex_digits[data[i] & 0xF];
+            }
+            else
+            {
+                *p++ = ' ';
+                *p++ = ' ';
+            }
+            *p++ = ' ';
+        }
+        *p++ = ' ';
+        *p++ = '|';
+    }
+
+    /* Character column */
+    for (int i = 0; i < len; i++)
+    {
+        *p++ = (data[i] >= 0x20 && data[i] < 0x7F) ? (char)data[i] : '.';
+    }
+    if (hex)
+    {
+        *p++ = '|';
+    }
+    return p;
 }
 
-void serial_log_buffer_hex_internal(const char *tag,
-                                    const char *buffer,
-                                    uint16_t buff_len,
-                                    serial_log_level_t log_level)
+static void log_buffer_dump(const char *tag, const char *buffer, uint16_t buff_len,
+                            serial_log_level_t log_level, bool hex)
 {
-    if (buff_len == 0) return;
-    char temp_buffer[BYTES_PER_LINE + 3];
-    char hex_buffer[3 * BYTES_PER_LINE + 1];
-    int bytes_current_line;
+    uint32_t sinks = 0;
+    if (buff_len && log_level <= atomic_load_relaxed(&serial_log_level_limit) && log_level_check(log_level, tag))
+    {
+        sinks = log_sink_select(log_level, tag);
+    }
+    if (!sinks)
+    {
+        LOG_STAT_ADD(filtered[log_level_normalize(log_level)], 1);
+        return;
+    }
+    if (!(sinks = log_isr_filter(sinks, log_level)))
+    {
+        return;
+    }
 
-    do {
-        if ( buff_len > BYTES_PER_LINE)
+    log_level = log_level_normalize(log_level);
+    LOG_STAT_ADD(emitted[log_level], 1);
+    uint32_t binary_sinks = sinks & atomic_load_relaxed(&log_sink_binary);
+    uint32_t cbor_sinks = sinks & atomic_load_relaxed(&log_sink_cbor);
+    uint32_t text_sinks = sinks & ~binary_sinks & ~cbor_sinks;
+    const uint8_t *data = (const uint8_t*)buffer;
+    /* Offset, hex column with its bar, characters, bar and the NUL */
+    char line[6 + 3 * BYTES_PER_LINE + 2 + BYTES_PER_LINE + 1 + 1];
+
+    /* One binary or CBOR record per line, the decoder adds the prefix */
+    for (uint32_t offset = 0; (binary_sinks || cbor_sinks) && offset < buff_len; offset += BYTES_PER_LINE)
+    {
+        int len = (buff_len - offset > BYTES_PER_LINE) ? BYTES_PER_LINE : buff_len - offset;
+        char *end = log_dump_line(line, data + offset, offset, len, hex);
+        *end = '\0';
+        if (binary_sinks)
         {
-            bytes_current_line = BYTES_PER_LINE;
+            log_write_binary_line(binary_sinks, log_level, tag, "%s", line);
         }
-        else
+        if (cbor_sinks)
         {
-            bytes_current_line = buff_len;
+            log_output_cbor(cbor_sinks, log_level, tag, line, (uint16_t)(end - line), NULL, 0);
         }
+    }
+    if (!text_sinks)
+    {
+        return;
+    }
+
+    /* Format the record prefix once and repeat it on every line */
+    char prefix[LOG_DUMP_PREFIX_SIZE];
+    char stamp[LOG_STAMP_SIZE];
+    char tag_id[LOG_TAG_TEXT_SIZE];
+    log_stamp_format(stamp, sizeof(stamp));
+    int prefix_len = log_snprintf(prefix, sizeof(prefix), "%s%s%s: ",
+                                  log_level_prefix[log_level_normalize(log_level)].str,
+                                  stamp, log_tag_text(tag, tag_id));
+    if (prefix_len < 0 || prefix_len >= (int)sizeof(prefix))
+    {
+        prefix_len = sizeof(prefix) - 1;
+    }
+    const int line_max = prefix_len + (int)sizeof(line) - 1 + log_suffix.len;
 
-        memcpy(temp_buffer, buffer, (bytes_current_line + 3) / 4 * 4);
+    /* Pack as many whole lines as fit into each buffer handed to the sinks */
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        return;
+    }
+    serial_log_iovec_t iov = { buf, 0 };
+    for (uint32_t offset = 0; offset < buff_len; offset += BYTES_PER_LINE)
+    {
+        int len = (buff_len - offset > BYTES_PER_LINE) ? BYTES_PER_LINE : buff_len - offset;
+        char *p = buf + iov.len;
+        memcpy(p, prefix, prefix_len);
+        p = log_dump_line(p + prefix_len, data + offset, offset, len, hex);
+        memcpy(p, log_suffix.str, log_suffix.len);
+        iov.len = p + log_suffix.len - buf;
 
-        for (int i = 0; i < buff_len; i++)
+        if (iov.len + line_max > LOG_BUF_SIZE)
         {
-            sprintf(&hex_buffer[i * 3], "%02x ", buffer[i]);
+            log_sink_dispatch(text_sinks, log_level, &iov, 1);
+            iov.len = 0;
         }
+    }
+    if (iov.len)
+    {
+        log_sink_dispatch(text_sinks, log_level, &iov, 1);
+    }
+    log_buf_release(buf);
+}
+
+void serial_log_payload(serial_log_level_t level, const char *tag, const void *data, uint32_t len)
+{
+    uint32_t sinks = 0;
+    if (len && level <= atomic_load_relaxed(&serial_log_level_limit) && log_level_check(level, tag))
+    {
+        sinks = log_sink_select(level, tag);
+    }
+    if (!sinks)
+    {
+        LOG_STAT_ADD(filtered[log_level_normalize(level)], 1);
+        return;
+    }
+    if (!(sinks = log_isr_filter(sinks, level)))
+    {
+        return;
+    }
+
+    /* Binary and CBOR links carry the bytes as they are, text links base64 */
+    level = log_level_normalize(level);
+    LOG_STAT_ADD(emitted[level], 1);
+    uint16_t id = (uint16_t)atomic_add(&log_payload_id, 1);
+    uint32_t byte_sinks = sinks & (atomic_load_relaxed(&log_sink_binary) | atomic_load_relaxed(&log_sink_cbor));
+    if (byte_sinks)
+    {
+        log_payload_frames(byte_sinks, level, tag, id, (const uint8_t*)data, len);
+    }
+    if (sinks & ~byte_sinks)
+    {
+        log_payload_text(sinks & ~byte_sinks, level, tag, id, (const uint8_t*)data, len);
+    }
+    log_stats_emit();
+}
+
+static void log_payload_frames(uint32_t sinks, serial_log_level_t level, const char *tag, uint16_t id,
+                               const uint8_t *data, uint32_t len)
+{
+    /* Sinks get the payload in place, only the header and CRC are built */
+    serial_log_level_t flagged = level;
+    uint32_t timestamp = log_binary_timestamp(&flagged);
+    size_t tag_len = strlen(tag);
+    if (tag_len > LOG_PAYLOAD_TAG_MAX)
+    {
+        tag_len = LOG_PAYLOAD_TAG_MAX;
+    }
+
+    uint8_t header[LOG_PAYLOAD_HEADER_SIZE];
+    uint8_t crc[LOG_PAYLOAD_CRC_SIZE];
+    header[0] = LOG_PAYLOAD_SYNC;
+    header[1] = (uint8_t)flagged;
+    header[2] = (uint8_t)tag_len;
+    header[3] = 0;
+    memcpy(&header[4], &id, sizeof(id));
+    memcpy(&header[12], &len, sizeof(len));
+    memcpy(&header[16], &timestamp, sizeof(timestamp));
+    for (uint32_t offset = 0; offset < len; offset += LOG_PAYLOAD_FRAME_DATA)
+    {
+        uint16_t chunk = (len - offset > LOG_PAYLOAD_FRAME_DATA) ? LOG_PAYLOAD_FRAME_DATA : len - offset;
+        memcpy(&header[6], &chunk, sizeof(chunk));
+        memcpy(&header[8], &offset, sizeof(offset));
+
+        uint32_t frame_crc = log_crc32(header, sizeof(header));
+        frame_crc = log_crc32_update(frame_crc, tag, tag_len);
+        frame_crc = log_crc32_update(frame_crc, data + offset, chunk);
+        memcpy(crc, &frame_crc, sizeof(crc));
+
+        serial_log_iovec_t iov[4] = {
+            { header, sizeof(header) },
+            { tag, (uint16_t)tag_len },
+            { data + offset, chunk },
+            { crc, sizeof(crc) },
+        };
+        log_sink_dispatch(sinks, level, iov, 4);
+    }
+}
+
+static void log_payload_text(uint32_t sinks, serial_log_level_t level, const char *tag, uint16_t id,
+                             const uint8_t *data, uint32_t len)
+{
+    /* One record per line: "@id offset/total crc base64", the CRC-32 of the
+       bytes of the line */
+    char *buf = log_buf_acquire();
+    if (!buf)
+    {
+        LOG_STAT_ADD(dropped[level], 1);
+        return;
+    }
+    char stamp[LOG_STAMP_SIZE];
+    char tag_id[LOG_TAG_TEXT_SIZE];
+    log_stamp_format(stamp, sizeof(stamp));
+    int prefix_len = log_snprintf(buf, LOG_DUMP_PREFIX_SIZE, "%s%s%s: ",
+                                  log_level_prefix[level].str, stamp, log_tag_text(tag, tag_id));
+    if (prefix_len < 0 || prefix_len >= LOG_DUMP_PREFIX_SIZE)
+    {
+        prefix_len = LOG_DUMP_PREFIX_SIZE - 1;
+    }
+
+    for (uint32_t offset = 0; offset < len; offset += LOG_PAYLOAD_LINE_DATA)
+    {
+        uint32_t chunk = (len - offset > LOG_PAYLOAD_LINE_DATA) ? LOG_PAYLOAD_LINE_DATA : len - offset;
+        char *p = buf + prefix_len;
+        p += log_clamp(log_snprintf(p, 40, "@%u %lu/%lu %08lx ", (unsigned)id, (unsigned long)offset,
+                                    (unsigned long)len, (unsigned long)log_crc32(data + offset, chunk)), 40);
+        p = log_base64(p, data + offset, chunk);
+        memcpy(p, log_suffix.str, log_suffix.len);
+
+        serial_log_iovec_t iov = { buf, (uint16_t)(p + log_suffix.len - buf) };
+        log_sink_dispatch(sinks, level, &iov, 1);
+    }
+    log_buf_release(buf);
+}
 
-        SERIAL_LOG_LEVEL(log_level, tag, "%s", hex_buffer);
-        buff_len -= bytes_current_line;
-        buffer += bytes_current_line;
-    } while (buff_len);
+static char *log_base64(char *out, const uint8_t *in, uint32_t len)
+{
+    /* Whole 3 byte groups, then the padded rest */
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (; len >= 3; len -= 3, in += 3, out += 4)
+    {
+        uint32_t group = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        out[0] = digits[group >> 18];
+        out[1] = digits[(group >> 12) & 0x3F];
+        out[2] = digits[(group >> 6) & 0x3F];
+        out[3] = digits[group & 0x3F];
+    }
+    if (len)
+    {
+        uint32_t group = ((uint32_t)in[0] << 16) | ((len > 1) ? (uint32_t)in[1] << 8 : 0);
+        out[0] = digits[group >> 18];
+        out[1] = digits[(group >> 12) & 0x3F];
+        out[2] = (len > 1) ? digits[(group >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    return out;
+}
+
+void serial_log_buffer_hex_internal(const char *tag,
+                                    const char *buffer,
+                                    uint16_t buff_len,
+                                    serial_log_level_t log_level)
+{
+    log_buffer_dump(tag, buffer, buff_len, log_level, true);
 }
 
 void serial_log_buffer_char_internal(const char *tag,
@@ -344,37 +4732,44 @@ void serial_log_buffer_char_internal(const char *tag,
                                      uint16_t buff_len,
                                      serial_log_level_t log_level)
 {
-    if (buff_len == 0) return;
-    char temp_buffer[BYTES_PER_LINE + 3];
-    char char_buffer[BYTES_PER_LINE + 1];
-    int bytes_current_line;
-
-    do {
-        if (buff_len > BYTES_PER_LINE)
-        {
-            bytes_current_line = BYTES_PER_LINE;
-        }
-        else
-        {
-            bytes_current_line = buff_len;
-        }
-
-        memcpy(temp_buffer, buffer, (bytes_current_line + 3) / 4 * 4);
+    log_buffer_dump(tag, buffer, buff_len, log_level, false);
+}
 
-        for (int i = 0; i < buff_len; i++)
-        {
-            sprintf(&char_buffer[i], "%c ", buffer[i]);
-        }
+static void log_default_sink_set(func_log log, func_log_vec log_vec)
+{
+    serial_log_sink_t config = {
+        .log = log,
+        .log_vec = log_vec,
+        .level = SERIAL_LOG_VERBOSE,
+        .tag = NULL,
+#ifdef USE_LOG_BINARY
+        .format = SERIAL_LOG_FORMAT_BINARY,
+#else
+        .format = SERIAL_LOG_FORMAT_TEXT,
+#endif
+    };
 
-        SERIAL_LOG_LEVEL(log_level, tag, "%s", char_buffer);
-        buffer += bytes_current_line;
-        buff_len -= bytes_current_line;
-    } while (buff_len);
+    log_config_lock();
+    /* Keep the policy set with serial_log_sink_overflow_set */
+    config.overflow = (serial_log_overflow_t)log_sinks[0].overflow;
+    config.block_timeout_ms = log_sinks[0].block_timeout;
+    log_sink_configure(0, (log || log_vec) ? &config : NULL);
+    log_mutex_unlock(&set_log_lock);
 }
 
 void serial_log_function_set(func_log log, func_get_tick get_tick)
 {
-    FuncLog = log;
     FuncGetTick = get_tick;
+    log_default_sink_set(log, NULL);
+}
+
+void serial_log_time_us_set(func_get_time_us get_time_us)
+{
+    FuncGetTimeUs = get_time_us;
 }
 
+void serial_log_function_vec_set(func_log_vec log_vec, func_get_tick get_tick)
+{
+    FuncGetTick = get_tick;
+    log_default_sink_set(NULL, log_vec);
+}
@@ -5,11 +5,50 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdarg.h>
 
+/* Default sink emits compact binary records instead of formatted text. Formatting
+   is done off-target by tools/serial_log_decode.py using the strings in the ELF file */
+//#define USE_LOG_BINARY
+
+/* Text records in a compact layout: no colors, hex timestamp and "\n" only.
+   tools/serial_log_compact.py turns them back into the usual layout */
+//#define USE_LOG_COMPACT
+
+/*
+ * One segment of a vectored log output.
+ */
+typedef struct {
+    const void *data;   /*!< Segment data */
+    uint16_t len;       /*!< Segment length in bytes */
+} serial_log_iovec_t;
+
 typedef void (*func_log)(uint8_t *data, uint16_t len, uint32_t timeout_ms);
+typedef void (*func_log_vec)(const serial_log_iovec_t *iov, uint8_t iovcnt, uint32_t timeout_ms);
+typedef void (*func_log_dma)(const uint8_t *data, uint16_t len);
 typedef uint32_t (*func_get_tick)(void);
+typedef uint64_t (*func_get_time_us)(void);
+
+/*
+ * Output format of a sink.
+ */
+typedef enum {
+    SERIAL_LOG_FORMAT_TEXT = 0,     /*!< Formatted text records */
+    SERIAL_LOG_FORMAT_BINARY,       /*!< Binary records, see serial_log_write_binary */
+    SERIAL_LOG_FORMAT_CBOR          /*!< CBOR records with typed fields, see serial_log_record_kv */
+} serial_log_format_t;
+
+/*
+ * Caller-side latency of serial_log_write, in counter units.
+ */
+typedef struct {
+    uint32_t count;     /*!< Number of measured calls */
+    uint32_t total;     /*!< Sum of all measured latencies */
+    uint32_t max;       /*!< Worst measured latency */
+} serial_log_latency_t;
 
 /*
  * Log level output.
@@ -24,25 +63,446 @@ typedef enum {
 } serial_log_level_t;
 
 /*
- * @brief   Set log function.
+ * What a sink does with a record when its queue is full, with USE_LOG_ASYNC.
+ * Records lost to overflow are counted, and the count is output as a WARN
+ * record "N records dropped" with tag "serial_log" where the sink resumes.
+ */
+typedef enum {
+    SERIAL_LOG_OVERFLOW_DROP_NEWEST = 0,    /*!< Drop the new record */
+    SERIAL_LOG_OVERFLOW_DROP_OLDEST,        /*!< Drop the oldest queued record to make room */
+    SERIAL_LOG_OVERFLOW_BLOCK,              /*!< Wait for room up to block_timeout_ms, then drop the new record. Never waits in an ISR. */
+    SERIAL_LOG_OVERFLOW_PRIORITY            /*!< Keep the last slots for ERROR and WARN records, which also evict the oldest record when it is DEBUG or VERBOSE */
+} serial_log_overflow_t;
+
+/*
+ * Sink configuration. Set one of log, log_vec or log_dma.
+ */
+typedef struct {
+    func_log log;                   /*!< Log function */
+    func_log_vec log_vec;           /*!< Vectored log function, used instead of log when set */
+    func_log_dma log_dma;           /*!< Starts a transfer of a filled buffer and returns, see serial_log_dma_complete. Used instead of log and log_vec when set, needs USE_LOG_DMA */
+    serial_log_level_t level;       /*!< Most verbose level output to this sink */
+    const char *tag;                /*!< Only output records of this tag, NULL for every tag. Must stay valid. */
+    serial_log_format_t format;     /*!< Output format */
+    bool compress;                  /*!< Compress the output, needs USE_LOG_COMPRESS */
+    serial_log_overflow_t overflow; /*!< Policy when the queue is full, needs USE_LOG_ASYNC. With log_dma, SERIAL_LOG_OVERFLOW_BLOCK waits for a free buffer, others drop the record. */
+    uint32_t block_timeout_ms;      /*!< Longest wait of SERIAL_LOG_OVERFLOW_BLOCK */
+} serial_log_sink_t;
+
+/*
+ * Library statistics, counted when USE_LOG_STATS is defined. Per level counters
+ * are indexed by serial_log_level_t.
+ */
+typedef struct {
+    uint32_t emitted[SERIAL_LOG_VERBOSE + 1];       /*!< Records passed to sinks, once per record whatever the number of sinks and formats. A buffer dump or payload is one record. */
+    uint32_t filtered[SERIAL_LOG_VERBOSE + 1];      /*!< Records stopped by level, tag filter, rate limit or duplicate suppression */
+    uint32_t dropped[SERIAL_LOG_VERBOSE + 1];       /*!< Records lost for lack of a buffer, or to a full queue in a sink */
+    uint32_t truncated[SERIAL_LOG_VERBOSE + 1];     /*!< Records cut at LOG_RECORD_MAX, or to fit the buffer */
+    uint32_t bytes;                                 /*!< Bytes passed to log functions */
+    uint32_t sink_time;                             /*!< Time spent in log functions, in latency counter units */
+    uint32_t cache_hits;                            /*!< Tag levels found in the cache */
+    uint32_t cache_misses;                          /*!< Tag levels looked up in the tag list */
+    uint32_t cache_evictions;                       /*!< Cached tags replaced by another tag */
+    uint32_t queue_high_water;                      /*!< Most records queued at once in a sink, with USE_LOG_ASYNC */
+    uint32_t dma_dropped;                           /*!< Records a DMA sink had no free buffer for, with USE_LOG_DMA */
+    uint32_t tag_memory;                            /*!< Bytes taken by tag entries, from the pool with USE_LOG_STATIC or the heap. Not reset. */
+} serial_log_stats_t;
+
+/*
+ * Message writer for serial_log_record_render. For SERIAL_LOG_FORMAT_TEXT it
+ * writes the message, for SERIAL_LOG_FORMAT_BINARY the argument values laid
+ * out as serial_log_write_binary does, keeping whole values only. Returns the
+ * length written, at most size, and sets *truncated when something was cut.
+ * Called once per format the sinks of the record use.
+ */
+typedef uint16_t (*serial_log_render_t)(const void *ctx, serial_log_format_t format,
+                                         char *buf, uint16_t size, bool *truncated);
+
+/*
+ * Type of a structured record field.
+ */
+typedef enum {
+    SERIAL_LOG_FIELD_INT = 0,       /*!< Signed integer */
+    SERIAL_LOG_FIELD_UINT,          /*!< Unsigned integer */
+    SERIAL_LOG_FIELD_FLOAT,         /*!< Floating point */
+    SERIAL_LOG_FIELD_BOOL,          /*!< Boolean */
+    SERIAL_LOG_FIELD_STR,           /*!< NUL terminated string */
+    SERIAL_LOG_FIELD_BYTES          /*!< Byte array */
+} serial_log_field_type_t;
+
+/*
+ * Key/value field of a structured record. Build it with serial_log_field_int
+ * and the other constructors below.
+ */
+typedef struct {
+    const char *key;                /*!< Field name */
+    serial_log_field_type_t type;   /*!< Type of the value */
+    union {
+        int64_t i;
+        uint64_t u;
+        double f;
+        bool b;
+        const char *s;
+        struct {
+            const void *data;
+            uint16_t len;
+        } bytes;
+    } value;                        /*!< Value, member selected by type */
+} serial_log_field_t;
+
+static inline serial_log_field_t serial_log_field_int(const char *key, int64_t value)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_INT;
+    field.value.i = value;
+    return field;
+}
+
+static inline serial_log_field_t serial_log_field_uint(const char *key, uint64_t value)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_UINT;
+    field.value.u = value;
+    return field;
+}
+
+static inline serial_log_field_t serial_log_field_float(const char *key, double value)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_FLOAT;
+    field.value.f = value;
+    return field;
+}
+
+static inline serial_log_field_t serial_log_field_bool(const char *key, bool value)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_BOOL;
+    field.value.b = value;
+    return field;
+}
+
+static inline serial_log_field_t serial_log_field_str(const char *key, const char *value)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_STR;
+    field.value.s = value;
+    return field;
+}
+
+static inline serial_log_field_t serial_log_field_bytes(const char *key, const void *data, uint16_t len)
+{
+    serial_log_field_t field;
+    field.key = key;
+    field.type = SERIAL_LOG_FIELD_BYTES;
+    field.value.bytes.data = data;
+    field.value.bytes.len = len;
+    return field;
+}
+
+/*
+ * Level of a tag descriptor which has not been registered yet.
+ */
+#define SERIAL_LOG_TAG_UNRESOLVED   0xFF
+
+/*
+ * Tag descriptor. Define one per module with SERIAL_LOG_TAG_DEFINE and log with
+ * the SERIAL_LOGx_TAG macros, then the level check is a single load instead of
+ * a tag lookup. The level is kept up to date by serial_log_level_set.
+ */
+typedef struct serial_log_tag_ {
+    const char *name;                   /*!< Tag string */
+    uint8_t level;                      /*!< Level for this tag */
+    struct serial_log_tag_ *next;       /*!< Next registered tag */
+} serial_log_tag_t;
+
+/*
+ * Define a tag descriptor. It registers itself on first use.
+ */
+#define SERIAL_LOG_TAG_DEFINE(var, tag)     serial_log_tag_t var = { tag, SERIAL_LOG_TAG_UNRESOLVED, NULL }
+
+/*
+ * @brief   Set log function of the default sink, which outputs every level and
+ *          tag. Passing NULL removes the default sink and only sets get_tick.
  *
- * @param   tag Description tag.
- * @param   level Log level output.
+ * @param   log Log function.
+ * @param   get_tick Get tick function.
  *
  * @return  None.
  */
 void serial_log_function_set(func_log log, func_get_tick get_tick);
 
 /*
- * @brief   Set log level for given tag.
+ * @brief   Set vectored log function. Constant parts of a record such as the
+ *          color codes and the tag are passed by reference instead of being
+ *          copied, and queued records are output in one call. Replaces the
+ *          function set with serial_log_function_set.
  *
- * @param   tag Description tag.
+ * @param   log_vec Vectored log function.
+ * @param   get_tick Get tick function.
+ *
+ * @return  None.
+ */
+void serial_log_function_vec_set(func_log_vec log_vec, func_get_tick get_tick);
+
+/*
+ * @brief   Add sink. A record goes to every sink whose level and tag filter
+ *          accept it, after the tag level set with serial_log_level_set.
+ *          Records no sink accepts are dropped before formatting. With
+ *          USE_LOG_ASYNC each sink has its own queue and drain task, so a slow
+ *          sink never holds up the others.
+ *
+ * @param   sink Sink configuration, copied.
+ *
+ * @return  Sink id, or -1 when all LOG_SINK_MAX sinks are in use.
+ */
+int serial_log_sink_add(const serial_log_sink_t *sink);
+
+/*
+ * @brief   Remove sink added with serial_log_sink_add.
+ *
+ * @param   sink Sink id.
+ *
+ * @return  None.
+ */
+void serial_log_sink_remove(int sink);
+
+/*
+ * @brief   Set most verbose level output to a sink. Sink id 0 is the default
+ *          sink set with serial_log_function_set.
+ *
+ * @param   sink Sink id.
+ * @param   level Log level output.
+ *
+ * @return  None.
+ */
+void serial_log_sink_level_set(int sink, serial_log_level_t level);
+
+/*
+ * @brief   Set what a sink does when its queue is full. Sink id 0 is the
+ *          default sink set with serial_log_function_set. Only has an effect
+ *          with USE_LOG_ASYNC. Without RTOS or pthread, a blocked caller
+ *          outputs queued records itself, so do not use
+ *          SERIAL_LOG_OVERFLOW_BLOCK for sinks written from interrupts there.
+ *
+ * @param   sink Sink id.
+ * @param   overflow Overflow policy.
+ * @param   block_timeout_ms Longest wait of SERIAL_LOG_OVERFLOW_BLOCK.
+ *
+ * @return  None.
+ */
+void serial_log_sink_overflow_set(int sink, serial_log_overflow_t overflow, uint32_t block_timeout_ms);
+
+/*
+ * @brief   Tell a sink with a log_dma function that its transfer is done, so
+ *          the buffer is reused and the next filled one is started. Call it
+ *          once per transfer, from the DMA interrupt or a task. Records are
+ *          gathered into the next buffer while a transfer is in flight. Needs
+ *          USE_LOG_DMA.
+ *
+ * @param   sink Sink id returned by serial_log_sink_add.
+ *
+ * @return  None.
+ */
+void serial_log_dma_complete(int sink);
+
+/*
+ * @brief   Start flight recorder. Records are kept in a ring in the given
+ *          memory, which should survive a warm reset, for example a section
+ *          not initialized by the startup code. Call serial_log_recorder_dump
+ *          first to recover the previous session, start clears it. With
+ *          USE_LOG_ASYNC, records still in the recorder queue are lost.
+ *
+ * @param   mem Recorder memory, 4 byte aligned.
+ * @param   size Size of the memory in bytes.
+ * @param   level Most verbose level recorded.
+ * @param   format Record format.
+ *
+ * @return  Sink id of the recorder, or -1 on failure.
+ */
+int serial_log_recorder_start(void *mem, uint32_t size, serial_log_level_t level, serial_log_format_t format);
+
+/*
+ * @brief   Output records kept in recorder memory, oldest first, in chunks as
+ *          they were written. Works on the memory of a previous session before
+ *          serial_log_recorder_start, and on a copy taken off the target.
+ *
+ * @param   mem Recorder memory.
+ * @param   size Size of the memory in bytes.
+ * @param   out Function receiving the records.
+ *
+ * @return  true if the memory holds a valid recorder, false otherwise.
+ */
+bool serial_log_recorder_dump(const void *mem, uint32_t size, func_log out);
+
+#ifdef __linux__
+/*
+ * @brief   Map a file to use as recorder memory on a Linux host. The file keeps
+ *          the records when the process is killed, as no-init RAM does on a
+ *          warm reset. The file is created or resized as needed.
+ *
+ * @param   path File path.
+ * @param   size Size of the memory in bytes.
+ *
+ * @return  Mapped memory, or NULL on failure.
+ */
+void *serial_log_recorder_map(const char *path, uint32_t size);
+#endif
+
+/*
+ * @brief   Set high resolution time source. Records are then stamped in
+ *          seconds with microseconds instead of the tick. Binary records carry
+ *          the low 32 bits of the time in microseconds. Passing NULL returns to
+ *          the tick.
+ *
+ * @param   get_time_us Function returning the time in microseconds.
+ *
+ * @return  None.
+ */
+void serial_log_time_us_set(func_get_time_us get_time_us);
+
+/*
+ * @brief   Set log level for given tag, or for every tag matching a pattern
+ *          where '*' stands for any characters and '?' for one, such as
+ *          "net.*". A level set for the tag itself wins over patterns, and the
+ *          pattern with the most characters other than wildcards wins over
+ *          the others. "*" alone sets the default level and clears every tag
+ *          and pattern.
+ *
+ * @param   tag Description tag or pattern.
  * @param   level Log level output.
  *
  * @return  None.
  */
 void serial_log_level_set(const char *tag, serial_log_level_t level);
 
+/*
+ * @brief   Limit records of given tag with a token bucket. Records over the
+ *          limit are dropped before formatting.
+ *
+ * @param   tag Description tag.
+ * @param   rate Records per second, 0 removes the limit.
+ * @param   burst Records output at once after a quiet period.
+ *
+ * @return  None.
+ */
+void serial_log_rate_set(const char *tag, uint16_t rate, uint16_t burst);
+
+/*
+ * @brief   Suppress repeated records. Records from the same call site, told
+ *          apart by their format string, are output once per window. The
+ *          count of suppressed records is output as "last message repeated
+ *          N times", at their level and tag, before the next record of the
+ *          call site or of another one which takes its entry, and from
+ *          serial_log_flush and serial_log_process. The tag must stay valid
+ *          until then.
+ *
+ * @param   window_ms Window in milliseconds, 0 disables suppression.
+ *
+ * @return  None.
+ */
+void serial_log_dedup_set(uint32_t window_ms);
+
+/*
+ * @brief   Register tag descriptor and resolve its level. Called automatically
+ *          on first use, registering early keeps that lookup out of the first
+ *          log call.
+ *
+ * @param   tag Tag descriptor.
+ *
+ * @return  None.
+ */
+void serial_log_tag_register(serial_log_tag_t *tag);
+
+/*
+ * @brief   Output every record queued so far, and the counts of repeated
+ *          records suppressed so far. Blocks until the drain task has passed
+ *          them to the log function, and with USE_LOG_DMA until every DMA
+ *          transfer is complete.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+void serial_log_flush(void);
+
+/*
+ * @brief   Output queued records from the caller's context, and the counts of
+ *          repeated records suppressed so far. Needed with USE_LOG_ASYNC on
+ *          systems without RTOS or pthread, where it should be called
+ *          periodically from the main loop.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+void serial_log_process(void);
+
+/*
+ * @brief   Set counter used to measure caller-side latency of serial_log_write.
+ *          Use a high resolution source such as a cycle counter. Passing NULL
+ *          disables the measurement. Resets the collected latency.
+ *
+ * @param   get_counter Counter function.
+ *
+ * @return  None.
+ */
+void serial_log_latency_counter_set(func_get_tick get_counter);
+
+/*
+ * @brief   Get caller-side latency collected since the last reset.
+ *
+ * @param   latency Pointer to the latency output.
+ *
+ * @return  None.
+ */
+void serial_log_latency_get(serial_log_latency_t *latency);
+
+/*
+ * @brief   Reset collected caller-side latency.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+void serial_log_latency_reset(void);
+
+/*
+ * @brief   Get statistics collected since the last reset. Time spent in log
+ *          functions is measured with the counter set by
+ *          serial_log_latency_counter_set.
+ *
+ * @param   stats Pointer to the statistics output.
+ *
+ * @return  None.
+ */
+void serial_log_stats_get(serial_log_stats_t *stats);
+
+/*
+ * @brief   Reset collected statistics.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+void serial_log_stats_reset(void);
+
+/*
+ * @brief   Output a summary of the statistics as an INFO record with tag
+ *          "serial_log" once per period. The record is output from the next
+ *          log call after the period ends.
+ *
+ * @param   period_ms Period in milliseconds, 0 disables the output.
+ *
+ * @return  None.
+ */
+void serial_log_stats_period_set(uint32_t period_ms);
+
 /*
  * @brief   Get FreeRTOS tick count.
  *
@@ -53,9 +513,9 @@ void serial_log_level_set(const char *tag, serial_log_level_t level);
 uint32_t serial_log_timestamp(void);
 
 /*
- * @brief   Write message into the log. This function is not recommended to be
- *          use directly. Instead, use one of SERIAL_LOGE, SERIAL_LOGW, SERIAL_LOGI,
- *          SERIAL_LOGD, SERIAL_LOGV macros.
+ * @brief   Write message into the log, as text to every sink. This function is
+ *          not recommended to be use directly. Instead, use one of SERIAL_LOGE,
+ *          SERIAL_LOGW, SERIAL_LOGI, SERIAL_LOGD, SERIAL_LOGV macros.
  *
  * @param   level Log level.
  * @param   tag Tag description.
@@ -66,10 +526,155 @@ uint32_t serial_log_timestamp(void);
  */
 void serial_log_write(serial_log_level_t level, const char *tag, const char *format, ...);
 
+/*
+ * @brief   Write binary record into the log. The format string is not expanded,
+ *          only its address, the tag address, the timestamp and the raw
+ *          argument values are output, to every sink regardless of its
+ *          format. This function is not recommended to be use directly,
+ *          sinks with binary format get binary records from the SERIAL_LOGx
+ *          macros.
+ *
+ * @param   level Log level.
+ * @param   tag Tag description.
+ * @param   format Display format
+ * @param   ... Arguments.
+ *
+ * @return  None.
+ */
+void serial_log_write_binary(serial_log_level_t level, const char *tag, const char *format, ...);
+
+/*
+ * @brief   Write record into the log. The level letter, timestamp, tag and
+ *          colors are added by the library, as text or as a binary record
+ *          depending on the format of each sink. This function is not recommended to be
+ *          use directly. Instead, use one of SERIAL_LOGE, SERIAL_LOGW,
+ *          SERIAL_LOGI, SERIAL_LOGD, SERIAL_LOGV macros.
+ *
+ * @param   level Log level.
+ * @param   tag Tag description.
+ * @param   format Message format, without prefix.
+ * @param   ... Arguments.
+ *
+ * @return  None.
+ */
+void serial_log_record(serial_log_level_t level, const char *tag, const char *format, ...);
+
+/*
+ * @brief   Write record into the log for a registered tag. This function is not
+ *          recommended to be use directly. Instead, use one of SERIAL_LOGE_TAG,
+ *          SERIAL_LOGW_TAG, SERIAL_LOGI_TAG, SERIAL_LOGD_TAG, SERIAL_LOGV_TAG macros.
+ *
+ * @param   level Log level.
+ * @param   tag Tag descriptor.
+ * @param   format Message format, without prefix.
+ * @param   ... Arguments.
+ *
+ * @return  None.
+ */
+void serial_log_record_tag(serial_log_level_t level, serial_log_tag_t *tag, const char *format, ...);
+
+/*
+ * @brief   Write record whose message is written by a callback instead of
+ *          being formatted from variable arguments. Filtering, prefix,
+ *          timestamp and the binary record header are the same as for
+ *          serial_log_record. Used by the C++ front-end in serial_log.hpp.
+ *
+ * @param   level Log level.
+ * @param   tag Tag description.
+ * @param   format Message format, used for duplicate suppression and by the
+ *          binary decoder.
+ * @param   render Message writer.
+ * @param   ctx Context passed to render.
+ *
+ * @return  None.
+ */
+void serial_log_record_render(serial_log_level_t level, const char *tag, const char *format,
+                              serial_log_render_t render, const void *ctx);
+
+/*
+ * @brief   Write record with a callback message for a registered tag.
+ *
+ * @param   level Log level.
+ * @param   tag Tag descriptor.
+ * @param   format Message format.
+ * @param   render Message writer.
+ * @param   ctx Context passed to render.
+ *
+ * @return  None.
+ */
+void serial_log_record_tag_render(serial_log_level_t level, serial_log_tag_t *tag, const char *format,
+                                  serial_log_render_t render, const void *ctx);
+
+/*
+ * @brief   Write structured record. Sinks with SERIAL_LOG_FORMAT_CBOR get a
+ *          CBOR map with level, timestamp, tag, message and the fields, see
+ *          tools/serial_log_cbor.py. Text sinks get the message followed by
+ *          key=value pairs, binary sinks a binary record whose arguments are
+ *          the fields in CBOR. Fields which do not fit the record buffer are
+ *          left out whole. This function is not recommended to be use
+ *          directly. Instead, use one of SERIAL_LOGE_KV, SERIAL_LOGW_KV,
+ *          SERIAL_LOGI_KV, SERIAL_LOGD_KV, SERIAL_LOGV_KV macros.
+ *
+ * @param   level Log level.
+ * @param   tag Tag description.
+ * @param   message Message, output as is. A string constant, so binary
+ *          records can refer to it.
+ * @param   fields Fields.
+ * @param   count Number of fields.
+ *
+ * @return  None.
+ */
+void serial_log_record_kv(serial_log_level_t level, const char *tag, const char *message,
+                          const serial_log_field_t *fields, uint8_t count);
+
+/*
+ * @brief   Write binary payload. Sinks with SERIAL_LOG_FORMAT_BINARY or
+ *          SERIAL_LOG_FORMAT_CBOR get it in frames of at most LOG_BUF_SIZE
+ *          bytes, which pass the payload to the log function in place. Text
+ *          sinks get it in base64, one record per line. Frames and lines
+ *          carry a CRC-32, tools/serial_log_payload.py writes the payloads
+ *          to files. Use SERIAL_LOG_PAYLOAD instead of SERIAL_LOG_BUFFER_HEX
+ *          for large buffers.
+ *
+ * @param   level Log level.
+ * @param   tag Tag description, cut to 32 characters in frames.
+ * @param   data Payload. With USE_LOG_ASYNC it is copied into the queue,
+ *          otherwise it is only read until the function returns.
+ * @param   len Length of payload in bytes.
+ *
+ * @return  None.
+ */
+void serial_log_payload(serial_log_level_t level, const char *tag, const void *data, uint32_t len);
+
 /** @cond */
 #include "serial_log_internal.h"
+
+extern uint8_t serial_log_level_limit;
+bool serial_log_enabled_internal(const char *tag, serial_log_level_t level);
+
+/* Filtering and output of a record split in two, so the macros filter once
+   and only evaluate the arguments of records which are output. */
+uint32_t serial_log_select(serial_log_level_t level, const char *tag, const char *format);
+void serial_log_record_sinks(uint32_t sinks, serial_log_level_t level, const char *tag, const char *format, ...);
+void serial_log_record_kv_sinks(uint32_t sinks, serial_log_level_t level, const char *tag, const char *message,
+                                const serial_log_field_t *fields, uint8_t count);
 /** @endcond */
 
+/*
+ * @brief   Check whether a record would be output, without evaluating its
+ *          arguments. Levels no tag and no sink accepts are rejected inline.
+ *
+ * @param   tag Description tag.
+ * @param   level Log level.
+ *
+ * @return  true if the record would be output, false otherwise.
+ */
+static inline bool serial_log_enabled(const char *tag, serial_log_level_t level)
+{
+    return level <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) &&
+           serial_log_enabled_internal(tag, level);
+}
+
 /*
  * Log local level.
  */
@@ -86,11 +691,29 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
  */
 #define SERIAL_LOG_BUFFER_HEX_LEVEL(tag, buffer, buff_len, level)              \
     do {                                                                    \
-        if ( LOG_LOCAL_LEVEL >= level ) {                                   \
+        if ( LOG_LOCAL_LEVEL >= level &&                                    \
+             (level) <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) ) { \
             serial_log_buffer_hex_internal(tag, buffer, buff_len, level);      \
         }                                                                   \
     } while(0)
 
+/*
+ * @brief   Log a binary payload at specified level, see serial_log_payload.
+ *
+ * @param   tag Description tag.
+ * @param   data Pointer to the payload.
+ * @param   len Length of payload in bytes.
+ * @param   level Level of the log.
+ *
+ */
+#define SERIAL_LOG_PAYLOAD_LEVEL(tag, data, len, level)                       \
+    do {                                                                    \
+        if ( LOG_LOCAL_LEVEL >= level &&                                    \
+             (level) <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) ) { \
+            serial_log_payload(level, tag, data, len);                     \
+        }                                                                   \
+    } while(0)
+
 /**
  * @brief   Log a buffer of characters at specified level, separated into 16 bytes each line.
  *          Buffer should contain only printable characters.
@@ -103,7 +726,8 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
  */
 #define SERIAL_LOG_BUFFER_CHAR_LEVEL(tag, buffer, buff_len, level)             \
     do {                                                                    \
-        if(LOG_LOCAL_LEVEL >= level) {                                      \
+        if(LOG_LOCAL_LEVEL >= level &&                                      \
+           (level) <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED)) { \
             serial_log_buffer_char_internal(tag, buffer, buff_len, level);     \
         }                                                                   \
     } while(0)
@@ -140,6 +764,22 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
         }                                                                   \
     } while(0)
 
+/*
+ * @brief  Log a binary payload at Info level.
+ *
+ * @param  tag Description tag.
+ * @param  data Pointer to the payload.
+ * @param  len Length of payload in bytes.
+ *
+ * @see    ``SERIAL_LOG_PAYLOAD_LEVEL``.
+ */
+#define SERIAL_LOG_PAYLOAD(tag, data, len)                                     \
+    do {                                                                    \
+        if(LOG_LOCAL_LEVEL >= SERIAL_LOG_INFO) {                               \
+            SERIAL_LOG_PAYLOAD_LEVEL(tag, data, len, SERIAL_LOG_INFO);         \
+        }                                                                   \
+    } while(0)
+
 /*
  * Compatible macros in lowcase.
  */
@@ -173,9 +813,14 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
 #define LOG_COLOR_V         LOG_COLOR(LOG_COLOR_BLUE)       /*!< Log verbose color */
 
 /*
- * Macros to output logs.
+ * Record layout, for use with serial_log_write. The SERIAL_LOGx macros build
+ * the same layout inside the library.
  */
+#ifdef USE_LOG_COMPACT
+#define LOG_FORMAT(letter, format)  #letter " %x %s: " format "\n"
+#else
 #define LOG_FORMAT(letter, format)  LOG_COLOR_ ## letter #letter " (%d) %s: " format LOG_RESET_COLOR "\r\n"
+#endif
 
 /* Macro to out put log at ERROR level */
 #define SERIAL_LOGE(tag, format, ...)  SERIAL_LOG_LEVEL_LOCAL(SERIAL_LOG_ERROR  , tag, format, ##__VA_ARGS__)
@@ -188,17 +833,64 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
 /* Macro to out put log at VERBOSE level */
 #define SERIAL_LOGV(tag, format, ...)  SERIAL_LOG_LEVEL_LOCAL(SERIAL_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
 
+/* Macros to output logs from registered tag descriptor */
+#define SERIAL_LOGE_TAG(tag, format, ...)  SERIAL_LOG_TAG_LEVEL_LOCAL(SERIAL_LOG_ERROR  , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGW_TAG(tag, format, ...)  SERIAL_LOG_TAG_LEVEL_LOCAL(SERIAL_LOG_WARN   , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGI_TAG(tag, format, ...)  SERIAL_LOG_TAG_LEVEL_LOCAL(SERIAL_LOG_INFO   , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGD_TAG(tag, format, ...)  SERIAL_LOG_TAG_LEVEL_LOCAL(SERIAL_LOG_DEBUG  , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGV_TAG(tag, format, ...)  SERIAL_LOG_TAG_LEVEL_LOCAL(SERIAL_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+/*
+ * Macros to output logs at specified level. The arguments are only evaluated
+ * when the record will be output. The tag is evaluated once, and the record
+ * is filtered once, the selected sinks are passed on to the output.
+ */
+#define SERIAL_LOG_LEVEL(level, tag, format, ...) do {                                  \
+        const char *serial_log_tag_ = (tag);                                            \
+        uint32_t serial_log_sinks_;                                                     \
+        if ((level) <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) &&    \
+            (serial_log_sinks_ = serial_log_select(level, serial_log_tag_, format)) != 0) \
+            serial_log_record_sinks(serial_log_sinks_, level, serial_log_tag_, format, ##__VA_ARGS__); \
+    } while(0)
+
 /*
- * Macros to output logs at specified level.
+ * Macro to output logs at specified level from registered tag descriptor.
+ * Filtered-out records only cost a load of the level limit and the descriptor
+ * level.
  */
-#define SERIAL_LOG_LEVEL(level, tag, format, ...) do {                                                                                                     \
-        if      (level==SERIAL_LOG_ERROR )     { serial_log_write(SERIAL_LOG_ERROR,      tag, LOG_FORMAT(E, format), serial_log_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==SERIAL_LOG_WARN )      { serial_log_write(SERIAL_LOG_WARN,       tag, LOG_FORMAT(W, format), serial_log_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==SERIAL_LOG_DEBUG )     { serial_log_write(SERIAL_LOG_DEBUG,      tag, LOG_FORMAT(D, format), serial_log_timestamp(), tag, ##__VA_ARGS__); } \
-        else if (level==SERIAL_LOG_VERBOSE )   { serial_log_write(SERIAL_LOG_VERBOSE,    tag, LOG_FORMAT(V, format), serial_log_timestamp(), tag, ##__VA_ARGS__); } \
-        else                                { serial_log_write(SERIAL_LOG_INFO,       tag, LOG_FORMAT(I, format), serial_log_timestamp(), tag, ##__VA_ARGS__); } \
+#define SERIAL_LOG_TAG_LEVEL(log_level, tag, format, ...) do {                          \
+        serial_log_tag_t *serial_log_tag_ = (tag);                                      \
+        if (__atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) >= (log_level) && \
+            __atomic_load_n(&serial_log_tag_->level, __ATOMIC_RELAXED) >= (log_level)) \
+            serial_log_record_tag(log_level, serial_log_tag_, format, ##__VA_ARGS__);   \
     } while(0)
 
+/*
+ * Macro to output structured record at specified level. The fields are only
+ * evaluated when the record will be output.
+ *
+ *     SERIAL_LOGI_KV("net", "connected", serial_log_field_str("host", host),
+ *                    serial_log_field_int("rssi", rssi));
+ */
+#define SERIAL_LOG_KV_LEVEL(level, tag, message, ...) do {                              \
+        const char *serial_log_tag_ = (tag);                                            \
+        uint32_t serial_log_sinks_;                                                     \
+        if ( LOG_LOCAL_LEVEL >= level &&                                                \
+             (level) <= __atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) &&   \
+             (serial_log_sinks_ = serial_log_select(level, serial_log_tag_, message)) != 0 ) { \
+            const serial_log_field_t serial_log_fields_[] = { __VA_ARGS__ };            \
+            serial_log_record_kv_sinks(serial_log_sinks_, level, serial_log_tag_, message, serial_log_fields_, \
+                                       sizeof(serial_log_fields_) / sizeof(serial_log_fields_[0])); \
+        }                                                                               \
+    } while(0)
+
+/* Macros to output structured records */
+#define SERIAL_LOGE_KV(tag, message, ...)  SERIAL_LOG_KV_LEVEL(SERIAL_LOG_ERROR  , tag, message, __VA_ARGS__)
+#define SERIAL_LOGW_KV(tag, message, ...)  SERIAL_LOG_KV_LEVEL(SERIAL_LOG_WARN   , tag, message, __VA_ARGS__)
+#define SERIAL_LOGI_KV(tag, message, ...)  SERIAL_LOG_KV_LEVEL(SERIAL_LOG_INFO   , tag, message, __VA_ARGS__)
+#define SERIAL_LOGD_KV(tag, message, ...)  SERIAL_LOG_KV_LEVEL(SERIAL_LOG_DEBUG  , tag, message, __VA_ARGS__)
+#define SERIAL_LOGV_KV(tag, message, ...)  SERIAL_LOG_KV_LEVEL(SERIAL_LOG_VERBOSE, tag, message, __VA_ARGS__)
+
 /*
  * Runtime macro to output logs at a specified level. Also check the
  * level with ``LOG_LOCAL_LEVEL``.
@@ -207,6 +899,10 @@ void serial_log_write(serial_log_level_t level, const char *tag, const char *for
         if ( LOG_LOCAL_LEVEL >= level ) SERIAL_LOG_LEVEL(level, tag, format, ##__VA_ARGS__);   \
     } while(0)
 
+#define SERIAL_LOG_TAG_LEVEL_LOCAL(level, tag, format, ...) do {                               \
+        if ( LOG_LOCAL_LEVEL >= level ) SERIAL_LOG_TAG_LEVEL(level, tag, format, ##__VA_ARGS__); \
+    } while(0)
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,553 @@
+#ifndef _SERIAL_LOG_HPP_
+#define _SERIAL_LOG_HPP_
+
+/*
+ * C++17 front-end. Format strings are checked against the argument types at
+ * compile time, and arguments are written into the record buffer with their
+ * exact type instead of going through va_list. Records above
+ * SERIAL_LOG_CPP_LEVEL generate no code. Tag levels, sinks and every filter
+ * are the ones of the C library.
+ *
+ *     static serial_log::tag net_tag("net");
+ *
+ *     SERIAL_LOGI_CPP("app", "started in %u ms", elapsed);
+ *     SERIAL_LOGW_CPP(net_tag, "retry %d of %s", retry, host);
+ *
+ * Conversions are those of serial_log_write_binary. '*' width and precision
+ * are not supported, and an argument wider than its conversion is an error,
+ * use the l, ll, j or z length modifier for it.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "serial_log.h"
+
+/* Most verbose level compiled in */
+#ifndef SERIAL_LOG_CPP_LEVEL
+#define SERIAL_LOG_CPP_LEVEL    LOG_LOCAL_LEVEL
+#endif
+
+namespace serial_log {
+
+/*
+ * Tag descriptor. Constant initialized, so it can be used from constructors
+ * of other static objects. Its level is a single load, see SERIAL_LOG_TAG_DEFINE.
+ */
+class tag {
+public:
+    constexpr explicit tag(const char *name) : desc_{ name, SERIAL_LOG_TAG_UNRESOLVED, nullptr } {}
+
+    tag(const tag &) = delete;
+    tag &operator=(const tag &) = delete;
+
+    serial_log_tag_t *get() { return &desc_; }
+
+private:
+    serial_log_tag_t desc_;
+};
+
+namespace detail {
+
+enum class arg_kind : uint8_t { integer, floating, string, pointer, other };
+
+enum class length : uint8_t { none, hh, h, l, ll, j, z, t, unsupported };
+
+enum class format_error : uint8_t { none, too_few_args, too_many_args, type_mismatch, too_wide, star, unknown };
+
+/*
+ * One conversion of a format string.
+ */
+struct spec {
+    const char *begin;      /* The '%' */
+    const char *end;        /* Past the conversion character */
+    char conversion;
+    length len;
+    bool star;
+};
+
+template <typename T>
+constexpr arg_kind kind_of()
+{
+    using U = std::decay_t<T>;
+    if constexpr (std::is_integral_v<U> || std::is_enum_v<U>)
+    {
+        return arg_kind::integer;
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        return arg_kind::floating;
+    }
+    else if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *>)
+    {
+        return arg_kind::string;
+    }
+    else if constexpr (std::is_pointer_v<U> || std::is_null_pointer_v<U>)
+    {
+        return arg_kind::pointer;
+    }
+    else
+    {
+        return arg_kind::other;
+    }
+}
+
+constexpr size_t length_size(length len)
+{
+    /* Size of the integer a conversion reads, shorter ones are promoted to int */
+    switch (len)
+    {
+    case length::l:  return sizeof(long);
+    case length::ll: return sizeof(long long);
+    case length::j:  return sizeof(intmax_t);
+    case length::z:  return sizeof(size_t);
+    case length::t:  return sizeof(ptrdiff_t);
+    default:         return sizeof(int);
+    }
+}
+
+constexpr bool is_integer_conversion(char c)
+{
+    return c == 'd' || c == 'i' || c == 'u' || c == 'x' || c == 'X' || c == 'o' || c == 'c';
+}
+
+constexpr bool is_float_conversion(char c)
+{
+    return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A';
+}
+
+/*
+ * Find the next conversion, skipping "%%". Returns false at the end of the
+ * format.
+ */
+constexpr bool next_spec(const char *f, spec &s)
+{
+    for (; *f; f++)
+    {
+        if (*f != '%')
+        {
+            continue;
+        }
+        if (f[1] == '%')
+        {
+            f++;
+            continue;
+        }
+
+        s.begin = f++;
+        s.star = false;
+        while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0')
+        {
+            f++;
+        }
+        while (*f == '*' || *f == '.' || (*f >= '0' && *f <= '9'))
+        {
+            s.star |= (*f == '*');
+            f++;
+        }
+
+        s.len = length::none;
+        if (*f == 'h')
+        {
+            s.len = (f[1] == 'h') ? length::hh : length::h;
+            f += (f[1] == 'h') ? 2 : 1;
+        }
+        else if (*f == 'l')
+        {
+            s.len = (f[1] == 'l') ? length::ll : length::l;
+            f += (f[1] == 'l') ? 2 : 1;
+        }
+        else if (*f == 'j' || *f == 'z' || *f == 't')
+        {
+            s.len = (*f == 'j') ? length::j : (*f == 'z') ? length::z : length::t;
+            f++;
+        }
+        else if (*f == 'L' || *f == 'q')
+        {
+            s.len = length::unsupported;
+            f++;
+        }
+
+        s.conversion = *f;
+        s.end = *f ? f + 1 : f;
+        return true;
+    }
+    return false;
+}
+
+template <typename... Args>
+constexpr format_error check_format(const char *format)
+{
+    constexpr arg_kind kinds[] = { kind_of<Args>()..., arg_kind::other };
+    constexpr size_t sizes[] = { sizeof(std::decay_t<Args>)..., 0 };
+    size_t index = 0;
+    spec s{};
+
+    for (const char *f = format; next_spec(f, s); f = s.end)
+    {
+        if (s.star)
+        {
+            return format_error::star;
+        }
+        if (s.len == length::unsupported)
+        {
+            return format_error::unknown;
+        }
+        if (index == sizeof...(Args))
+        {
+            return format_error::too_few_args;
+        }
+
+        arg_kind kind = kinds[index];
+        if (is_integer_conversion(s.conversion))
+        {
+            if (kind != arg_kind::integer)
+            {
+                return format_error::type_mismatch;
+            }
+            if (s.conversion != 'c' && sizes[index] > length_size(s.len))
+            {
+                return format_error::too_wide;
+            }
+        }
+        else if (is_float_conversion(s.conversion))
+        {
+            if (kind != arg_kind::floating)
+            {
+                return format_error::type_mismatch;
+            }
+        }
+        else if (s.conversion == 's')
+        {
+            if (kind != arg_kind::string)
+            {
+                return format_error::type_mismatch;
+            }
+        }
+        else if (s.conversion == 'p')
+        {
+            if (kind != arg_kind::pointer && kind != arg_kind::string)
+            {
+                return format_error::type_mismatch;
+            }
+        }
+        else
+        {
+            return format_error::unknown;
+        }
+        index++;
+    }
+    return (index == sizeof...(Args)) ? format_error::none : format_error::too_many_args;
+}
+
+/*
+ * Output position in the record buffer.
+ */
+struct writer {
+    char *p;
+    char *end;
+    bool truncated;
+    const char *f;          /* Format position of the next argument */
+};
+
+inline void put_literal(writer &w, const char *from, const char *to)
+{
+    /* Format text between conversions, "%%" becomes '%' */
+    for (const char *c = from; c < to; c++)
+    {
+        if (c[0] == '%' && c[1] == '%')
+        {
+            c++;
+        }
+        if (w.p == w.end)
+        {
+            w.truncated = true;
+            return;
+        }
+        *w.p++ = *c;
+    }
+}
+
+template <typename T>
+inline void put_text(writer &w, const spec &s, const T &arg)
+{
+    /* snprintf with the conversion alone and the argument in the exact type
+       the conversion reads */
+    char conv[24];
+    size_t conv_len = (size_t)(s.end - s.begin);
+    if (conv_len >= sizeof(conv))
+    {
+        w.truncated = true;
+        return;
+    }
+    std::memcpy(conv, s.begin, conv_len);
+    conv[conv_len] = '\0';
+
+    size_t room = (size_t)(w.end - w.p) + 1;
+    char *out = w.p;
+    int n = 0;
+    using U = std::decay_t<T>;
+    if constexpr (kind_of<T>() == arg_kind::integer)
+    {
+        bool is_signed = (s.conversion == 'd' || s.conversion == 'i');
+        switch (s.len)
+        {
+        case length::l:
+            n = is_signed ? std::snprintf(out, room, conv, (long)arg) : std::snprintf(out, room, conv, (unsigned long)arg);
+            break;
+        case length::ll:
+            n = is_signed ? std::snprintf(out, room, conv, (long long)arg) : std::snprintf(out, room, conv, (unsigned long long)arg);
+            break;
+        case length::j:
+            n = is_signed ? std::snprintf(out, room, conv, (intmax_t)arg) : std::snprintf(out, room, conv, (uintmax_t)arg);
+            break;
+        case length::z:
+            n = is_signed ? std::snprintf(out, room, conv, (std::make_signed_t<size_t>)arg) : std::snprintf(out, room, conv, (size_t)arg);
+            break;
+        case length::t:
+            n = is_signed ? std::snprintf(out, room, conv, (ptrdiff_t)arg) : std::snprintf(out, room, conv, (std::make_unsigned_t<ptrdiff_t>)arg);
+            break;
+        default:
+            n = is_signed ? std::snprintf(out, room, conv, (int)arg) : std::snprintf(out, room, conv, (unsigned int)arg);
+            break;
+        }
+    }
+    else if constexpr (kind_of<T>() == arg_kind::floating)
+    {
+        n = std::snprintf(out, room, conv, (double)arg);
+    }
+    else if constexpr (kind_of<T>() == arg_kind::string)
+    {
+        const char *str = arg;
+        if (s.conversion == 's')
+        {
+            n = std::snprintf(out, room, conv, str ? str : "(null)");
+        }
+        else
+        {
+            n = std::snprintf(out, room, conv, (const void *)str);
+        }
+    }
+    else
+    {
+        static_assert(std::is_pointer_v<U> || std::is_null_pointer_v<U>, "unsupported argument type");
+        n = std::snprintf(out, room, conv, (const void *)arg);
+    }
+
+    /* snprintf returns the length it wanted to write */
+    if (n < 0)
+    {
+        return;
+    }
+    if ((size_t)n >= room)
+    {
+        w.truncated = true;
+        n = (int)(room - 1);
+    }
+    w.p += n;
+}
+
+inline void put_bytes(writer &w, const void *data, size_t len)
+{
+    /* Binary values are kept whole or not at all */
+    if (w.truncated || (size_t)(w.end - w.p) < len)
+    {
+        w.truncated = true;
+        return;
+    }
+    std::memcpy(w.p, data, len);
+    w.p += len;
+}
+
+template <typename T>
+inline void put_binary(writer &w, const spec &s, const T &arg)
+{
+    /* Same layout as log_binary_encode: integers as int or long long,
+       pointers as 32 bits, floating point as double, strings with a length byte */
+    if constexpr (kind_of<T>() == arg_kind::integer)
+    {
+        if (length_size(s.len) == sizeof(long long))
+        {
+            long long value = (long long)arg;
+            put_bytes(w, &value, sizeof(value));
+        }
+        else
+        {
+            int value = (int)arg;
+            put_bytes(w, &value, sizeof(value));
+        }
+    }
+    else if constexpr (kind_of<T>() == arg_kind::floating)
+    {
+        double value = (double)arg;
+        put_bytes(w, &value, sizeof(value));
+    }
+    else if constexpr (kind_of<T>() == arg_kind::string)
+    {
+        const char *str = arg;
+        if (s.conversion == 's')
+        {
+            size_t len = str ? std::strlen(str) : 0;
+            uint8_t len8 = (uint8_t)((len > UINT8_MAX) ? UINT8_MAX : len);
+            if (!w.truncated && (size_t)(w.end - w.p) < 1u + len8)
+            {
+                w.truncated = true;
+                return;
+            }
+            put_bytes(w, &len8, sizeof(len8));
+            put_bytes(w, str, len8);
+        }
+        else
+        {
+            uint32_t value = (uint32_t)(uintptr_t)str;
+            put_bytes(w, &value, sizeof(value));
+        }
+    }
+    else
+    {
+        uint32_t value = (uint32_t)(uintptr_t)arg;
+        put_bytes(w, &value, sizeof(value));
+    }
+}
+
+template <typename T>
+inline void put_arg(writer &w, serial_log_format_t format, const T &arg)
+{
+    spec s{};
+    next_spec(w.f, s);
+    if (format == SERIAL_LOG_FORMAT_TEXT)
+    {
+        put_literal(w, w.f, s.begin);
+        put_text(w, s, arg);
+    }
+    else
+    {
+        put_binary(w, s, arg);
+    }
+    w.f = s.end;
+}
+
+/*
+ * Arguments of one record, referenced until the record is written.
+ */
+template <typename... Args>
+struct message {
+    const char *format;
+    const void *args[sizeof...(Args) + 1];
+
+    template <size_t... I>
+    uint16_t write(serial_log_format_t fmt, char *buf, uint16_t size, bool *truncated,
+                   std::index_sequence<I...>) const
+    {
+        /* Text keeps one byte for the NUL snprintf writes */
+        writer w{ buf, buf + size - (fmt == SERIAL_LOG_FORMAT_TEXT ? 1 : 0), false, format };
+        (put_arg(w, fmt, *static_cast<const Args *>(args[I])), ...);
+        if (fmt == SERIAL_LOG_FORMAT_TEXT)
+        {
+            put_literal(w, w.f, w.f + std::strlen(w.f));
+        }
+        *truncated |= w.truncated;
+        return (uint16_t)(w.p - buf);
+    }
+
+    static uint16_t render(const void *ctx, serial_log_format_t fmt, char *buf, uint16_t size, bool *truncated)
+    {
+        const message *m = static_cast<const message *>(ctx);
+        return m->write(fmt, buf, size, truncated, std::index_sequence_for<Args...>{});
+    }
+};
+
+template <typename Format, typename... Args>
+constexpr bool check()
+{
+    constexpr format_error error = check_format<Args...>(Format::str());
+    static_assert(error != format_error::too_few_args, "serial_log: format has more conversions than arguments");
+    static_assert(error != format_error::too_many_args, "serial_log: format has fewer conversions than arguments");
+    static_assert(error != format_error::type_mismatch, "serial_log: argument type does not match its conversion");
+    static_assert(error != format_error::too_wide, "serial_log: argument is wider than its conversion, add a length modifier");
+    static_assert(error != format_error::star, "serial_log: '*' width and precision are not supported");
+    static_assert(error != format_error::unknown, "serial_log: unsupported conversion");
+    return error == format_error::none;
+}
+
+} /* namespace detail */
+
+/*
+ * @brief   Write record with a format checked at compile time. Use the
+ *          SERIAL_LOGx_CPP macros, which pass the format as a type.
+ *
+ * @param   tag Tag string or descriptor.
+ * @param   format Format type from SERIAL_LOG_CPP_FORMAT.
+ * @param   args Arguments.
+ *
+ * @return  None.
+ */
+template <serial_log_level_t Level, typename Format, typename... Args>
+inline void record(const char *tag, Format, const Args &... args)
+{
+    static_assert(detail::check<Format, Args...>(), "serial_log: invalid format");
+    if constexpr (Level != SERIAL_LOG_NONE && Level <= SERIAL_LOG_CPP_LEVEL)
+    {
+        /* The arguments are evaluated already, the record is filtered once
+           in serial_log_record_render */
+        if (__atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) >= Level)
+        {
+            detail::message<Args...> m{ Format::str(), { static_cast<const void *>(&args)..., nullptr } };
+            serial_log_record_render(Level, tag, Format::str(), &detail::message<Args...>::render, &m);
+        }
+    }
+    else
+    {
+        ((void)tag, ..., (void)args);
+    }
+}
+
+template <serial_log_level_t Level, typename Format, typename... Args>
+inline void record(tag &t, Format, const Args &... args)
+{
+    static_assert(detail::check<Format, Args...>(), "serial_log: invalid format");
+    if constexpr (Level != SERIAL_LOG_NONE && Level <= SERIAL_LOG_CPP_LEVEL)
+    {
+        /* Same inline filter as SERIAL_LOG_TAG_LEVEL */
+        serial_log_tag_t *desc = t.get();
+        if (__atomic_load_n(&serial_log_level_limit, __ATOMIC_RELAXED) >= Level &&
+            __atomic_load_n(&desc->level, __ATOMIC_RELAXED) >= Level)
+        {
+            detail::message<Args...> m{ Format::str(), { static_cast<const void *>(&args)..., nullptr } };
+            serial_log_record_tag_render(Level, desc, Format::str(), &detail::message<Args...>::render, &m);
+        }
+    }
+    else
+    {
+        ((void)t, ..., (void)args);
+    }
+}
+
+} /* namespace serial_log */
+
+/*
+ * Format string as a type, so it can be checked at compile time.
+ */
+#define SERIAL_LOG_CPP_FORMAT(format)                                                   \
+    [] {                                                                                \
+        struct serial_log_format {                                                      \
+            static constexpr const char *str() { return format; }                       \
+        };                                                                              \
+        return serial_log_format{};                                                     \
+    }()
+
+#define SERIAL_LOG_CPP(level, tag, format, ...) \
+    ::serial_log::record<level>(tag, SERIAL_LOG_CPP_FORMAT(format), ##__VA_ARGS__)
+
+/* Macros to output logs with checked formats, tag is a string or a serial_log::tag */
+#define SERIAL_LOGE_CPP(tag, format, ...)  SERIAL_LOG_CPP(SERIAL_LOG_ERROR  , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGW_CPP(tag, format, ...)  SERIAL_LOG_CPP(SERIAL_LOG_WARN   , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGI_CPP(tag, format, ...)  SERIAL_LOG_CPP(SERIAL_LOG_INFO   , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGD_CPP(tag, format, ...)  SERIAL_LOG_CPP(SERIAL_LOG_DEBUG  , tag, format, ##__VA_ARGS__)
+#define SERIAL_LOGV_CPP(tag, format, ...)  SERIAL_LOG_CPP(SERIAL_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif /* _SERIAL_LOG_HPP_ */
@@ -0,0 +1,168 @@
+#ifndef _SERIAL_LOG_PORT_H_
+#define _SERIAL_LOG_PORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef USE_RTOS
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "task.h"
+#include "semphr.h"
+#elif defined(USE_PTHREAD)
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Atomic operations. Aligned word loads and stores are atomic on every
+ * supported core. Read-modify-write operations need exclusive access
+ * instructions, which Cortex-M0 does not have, so under RTOS they fall back
+ * to a critical section there.
+ */
+#define atomic_load(p)              __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define atomic_load_relaxed(p)      __atomic_load_n(p, __ATOMIC_RELAXED)
+#define atomic_store(p, v)          __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define atomic_store_relaxed(p, v)  __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define atomic_fence_acquire()      __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define atomic_fence_release()      __atomic_thread_fence(__ATOMIC_RELEASE)
+#define atomic_fence()              __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#if defined(USE_RTOS) && defined(__ARM_ARCH_6M__)
+static inline uint32_t port_atomic_add(uint32_t *p, uint32_t v)
+{
+    taskENTER_CRITICAL();
+    uint32_t old = *p;
+    *p = old + v;
+    taskEXIT_CRITICAL();
+    return old;
+}
+
+static inline bool port_atomic_cas(uint32_t *p, uint32_t *expected, uint32_t desired)
+{
+    taskENTER_CRITICAL();
+    bool ok = (*p == *expected);
+    if (ok)
+    {
+        *p = desired;
+    }
+    else
+    {
+        *expected = *p;
+    }
+    taskEXIT_CRITICAL();
+    return ok;
+}
+
+#define atomic_add(p, v)            port_atomic_add(p, v)
+#define atomic_cas(p, e, v)         port_atomic_cas(p, e, v)
+#else
+#define atomic_add(p, v)            __atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define atomic_cas(p, e, v)         __atomic_compare_exchange_n(p, e, v, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#endif
+
+/*
+ * Mutex. One serializes writers of the configuration, and each sink has one
+ * that loggers hold while they call its log function. Under RTOS the mutexes
+ * are created by log_mutex_create, once and before any of them is taken.
+ */
+#if defined(USE_RTOS) && defined(USE_LOG_STATIC)
+/* Mutex created in its own storage, needs configSUPPORT_STATIC_ALLOCATION */
+typedef struct {
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t storage;
+} log_mutex_t;
+#define LOG_MUTEX_INIT              { NULL }
+
+static inline void log_mutex_create(log_mutex_t *mutex)
+{
+    if (!mutex->handle)
+    {
+        mutex->handle = xSemaphoreCreateMutexStatic(&mutex->storage);
+    }
+}
+
+static inline void log_mutex_lock(log_mutex_t *mutex)
+{
+    xSemaphoreTake(mutex->handle, portMAX_DELAY);
+}
+
+static inline void log_mutex_unlock(log_mutex_t *mutex)
+{
+    xSemaphoreGive(mutex->handle);
+}
+#elif defined(USE_RTOS)
+typedef SemaphoreHandle_t log_mutex_t;
+#define LOG_MUTEX_INIT              NULL
+
+static inline void log_mutex_create(log_mutex_t *mutex)
+{
+    if (!*mutex)
+    {
+        *mutex = xSemaphoreCreateMutex();
+    }
+}
+
+static inline void log_mutex_lock(log_mutex_t *mutex)
+{
+    xSemaphoreTake(*mutex, portMAX_DELAY);
+}
+
+static inline void log_mutex_unlock(log_mutex_t *mutex)
+{
+    xSemaphoreGive(*mutex);
+}
+#elif defined(USE_PTHREAD)
+typedef pthread_mutex_t log_mutex_t;
+#define LOG_MUTEX_INIT              PTHREAD_MUTEX_INITIALIZER
+
+static inline void log_mutex_create(log_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void log_mutex_lock(log_mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void log_mutex_unlock(log_mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+#else
+typedef uint8_t log_mutex_t;
+#define LOG_MUTEX_INIT              0
+
+static inline void log_mutex_create(log_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void log_mutex_lock(log_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void log_mutex_unlock(log_mutex_t *mutex)
+{
+    (void)mutex;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERIAL_LOG_PORT_H_ */
@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+
+#include "serial_log_mock.h"
+
+char mock_capture[MOCK_CAPTURE_SIZE];
+size_t mock_capture_len = 0;
+uint32_t mock_calls = 0;
+uint32_t mock_tick_value = 0;
+int mock_failures = 0;
+
+/* Bytes counted by mock_log_null, read so the calls are not optimized away */
+volatile uint32_t mock_null_bytes = 0;
+
+static void mock_append(const void *data, size_t len)
+{
+    /* Output past the capture is dropped, the check against it then fails */
+    if (len > MOCK_CAPTURE_SIZE - 1 - mock_capture_len)
+    {
+        len = MOCK_CAPTURE_SIZE - 1 - mock_capture_len;
+    }
+    memcpy(mock_capture + mock_capture_len, data, len);
+    mock_capture_len += len;
+    mock_capture[mock_capture_len] = '\0';
+}
+
+void mock_reset(void)
+{
+    mock_capture_len = 0;
+    mock_capture[0] = '\0';
+    mock_calls = 0;
+}
+
+void mock_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    mock_append(data, len);
+    mock_calls++;
+}
+
+void mock_log_vec(const serial_log_iovec_t *iov, uint8_t iovcnt, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    for (uint8_t i = 0; i < iovcnt; i++)
+    {
+        mock_append(iov[i].data, iov[i].len);
+    }
+    mock_calls++;
+}
+
+void mock_log_null(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)data;
+    (void)timeout_ms;
+    mock_null_bytes += len;
+}
+
+uint32_t mock_tick(void)
+{
+    return mock_tick_value;
+}
+
+uint64_t mock_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t mock_counter(void)
+{
+    return (uint32_t)mock_time_ns();
+}
+
+static void mock_print(const char *name, const char *data, size_t len)
+{
+    /* Control characters escaped, so color codes and line ends show */
+    printf("  %s: \"", name);
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '\033')
+        {
+            printf("\\e");
+        }
+        else if (c == '\r')
+        {
+            printf("\\r");
+        }
+        else if (c == '\n')
+        {
+            printf("\\n");
+        }
+        else if (c < 0x20 || c >= 0x7F)
+        {
+            printf("\\x%02x", c);
+        }
+        else
+        {
+            putchar(c);
+        }
+    }
+    printf("\"\n");
+}
+
+bool mock_expect(const char *file, int line, const char *expected, size_t len)
+{
+    bool match = (mock_capture_len == len && memcmp(mock_capture, expected, len) == 0);
+    if (!match)
+    {
+        mock_failures++;
+        printf("%s:%d: output differs\n", file, line);
+        mock_print("expected", expected, len);
+        mock_print("got", mock_capture, mock_capture_len);
+    }
+    mock_reset();
+    return match;
+}
@@ -0,0 +1,101 @@
+#ifndef _SERIAL_LOG_MOCK_H_
+#define _SERIAL_LOG_MOCK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "serial_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes kept by the capturing log functions */
+#define MOCK_CAPTURE_SIZE   (1 << 20)
+
+/* Output of mock_log and mock_log_vec since mock_reset, NUL terminated. Log
+   functions are called one at a time per sink, so the capture needs no lock
+   as long as one sink writes to it. */
+extern char mock_capture[MOCK_CAPTURE_SIZE];
+extern size_t mock_capture_len;
+extern uint32_t mock_calls;
+
+/* Tick returned by mock_tick */
+extern uint32_t mock_tick_value;
+
+/* Failed checks, the test exits with their count */
+extern int mock_failures;
+
+/*
+ * @brief   Clear the capture and the call count.
+ *
+ * @param   None.
+ *
+ * @return  None.
+ */
+void mock_reset(void);
+
+/*
+ * @brief   Log function appending to the capture.
+ */
+void mock_log(uint8_t *data, uint16_t len, uint32_t timeout_ms);
+
+/*
+ * @brief   Vectored log function appending to the capture.
+ */
+void mock_log_vec(const serial_log_iovec_t *iov, uint8_t iovcnt, uint32_t timeout_ms);
+
+/*
+ * @brief   Log function which only counts the bytes, for benchmarks.
+ */
+void mock_log_null(uint8_t *data, uint16_t len, uint32_t timeout_ms);
+
+/*
+ * @brief   Tick function returning mock_tick_value.
+ */
+uint32_t mock_tick(void);
+
+/*
+ * @brief   Monotonic time in nanoseconds.
+ */
+uint64_t mock_time_ns(void);
+
+/*
+ * @brief   Counter for serial_log_latency_counter_set, in nanoseconds.
+ */
+uint32_t mock_counter(void);
+
+/*
+ * @brief   Compare the capture with the expected output, print both when they
+ *          differ, then clear it.
+ *
+ * @param   file Source file of the check.
+ * @param   line Source line of the check.
+ * @param   expected Expected output.
+ * @param   len Length of the expected output.
+ *
+ * @return  true if the capture matches, false otherwise.
+ */
+bool mock_expect(const char *file, int line, const char *expected, size_t len);
+
+#define CHECK(cond) do {                                                                \
+        if (!(cond)) {                                                                  \
+            mock_failures++;                                                            \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);             \
+        }                                                                               \
+    } while(0)
+
+/* Compare the capture with a string literal */
+#define CHECK_OUTPUT(expected)  mock_expect(__FILE__, __LINE__, expected, sizeof(expected) - 1)
+
+/* Text record of the usual layout, as serial_log_record outputs it */
+#define MOCK_RECORD(letter, tick, tag, message) \
+    LOG_COLOR_ ## letter #letter " (" #tick ") " tag ": " message LOG_RESET_COLOR "\r\n"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERIAL_LOG_MOCK_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Async build whose drain thread can not be created: sink_add still succeeds
+ * and records are written from the caller, as without USE_LOG_ASYNC,
+ * messages longer than the buffer included.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+#define LONG_SIZE           600
+
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void*), void *arg);
+
+/* Linked with --wrap=pthread_create, every thread of the library fails */
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start)(void*), void *arg)
+{
+    (void)thread;
+    (void)attr;
+    (void)start;
+    (void)arg;
+    return EAGAIN;
+}
+
+int main(void)
+{
+    static char long_text[LONG_SIZE + 1];
+    static char expected[LONG_SIZE + 64];
+    memset(long_text, 'x', LONG_SIZE);
+
+    serial_log_function_set(mock_log, mock_tick);
+    SERIAL_LOGI("async", "direct %d", 1);
+    CHECK_OUTPUT(MOCK_RECORD(I, 0, "async", "direct 1"));
+
+    int len = snprintf(expected, sizeof(expected), MOCK_RECORD(I, 0, "async", "%s"), long_text);
+    SERIAL_LOGI("async", "%s", long_text);
+    mock_expect(__FILE__, __LINE__, expected, len);
+
+    serial_log_sink_t sink = { .log = mock_log, .level = SERIAL_LOG_WARN };
+    int id = serial_log_sink_add(&sink);
+    CHECK(id > 0);
+    SERIAL_LOGW("async", "both");
+    CHECK_OUTPUT(MOCK_RECORD(W, 0, "async", "both")
+                 MOCK_RECORD(W, 0, "async", "both"));
+
+    /* Nothing is queued, flush returns at once */
+    serial_log_flush();
+    CHECK(mock_capture_len == 0);
+    return mock_failures != 0;
+}
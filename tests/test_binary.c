@@ -0,0 +1,61 @@
+/*
+ * Binary records: argument values follow the header raw, strings with a
+ * length byte. A NULL string goes out as "(null)", build with
+ * SERIAL_LOG_SANITIZE to have the copies checked.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Header of a binary record: sync, level, argument length, tick, format and
+   tag addresses */
+#define BINARY_HEADER_SIZE  16
+
+static uint8_t binary_capture[4096];
+static size_t binary_len = 0;
+
+static void binary_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (binary_len + len <= sizeof(binary_capture))
+    {
+        memcpy(binary_capture + binary_len, data, len);
+        binary_len += len;
+    }
+}
+
+static void test_strings(void)
+{
+    /* Not a constant, so the compiler leaves the NULL argument alone */
+    static const char *volatile missing = NULL;
+    static const uint8_t args[] = { 6, '(', 'n', 'u', 'l', 'l', ')', 0, 3, 'a', 'b', 'c', 7, 0, 0, 0 };
+    const char *format = "%s|%s|%s|%d";
+
+    binary_len = 0;
+    mock_tick_value = 42;
+    SERIAL_LOGI("bin", format, missing, "", "abc", 7);
+
+    uint16_t args_len;
+    uint32_t tick, format_addr;
+    memcpy(&args_len, &binary_capture[2], sizeof(args_len));
+    memcpy(&tick, &binary_capture[4], sizeof(tick));
+    memcpy(&format_addr, &binary_capture[8], sizeof(format_addr));
+    CHECK(binary_len == BINARY_HEADER_SIZE + sizeof(args));
+    CHECK(binary_capture[0] == 0xA5);
+    CHECK(binary_capture[1] == SERIAL_LOG_INFO);
+    CHECK(args_len == sizeof(args));
+    CHECK(tick == 42);
+    CHECK(format_addr == (uint32_t)(uintptr_t)format);
+    CHECK(memcmp(binary_capture + BINARY_HEADER_SIZE, args, sizeof(args)) == 0);
+}
+
+int main(void)
+{
+    serial_log_sink_t binary = { .log = binary_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_BINARY };
+    serial_log_function_set(NULL, mock_tick);
+    CHECK(serial_log_sink_add(&binary) >= 0);
+
+    test_strings();
+    return mock_failures != 0;
+}
@@ -0,0 +1,102 @@
+/*
+ * CBOR records: a map behind the self-describe tag with level, tick, tag,
+ * message and fields. Given a capture and an expected file, writes records
+ * of every level with garbage between them and a cut record at the end, and
+ * the JSON lines tools/serial_log_cbor.py must turn them into.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Self-describe tag 55799 in front of every record */
+static const uint8_t cbor_sync[] = { 0xD9, 0xD9, 0xF7 };
+
+static void test_record(void)
+{
+    /* {0: 3, 1: 42, 2: "app", 3: "x=7"} */
+    static const uint8_t record[] = {
+        0xD9, 0xD9, 0xF7, 0xA4,
+        0x00, 0x03,
+        0x01, 0x18, 0x2A,
+        0x02, 0x63, 'a', 'p', 'p',
+        0x03, 0x63, 'x', '=', '7',
+    };
+    mock_tick_value = 42;
+    SERIAL_LOGI("app", "x=%d", 7);
+    CHECK(mock_capture_len == sizeof(record));
+    CHECK(memcmp(mock_capture, record, sizeof(record)) == 0);
+    mock_reset();
+}
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+static void test_tool(const char *capture_path, const char *expected_path)
+{
+    static char capture[4096];
+    size_t capture_len = 0;
+    static const char garbage[] = "\xD9\xD9 noise \xF7\x00";
+
+    mock_reset();
+    mock_tick_value = 10;
+    SERIAL_LOGE("net", "link down %d", 3);
+    mock_tick_value = 300;
+    SERIAL_LOGW("net.tcp", "retry %u of %s", 2u, "host");
+    memcpy(capture, mock_capture, mock_capture_len);
+    capture_len = mock_capture_len;
+    memcpy(capture + capture_len, garbage, sizeof(garbage) - 1);
+    capture_len += sizeof(garbage) - 1;
+
+    mock_reset();
+    mock_tick_value = 70000;
+    SERIAL_LOGI("sensor", "temp %.1f \xC2\xB0" "C", 21.5);
+    mock_tick_value = 0x12345678;
+    SERIAL_LOGD("app", "100%% done");
+    SERIAL_LOGV("app", "");
+    SERIAL_LOGI_KV("wifi", "connected", serial_log_field_str("ssid", "lab"), serial_log_field_int("rssi", -70));
+    memcpy(capture + capture_len, mock_capture, mock_capture_len);
+    capture_len += mock_capture_len;
+
+    /* Cut short, the tool skips it */
+    mock_reset();
+    SERIAL_LOGE("app", "cut");
+    memcpy(capture + capture_len, mock_capture, mock_capture_len - 3);
+    capture_len += mock_capture_len - 3;
+    CHECK(memcmp(mock_capture, cbor_sync, sizeof(cbor_sync)) == 0);
+    CHECK(write_file(capture_path, capture, capture_len));
+
+    static const char expected[] =
+        "{\"level\": \"E\", \"tick\": 10, \"tag\": \"net\", \"message\": \"link down 3\"}\n"
+        "{\"level\": \"W\", \"tick\": 300, \"tag\": \"net.tcp\", \"message\": \"retry 2 of host\"}\n"
+        "{\"level\": \"I\", \"tick\": 70000, \"tag\": \"sensor\", \"message\": \"temp 21.5 \xC2\xB0" "C\"}\n"
+        "{\"level\": \"D\", \"tick\": 305419896, \"tag\": \"app\", \"message\": \"100% done\"}\n"
+        "{\"level\": \"V\", \"tick\": 305419896, \"tag\": \"app\", \"message\": \"\"}\n"
+        "{\"level\": \"I\", \"tick\": 305419896, \"tag\": \"wifi\", \"message\": \"connected\", "
+        "\"fields\": {\"ssid\": \"lab\", \"rssi\": -70}}\n";
+    CHECK(write_file(expected_path, expected, sizeof(expected) - 1));
+    mock_reset();
+}
+
+int main(int argc, char **argv)
+{
+    serial_log_sink_t cbor = { .log = mock_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_CBOR };
+    serial_log_function_set(NULL, mock_tick);
+    CHECK(serial_log_sink_add(&cbor) >= 0);
+
+    test_record();
+    if (argc == 3)
+    {
+        test_tool(argv[1], argv[2]);
+    }
+    return mock_failures != 0;
+}
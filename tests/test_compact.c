@@ -0,0 +1,156 @@
+/*
+ * Compact records with LOG_COMPACT_DELTA: the differences to the record
+ * stamped before, with every LOG_COMPACT_RESYNC-th record stamped with the
+ * time. Given a capture and an expected file, writes a capture with one
+ * record left out, and what tools/serial_log_compact.py must turn it into:
+ * the times are off from the record left out to the next stamped with the
+ * time, and right from there on.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Records of the capture for the tool, and the one left out of it */
+#define TOOL_RECORDS        (3 * LOG_COMPACT_RESYNC)
+#define TOOL_DROPPED        (LOG_COMPACT_RESYNC + 1)
+
+static char warn_capture[4096];
+static size_t warn_len = 0;
+
+static void warn_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (warn_len + len < sizeof(warn_capture))
+    {
+        memcpy(warn_capture + warn_len, data, len);
+        warn_len += len;
+        warn_capture[warn_len] = '\0';
+    }
+}
+
+static void test_stamps(void)
+{
+    /* The first record takes the time, the difference to 0 */
+    static const uint32_t ticks[] = { 10, 15, 30, 31, 50, 52 };
+    for (size_t i = 0; i < sizeof(ticks) / sizeof(ticks[0]); i++)
+    {
+        mock_tick_value = ticks[i];
+        if (i == 2)
+        {
+            SERIAL_LOGW("cmp", "r%d", (int)i);
+        }
+        else
+        {
+            SERIAL_LOGI("cmp", "r%d", (int)i);
+        }
+    }
+    CHECK_OUTPUT("I a cmp: r0\n"
+                 "I +5 cmp: r1\n"
+                 "W +f cmp: r2\n"
+                 "I +1 cmp: r3\n"
+                 "I 32 cmp: r4\n"
+                 "I +2 cmp: r5\n");
+    /* The filtering sink gets the difference over all records */
+    CHECK(strcmp(warn_capture, "W +f cmp: r2\n") == 0);
+}
+
+static void test_resync(void)
+{
+    /* Records stamped with the time come every LOG_COMPACT_RESYNC records,
+       whichever sink they go to */
+    int records = 0;
+    int absolute = 0;
+    for (int i = 0; i < 4 * LOG_COMPACT_RESYNC; i++)
+    {
+        mock_tick_value += 3;
+        SERIAL_LOGI("cmp", "n%d", i);
+    }
+    for (const char *line = mock_capture; *line; line = strchr(line, '\n') + 1)
+    {
+        records++;
+        absolute += line[2] != '+';
+    }
+    CHECK(records == 4 * LOG_COMPACT_RESYNC);
+    CHECK(absolute == 4);
+    mock_reset();
+}
+
+static bool write_file(const char *path, const char *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+static void test_tool(const char *capture_path, const char *expected_path)
+{
+    static char capture[TOOL_RECORDS * 32];
+    static char expected[TOOL_RECORDS * 64];
+    size_t capture_len = 0;
+    size_t expected_len = 0;
+    uint32_t time[TOOL_RECORDS];
+
+    /* Start on a record stamped with the time */
+    do {
+        mock_reset();
+        mock_tick_value++;
+        SERIAL_LOGI("cmp", "t%d", 0);
+    } while (mock_capture[2] == '+');
+    time[0] = mock_tick_value;
+    for (int i = 1; i < TOOL_RECORDS; i++)
+    {
+        mock_tick_value += 1 + i % 5;
+        time[i] = mock_tick_value;
+        SERIAL_LOGI("cmp", "t%d", i);
+    }
+
+    uint32_t shift = 0;
+    const char *line = mock_capture;
+    for (int i = 0; i < TOOL_RECORDS; i++)
+    {
+        const char *next = strchr(line, '\n') + 1;
+        if (line[2] != '+')
+        {
+            shift = 0;
+        }
+        if (i == TOOL_DROPPED)
+        {
+            CHECK(line[2] == '+');
+            shift = (uint32_t)strtoul(line + 3, NULL, 16);
+        }
+        else
+        {
+            memcpy(capture + capture_len, line, next - line);
+            capture_len += next - line;
+            expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                                     LOG_COLOR_I "I (%u) cmp: t%d" LOG_RESET_COLOR "\r\n",
+                                     (unsigned)(time[i] - shift), i);
+        }
+        line = next;
+    }
+    CHECK(write_file(capture_path, capture, capture_len));
+    CHECK(write_file(expected_path, expected, expected_len));
+    mock_reset();
+}
+
+int main(int argc, char **argv)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_sink_t warn = { .log = warn_log, .level = SERIAL_LOG_WARN };
+    CHECK(serial_log_sink_add(&warn) >= 0);
+
+    test_stamps();
+    test_resync();
+    if (argc == 3)
+    {
+        test_tool(argv[1], argv[2]);
+    }
+    return mock_failures != 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Compressed sink next to a plain one: the compressed stream is smaller and,
+ * given a capture and an expected file, is written out with the plain
+ * output, which tools/serial_log_decompress.py must turn it back into. The
+ * records run over several history resets.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+#define RECORDS             400
+#define LONG_SIZE           600
+
+static uint8_t compressed[1 << 16];
+static size_t compressed_len = 0;
+
+static void compressed_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (compressed_len + len <= sizeof(compressed))
+    {
+        memcpy(compressed + compressed_len, data, len);
+        compressed_len += len;
+    }
+}
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+int main(int argc, char **argv)
+{
+    static char long_text[LONG_SIZE + 1];
+    for (int i = 0; i < LONG_SIZE; i++)
+    {
+        long_text[i] = (char)('a' + i * 7 % 26);
+    }
+
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_sink_t sink = { .log = compressed_log, .level = SERIAL_LOG_VERBOSE, .compress = true };
+    CHECK(serial_log_sink_add(&sink) > 0);
+
+    for (int i = 0; i < RECORDS; i++)
+    {
+        mock_tick_value = 1000 + i * 13;
+        if (i % 100 == 50)
+        {
+            SERIAL_LOGW("zip", "long %d %s", i, long_text);
+        }
+        else
+        {
+            SERIAL_LOGI(i % 3 ? "zip.rx" : "zip.tx", "packet %d: %u bytes from 10.0.%d.%d", i,
+                        (unsigned)(i * 37 % 1500), i % 7, i % 251);
+        }
+    }
+    serial_log_flush();
+
+    CHECK(mock_capture_len > 4 * 4096);
+    CHECK(compressed_len > 0 && compressed_len < mock_capture_len);
+    if (argc == 3)
+    {
+        CHECK(write_file(argv[1], compressed, compressed_len));
+        CHECK(write_file(argv[2], mock_capture, mock_capture_len));
+    }
+    return mock_failures != 0;
+}
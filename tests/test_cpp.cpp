@@ -0,0 +1,142 @@
+/*
+ * C++ front-end of serial_log.hpp. A record written through SERIAL_LOGx_CPP,
+ * with a string tag or a serial_log::tag, comes out the same as the one of
+ * the C macros, in text and in binary. Records above SERIAL_LOG_CPP_LEVEL are
+ * not compiled in.
+ */
+
+#include <cstring>
+
+/* DEBUG and VERBOSE records of the C++ macros generate no code */
+#define SERIAL_LOG_CPP_LEVEL    SERIAL_LOG_INFO
+
+#include "serial_log.hpp"
+#include "serial_log_mock.h"
+
+/* Header of a binary record: sync, level, argument length, tick, format and
+   tag addresses */
+#define BINARY_HEADER_SIZE  16
+#define BINARY_FORMAT_ADDR  8
+#define BINARY_TAG_ADDR     12
+
+static uint8_t binary_capture[4096];
+static size_t binary_len = 0;
+
+static void binary_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (binary_len + len <= sizeof(binary_capture))
+    {
+        memcpy(binary_capture + binary_len, data, len);
+        binary_len += len;
+    }
+}
+
+struct capture {
+    char text[256];
+    uint8_t binary[256];
+    size_t binary_len;
+};
+
+static void take(capture &c)
+{
+    size_t len = (mock_capture_len < sizeof(c.text)) ? mock_capture_len : sizeof(c.text) - 1;
+    memcpy(c.text, mock_capture, len);
+    c.text[len] = '\0';
+    memcpy(c.binary, binary_capture, binary_len);
+    c.binary_len = binary_len;
+    mock_reset();
+    binary_len = 0;
+}
+
+static void compare(const char *file, int line, const capture &c, const capture &cpp)
+{
+    /* The formats are different strings, and so may be the tags */
+    bool same = strcmp(c.text, cpp.text) == 0 && c.text[0] != '\0' &&
+                c.binary_len == cpp.binary_len && c.binary_len >= BINARY_HEADER_SIZE &&
+                memcmp(c.binary, cpp.binary, BINARY_FORMAT_ADDR) == 0 &&
+                memcmp(c.binary + BINARY_HEADER_SIZE, cpp.binary + BINARY_HEADER_SIZE,
+                       c.binary_len - BINARY_HEADER_SIZE) == 0;
+    if (!same)
+    {
+        mock_failures++;
+        printf("%s:%d: C++ record differs\n  C: %s  C++: %s", file, line, c.text, cpp.text);
+    }
+}
+
+#define COMPARE(c_record, cpp_record) do {                                              \
+        capture c, cpp;                                                                 \
+        c_record;                                                                       \
+        take(c);                                                                        \
+        cpp_record;                                                                     \
+        take(cpp);                                                                      \
+        compare(__FILE__, __LINE__, c, cpp);                                            \
+    } while(0)
+
+SERIAL_LOG_TAG_DEFINE(net_desc, "net");
+static serial_log::tag net_tag("net");
+
+static void test_string_tag()
+{
+    const char *host = "example.org";
+    long long total = -123456789012LL;
+    size_t size = 4096;
+    unsigned char flags = 0xa5;
+
+    mock_tick_value = 10;
+    COMPARE(SERIAL_LOGE("app", "code %d at %s", -3, host),
+            SERIAL_LOGE_CPP("app", "code %d at %s", -3, host));
+    COMPARE(SERIAL_LOGW("app", "%lld total, %zu bytes, flags %02x", total, size, flags),
+            SERIAL_LOGW_CPP("app", "%lld total, %zu bytes, flags %02x", total, size, flags));
+    COMPARE(SERIAL_LOGI("app", "%5.2f%% of %u", 99.5, 7u),
+            SERIAL_LOGI_CPP("app", "%5.2f%% of %u", 99.5, 7u));
+    COMPARE(SERIAL_LOGI("app", "no arguments"),
+            SERIAL_LOGI_CPP("app", "no arguments"));
+}
+
+static void test_descriptor()
+{
+    mock_tick_value = 20;
+    COMPARE(SERIAL_LOGW_TAG(&net_desc, "retry %d of %s", 2, "host"),
+            SERIAL_LOGW_CPP(net_tag, "retry %d of %s", 2, "host"));
+
+    /* Both pick up the level of the tag */
+    serial_log_level_set("net", SERIAL_LOG_ERROR);
+    SERIAL_LOGW_TAG(&net_desc, "retry %d", 3);
+    SERIAL_LOGW_CPP(net_tag, "retry %d", 3);
+    CHECK(mock_capture_len == 0 && binary_len == 0);
+    COMPARE(SERIAL_LOGE_TAG(&net_desc, "down"),
+            SERIAL_LOGE_CPP(net_tag, "down"));
+    serial_log_level_set("net", SERIAL_LOG_VERBOSE);
+}
+
+static void test_compiled_out()
+{
+    /* Let through at run time, the C macro writes the record and the C++
+       ones have none to write */
+    int evaluated = 0;
+    SERIAL_LOGD("app", "debug %d", ++evaluated);
+    CHECK(mock_capture_len > 0 && binary_len > 0);
+    mock_reset();
+    binary_len = 0;
+
+    SERIAL_LOGD_CPP("app", "debug %d", evaluated);
+    SERIAL_LOGV_CPP(net_tag, "verbose %d", evaluated);
+    CHECK(mock_capture_len == 0 && binary_len == 0);
+}
+
+int main()
+{
+    serial_log_sink_t binary = {};
+    binary.log = binary_log;
+    binary.level = SERIAL_LOG_VERBOSE;
+    binary.format = SERIAL_LOG_FORMAT_BINARY;
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+    CHECK(serial_log_sink_add(&binary) >= 0);
+
+    test_string_tag();
+    test_descriptor();
+    test_compiled_out();
+    return mock_failures != 0;
+}
@@ -0,0 +1,14 @@
+/*
+ * Must not build: a long for %d is wider than the conversion reads. The
+ * cpp_format_error test passes when the compiler rejects it with the message
+ * of serial_log.hpp.
+ */
+
+#include "serial_log.hpp"
+
+int main()
+{
+    long value = 1;
+    SERIAL_LOGI_CPP("app", "%d", value);
+    return 0;
+}
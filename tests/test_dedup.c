@@ -0,0 +1,91 @@
+/*
+ * Duplicate suppression: the count of suppressed records is output at their
+ * level and tag, when the call site logs again after the window, when another
+ * call site takes its entry, and from serial_log_flush and serial_log_process.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Entry of a format, as the library maps it */
+#define DEDUP_SLOTS         16
+#define DEDUP_SLOT(format)  ((((uintptr_t)(format) >> 2) ^ ((uintptr_t)(format) >> 7)) & (DEDUP_SLOTS - 1))
+
+static const char formats[64][8] = {
+    "f00", "f01", "f02", "f03", "f04", "f05", "f06", "f07", "f08", "f09", "f10", "f11", "f12", "f13", "f14", "f15",
+    "f16", "f17", "f18", "f19", "f20", "f21", "f22", "f23", "f24", "f25", "f26", "f27", "f28", "f29", "f30", "f31",
+    "f32", "f33", "f34", "f35", "f36", "f37", "f38", "f39", "f40", "f41", "f42", "f43", "f44", "f45", "f46", "f47",
+    "f48", "f49", "f50", "f51", "f52", "f53", "f54", "f55", "f56", "f57", "f58", "f59", "f60", "f61", "f62", "f63",
+};
+
+static void log_repeated(int times)
+{
+    for (int i = 0; i < times; i++)
+    {
+        SERIAL_LOGW("net", "link down");
+    }
+}
+
+static void test_window(void)
+{
+    mock_tick_value = 1000;
+    log_repeated(3);
+    CHECK_OUTPUT(MOCK_RECORD(W, 1000, "net", "link down"));
+    mock_tick_value = 1200;
+    log_repeated(1);
+    CHECK_OUTPUT(MOCK_RECORD(W, 1200, "net", "last message repeated 2 times")
+                 MOCK_RECORD(W, 1200, "net", "link down"));
+}
+
+static void test_collision(void)
+{
+    /* Two formats sharing an entry */
+    int first = 0, second = 1;
+    while (DEDUP_SLOT(formats[second]) != DEDUP_SLOT(formats[first]))
+    {
+        second++;
+    }
+
+    mock_tick_value = 2000;
+    for (int i = 0; i < 3; i++)
+    {
+        serial_log_record(SERIAL_LOG_ERROR, "disk", formats[first]);
+    }
+    serial_log_record(SERIAL_LOG_INFO, "app", formats[second]);
+
+    char expected[256];
+    snprintf(expected, sizeof(expected), "%s%s%s",
+             MOCK_RECORD(E, 2000, "disk", "f00"), MOCK_RECORD(E, 2000, "disk", "last message repeated 2 times"),
+             LOG_COLOR_I "I (2000) app: ");
+    CHECK(strncmp(mock_capture, expected, strlen(expected)) == 0);
+    CHECK(strstr(mock_capture, formats[second]) != NULL);
+    mock_reset();
+}
+
+static void test_flush(void)
+{
+    mock_tick_value = 3000;
+    log_repeated(4);
+    CHECK_OUTPUT(MOCK_RECORD(W, 3000, "net", "link down"));
+    serial_log_flush();
+    CHECK_OUTPUT(MOCK_RECORD(W, 3000, "net", "last message repeated 3 times"));
+    serial_log_flush();
+    CHECK_OUTPUT("");
+
+    /* Still in the window, the count starts again */
+    log_repeated(2);
+    CHECK_OUTPUT("");
+    serial_log_process();
+    CHECK_OUTPUT(MOCK_RECORD(W, 3000, "net", "last message repeated 2 times"));
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_dedup_set(100);
+    test_window();
+    test_collision();
+    test_flush();
+    return mock_failures != 0;
+}
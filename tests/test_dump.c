@@ -0,0 +1,76 @@
+/*
+ * Buffer dumps to text, binary and CBOR sinks. Full lines fill the line
+ * buffer of the binary and CBOR records, build with SERIAL_LOG_SANITIZE to
+ * have its bounds checked.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+static char binary_capture[4096];
+static size_t binary_len = 0;
+static char cbor_capture[4096];
+static size_t cbor_len = 0;
+
+static void binary_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (binary_len + len <= sizeof(binary_capture))
+    {
+        memcpy(binary_capture + binary_len, data, len);
+        binary_len += len;
+    }
+}
+
+static void cbor_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (cbor_len + len <= sizeof(cbor_capture))
+    {
+        memcpy(cbor_capture + cbor_len, data, len);
+        cbor_len += len;
+    }
+}
+
+static bool contains(const char *capture, size_t len, const char *line)
+{
+    return memmem(capture, len, line, strlen(line)) != NULL;
+}
+
+int main(void)
+{
+    char buffer[20];
+    for (int i = 0; i < (int)sizeof(buffer); i++)
+    {
+        buffer[i] = (char)('A' + i);
+    }
+
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_sink_t binary = { .log = binary_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_BINARY };
+    serial_log_sink_t cbor = { .log = cbor_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_CBOR };
+    CHECK(serial_log_sink_add(&binary) >= 0);
+    CHECK(serial_log_sink_add(&cbor) >= 0);
+
+    /* One full line and one short line */
+    SERIAL_LOG_BUFFER_HEX("dump", buffer, sizeof(buffer));
+    const char *full = "0000  41 42 43 44 45 46 47 48 49 4a 4b 4c 4d 4e 4f 50  |ABCDEFGHIJKLMNOP|";
+    const char *part = "0010  51 52 53 54                                      |QRST|";
+    CHECK_OUTPUT(MOCK_RECORD(I, 0, "dump", "0000  41 42 43 44 45 46 47 48 49 4a 4b 4c 4d 4e 4f 50  |ABCDEFGHIJKLMNOP|")
+                 MOCK_RECORD(I, 0, "dump", "0010  51 52 53 54                                      |QRST|"));
+    CHECK(contains(binary_capture, binary_len, full));
+    CHECK(contains(binary_capture, binary_len, part));
+    CHECK(contains(cbor_capture, cbor_len, full));
+    CHECK(contains(cbor_capture, cbor_len, part));
+
+    binary_len = 0;
+    cbor_len = 0;
+    SERIAL_LOG_BUFFER_CHAR("dump", buffer, 16);
+    CHECK_OUTPUT(MOCK_RECORD(I, 0, "dump", "0000  ABCDEFGHIJKLMNOP"));
+    CHECK(contains(binary_capture, binary_len, "0000  ABCDEFGHIJKLMNOP"));
+    CHECK(contains(cbor_capture, cbor_len, "0000  ABCDEFGHIJKLMNOP"));
+
+    return mock_failures != 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Built-in formatter against the libc vsnprintf, through serial_log_write so
+ * the format is the whole record. Built with and without LOG_FORMATTER_FLOAT.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Same format and arguments through snprintf and the library */
+#define CONFORM(...) do {                                                               \
+        char expected_[256];                                                            \
+        snprintf(expected_, sizeof(expected_), __VA_ARGS__);                            \
+        serial_log_write(SERIAL_LOG_INFO, "fmt", __VA_ARGS__);                          \
+        mock_expect(__FILE__, __LINE__, expected_, strlen(expected_));                  \
+    } while(0)
+
+static void test_integers(void)
+{
+    CONFORM("%d %i %d %d", 0, 42, -42, INT32_MIN);
+    CONFORM("%5d|%-5d|%05d|%+d|% d|%+d", 42, 42, -42, 42, 42, -7);
+    CONFORM("%.3d|%.0d|%8.3d|%-8.3d|%08d", 7, 0, -7, 7, -7);
+    CONFORM("%u %x %X %o", 4000000000u, 0xbeefu, 0xbeefu, 8u);
+    CONFORM("%hd %hhd %hu %hhu", 70000, 300, 70000, 300);
+    CONFORM("%ld %lu %lld %llu", -5L, 5UL, -9000000000LL, 18000000000ULL);
+    CONFORM("%zu %zd %jd %td", (size_t)12, (ptrdiff_t)-3, (intmax_t)-4, (ptrdiff_t)5);
+    CONFORM("%*d|%-*d|%.*d", 6, 1, 6, 2, 4, 3);
+    CONFORM("%llx %llX", 0x123456789abcdefULL, 0xfedcba987654321ULL);
+}
+
+static void test_alternate(void)
+{
+    CONFORM("%#x %#X %#x", 0xffu, 0xffu, 0u);
+    CONFORM("%#o %#o %#.0o %#.3o", 8u, 0u, 0u, 8u);
+    CONFORM("%#08x|%#-8x|%#8X|%#.4x", 0xffu, 0xffu, 0xffu, 0xffu);
+    CONFORM("%#llx %#hhx", 0x1234567890ULL, 0x1ffu);
+}
+
+static void test_text(void)
+{
+    int x = 0;
+    CONFORM("%c%c|%3c|%-3c|", 'a', 'b', 'c', 'd');
+    CONFORM("%s|%8s|%-8s|%.2s|%8.2s", "text", "text", "text", "text", "text");
+    CONFORM("%p", (void*)&x);
+    CONFORM("100%% %d%%", 5);
+}
+
+static void test_float(void)
+{
+#ifdef LOG_FORMATTER_FLOAT
+    CONFORM("%f %f %f", 0.0, 1.5, -2.25);
+    CONFORM("%.2f|%.0f|%.0f|%.0f|%.3f", 3.14159, 0.5, 1.5, 2.5, 1e-4);
+    CONFORM("%8.3f|%-8.1f|%+f|% f|%08.2f", 3.14159, 2.5, 1.0, 1.0, -3.5);
+    CONFORM("%#.0f %#.0f", 3.0, 0.0);
+    CONFORM("%Lf %.2Lf %d", (long double)1.25, (long double)-7.125, 9);
+    CONFORM("%F %d", 123456.789, 1);
+    CONFORM("%.9f|%.9f", 999999999999999999.0, -123456789012345678.0);
+
+    /* Integer parts past 64 bits, up to 128 */
+    CONFORM("%f|%.0f|%f", 1e19, 1e19, 1e20);
+    CONFORM("%.2f|%+.1f|%30.0f|%-30.0f|", 18446744073709551616.0, -1e25, 1e21, 1e21);
+    CONFORM("%f %.0f", 1e38, 3.4028236692093846e38 * (1 - DBL_EPSILON));
+    CONFORM("%f %f %f %F %F", INFINITY, -INFINITY, NAN, INFINITY, NAN);
+    CONFORM("%6f|%-6f|%+f|%06f|", INFINITY, NAN, INFINITY, -INFINITY);
+
+    /* Past them, output as is with the argument taken */
+    serial_log_write(SERIAL_LOG_INFO, "fmt", "%f %F %d", 1e39, -DBL_MAX, 7);
+    CHECK_OUTPUT("%f %F 7");
+#else
+    /* Not formatted, but the argument is taken so the next ones line up */
+    serial_log_write(SERIAL_LOG_INFO, "fmt", "%f %d", 1.5, 7);
+    CHECK_OUTPUT("%f 7");
+#endif
+    /* Only %f is formatted, the rest go out as is and keep the arguments in step */
+    serial_log_write(SERIAL_LOG_INFO, "fmt", "%e %g %a %E %G %A %d", 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7);
+    CHECK_OUTPUT("%e %g %a %E %G %A 7");
+    serial_log_write(SERIAL_LOG_INFO, "fmt", "%Le %s", (long double)1.0, "next");
+    CHECK_OUTPUT("%e next");
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    test_integers();
+    test_alternate();
+    test_text();
+    test_float();
+    return mock_failures != 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Capture for tools/serial_log_index.py: records of several tags and levels
+ * over more than one index block, with damaged bytes between some records and
+ * the line end of others lost. Given a capture and an expected file, writes
+ * both, the expected one with the records a query for net.* at W and above
+ * from 20000 to 45000 must print.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+#define RECORDS             6000
+#define QUERY_SINCE         20000
+#define QUERY_UNTIL         45000
+
+static const char *const tags[] = { "net.rx", "net.tx", "app", "netx" };
+static const char letters[] = "EWIDV";
+
+static char capture[MOCK_CAPTURE_SIZE];
+static char expected[MOCK_CAPTURE_SIZE];
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+int main(int argc, char **argv)
+{
+    size_t capture_len = 0;
+    size_t expected_len = 0;
+    const char *line = mock_capture;
+
+    serial_log_function_set(mock_log, mock_tick);
+    for (int i = 0; i < RECORDS; i++)
+    {
+        serial_log_level_t level = (serial_log_level_t)(SERIAL_LOG_ERROR + i % 5);
+        const char *tag = tags[i % 4];
+        mock_tick_value = 10 * i;
+        SERIAL_LOG_LEVEL(level, tag, "m%d", i);
+
+        /* The capture takes the record, after damaged bytes now and then,
+           and without its line end now and then */
+        const char *next = strstr(line, "\r\n") + 2;
+        size_t len = next - line;
+        if (i % 97 == 13)
+        {
+            memcpy(capture + capture_len, "\xfe\x00\xfe", 3);
+            capture_len += 3;
+        }
+        if (i % 89 == 7)
+        {
+            len -= 2;
+        }
+        memcpy(capture + capture_len, line, len);
+        capture_len += len;
+        line = next;
+
+        if (fnmatch("net.*", tag, 0) == 0 && level <= SERIAL_LOG_WARN &&
+            mock_tick_value >= QUERY_SINCE && mock_tick_value <= QUERY_UNTIL)
+        {
+            expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                                     "%c (%u) %s: m%d\n", letters[level - SERIAL_LOG_ERROR],
+                                     (unsigned)mock_tick_value, tag, i);
+        }
+    }
+    CHECK(line == mock_capture + mock_capture_len);
+    CHECK(expected_len > 0);
+
+    if (argc == 3)
+    {
+        CHECK(write_file(argv[1], capture, capture_len));
+        CHECK(write_file(argv[2], expected, expected_len));
+    }
+    return mock_failures != 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Overflow policies of an async sink. Built without a drain thread, the ring
+ * is only written out by serial_log_process, so the test fills it at will: a
+ * burst of VERBOSE records, then ERROR and WARN ones. Each policy keeps the
+ * records it should, and the notice of the records dropped comes out where
+ * they are missing.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Ring slots, and the last of them only ERROR and WARN take under
+   SERIAL_LOG_OVERFLOW_PRIORITY, as configured in serial_log.c */
+#define RING_SIZE           16
+#define RING_RESERVE        4
+
+static char expected[16384];
+static size_t expected_len = 0;
+
+static void expect(const char *color, char letter, const char *tag, const char *message, int value)
+{
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             "%s%c (0) %s: ", color, letter, tag);
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len, message, value);
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             LOG_RESET_COLOR "\r\n");
+}
+
+static void expect_notice(int dropped)
+{
+    expect(LOG_COLOR_W, 'W', "serial_log", "%d records dropped", dropped);
+}
+
+static void start(serial_log_overflow_t overflow)
+{
+    serial_log_process();
+    serial_log_sink_overflow_set(0, overflow, 0);
+    serial_log_stats_reset();
+    mock_reset();
+    expected_len = 0;
+}
+
+static void burst(int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        SERIAL_LOGV("burst", "v%d", i);
+    }
+}
+
+static void test_drop_newest(void)
+{
+    /* The full ring keeps the burst, the urgent records are dropped */
+    serial_log_stats_t stats;
+    start(SERIAL_LOG_OVERFLOW_DROP_NEWEST);
+    burst(0, RING_SIZE);
+    SERIAL_LOGE("alarm", "e%d", 0);
+    SERIAL_LOGW("alarm", "w%d", 0);
+    serial_log_process();
+    SERIAL_LOGI("after", "i%d", 0);
+    serial_log_process();
+
+    for (int i = 0; i < RING_SIZE; i++)
+    {
+        expect(LOG_COLOR_V, 'V', "burst", "v%d", i);
+    }
+    expect_notice(2);
+    expect(LOG_COLOR_I, 'I', "after", "i%d", 0);
+    mock_expect(__FILE__, __LINE__, expected, expected_len);
+    serial_log_stats_get(&stats);
+    CHECK(stats.dropped[SERIAL_LOG_ERROR] == 1 && stats.dropped[SERIAL_LOG_WARN] == 1);
+    CHECK(stats.dropped[SERIAL_LOG_VERBOSE] == 0);
+}
+
+static void test_drop_oldest(void)
+{
+    /* Each record into the full ring evicts the oldest, whatever its level */
+    serial_log_stats_t stats;
+    start(SERIAL_LOG_OVERFLOW_DROP_OLDEST);
+    burst(0, RING_SIZE);
+    SERIAL_LOGE("alarm", "e%d", 0);
+    SERIAL_LOGW("alarm", "w%d", 0);
+    serial_log_process();
+
+    for (int i = 2; i < RING_SIZE; i++)
+    {
+        expect(LOG_COLOR_V, 'V', "burst", "v%d", i);
+    }
+    expect_notice(1);
+    expect(LOG_COLOR_E, 'E', "alarm", "e%d", 0);
+    expect_notice(1);
+    expect(LOG_COLOR_W, 'W', "alarm", "w%d", 0);
+    mock_expect(__FILE__, __LINE__, expected, expected_len);
+    serial_log_stats_get(&stats);
+    CHECK(stats.dropped[SERIAL_LOG_VERBOSE] == 2);
+    CHECK(stats.dropped[SERIAL_LOG_ERROR] == 0 && stats.dropped[SERIAL_LOG_WARN] == 0);
+}
+
+static void test_priority(void)
+{
+    /* The burst stops short of the reserved slots, urgent records take them
+       and then evict the oldest VERBOSE records. A full ring of urgent
+       records drops the next one. */
+    serial_log_stats_t stats;
+    const int urgent = RING_RESERVE + 2;
+    start(SERIAL_LOG_OVERFLOW_PRIORITY);
+    burst(0, RING_SIZE);
+    for (int i = 0; i < urgent; i++)
+    {
+        SERIAL_LOGE("alarm", "e%d", i);
+    }
+    burst(RING_SIZE, RING_SIZE + 1);
+    serial_log_process();
+
+    for (int i = 2; i < RING_SIZE - RING_RESERVE; i++)
+    {
+        expect(LOG_COLOR_V, 'V', "burst", "v%d", i);
+    }
+    expect_notice(RING_RESERVE);
+    for (int i = 0; i < urgent; i++)
+    {
+        if (i >= RING_RESERVE)
+        {
+            expect_notice(1);
+        }
+        expect(LOG_COLOR_E, 'E', "alarm", "e%d", i);
+    }
+    expect_notice(1);
+    mock_expect(__FILE__, __LINE__, expected, expected_len);
+    serial_log_stats_get(&stats);
+    CHECK(stats.dropped[SERIAL_LOG_VERBOSE] == RING_RESERVE + 2 + 1);
+    CHECK(stats.dropped[SERIAL_LOG_ERROR] == 0);
+
+    /* With only urgent records queued, the next urgent one is dropped */
+    start(SERIAL_LOG_OVERFLOW_PRIORITY);
+    for (int i = 0; i <= RING_SIZE; i++)
+    {
+        SERIAL_LOGW("alarm", "w%d", i);
+    }
+    serial_log_process();
+    serial_log_stats_get(&stats);
+    CHECK(stats.dropped[SERIAL_LOG_WARN] == 1);
+    CHECK(strstr(mock_capture, "alarm: w15" LOG_RESET_COLOR) != NULL);
+    CHECK(strstr(mock_capture, "alarm: w16" LOG_RESET_COLOR) == NULL);
+    CHECK(strstr(mock_capture, "serial_log: 1 records dropped") != NULL);
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+
+    test_drop_newest();
+    test_drop_oldest();
+    test_priority();
+    return mock_failures != 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Payloads: binary sinks get frames with the bytes as they are, text sinks
+ * base64 records with a CRC-32 per line. Given a capture, an expected file
+ * and a directory, writes a capture of both kinds for
+ * tools/serial_log_payload.py, with one payload of each kind corrupted, the
+ * tool output expected and the payload files it must extract.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+/* Frame header: sync, level, tag length, reserved, id, chunk length, offset,
+   total and tick */
+#define FRAME_HEADER_SIZE   20
+#define FRAME_CRC_SIZE      4
+
+static uint8_t binary_capture[16384];
+static size_t binary_len = 0;
+static int binary_sink = -1;
+static uint16_t payload_ids = 0;
+
+static void binary_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)timeout_ms;
+    if (binary_len + len <= sizeof(binary_capture))
+    {
+        memcpy(binary_capture + binary_len, data, len);
+        binary_len += len;
+    }
+}
+
+static uint16_t payload(const char *tag, const uint8_t *data, uint32_t len)
+{
+    /* Ids count up from 0 per payload */
+    serial_log_payload(SERIAL_LOG_INFO, tag, data, len);
+    return payload_ids++;
+}
+
+static void fill(uint8_t *data, uint32_t len, uint32_t seed)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+static const uint8_t *frame_at(size_t offset, uint16_t *chunk_len, uint32_t *chunk_offset, size_t *frame_len)
+{
+    const uint8_t *frame = binary_capture + offset;
+    memcpy(chunk_len, frame + 6, sizeof(*chunk_len));
+    memcpy(chunk_offset, frame + 8, sizeof(*chunk_offset));
+    *frame_len = FRAME_HEADER_SIZE + frame[2] + *chunk_len + FRAME_CRC_SIZE;
+    return frame;
+}
+
+static void test_frames(void)
+{
+    /* Frames carry consecutive chunks of the payload */
+    static uint8_t data[1000];
+    static uint8_t joined[sizeof(data)];
+    fill(data, sizeof(data), 1);
+    serial_log_sink_level_set(0, SERIAL_LOG_NONE);
+    uint16_t id = payload("fw", data, sizeof(data));
+    serial_log_sink_level_set(0, SERIAL_LOG_VERBOSE);
+
+    size_t offset = 0;
+    uint32_t joined_len = 0;
+    int frames = 0;
+    while (offset < binary_len)
+    {
+        uint16_t chunk_len;
+        uint32_t chunk_offset;
+        uint16_t frame_id;
+        size_t frame_len;
+        const uint8_t *frame = frame_at(offset, &chunk_len, &chunk_offset, &frame_len);
+        memcpy(&frame_id, frame + 4, sizeof(frame_id));
+        CHECK(frame[0] == 0xA6 && frame[1] == SERIAL_LOG_INFO && frame[2] == 2);
+        CHECK(frame_id == id && chunk_offset == joined_len);
+        CHECK(memcmp(frame + FRAME_HEADER_SIZE, "fw", 2) == 0);
+        if (chunk_offset + chunk_len <= sizeof(joined))
+        {
+            memcpy(joined + chunk_offset, frame + FRAME_HEADER_SIZE + 2, chunk_len);
+        }
+        joined_len += chunk_len;
+        offset += frame_len;
+        frames++;
+    }
+    CHECK(frames > 1 && offset == binary_len);
+    CHECK(joined_len == sizeof(data) && memcmp(joined, data, sizeof(data)) == 0);
+    CHECK_OUTPUT("");
+    binary_len = 0;
+}
+
+static void test_text(void)
+{
+    /* "@id offset/total crc base64", the CRC-32 of "abc" is 352441c2 */
+    mock_tick_value = 5;
+    serial_log_sink_level_set(binary_sink, SERIAL_LOG_NONE);
+    uint16_t id = payload("cfg", (const uint8_t *)"abc", 3);
+    serial_log_sink_level_set(binary_sink, SERIAL_LOG_VERBOSE);
+
+    char expected[64];
+    int len = snprintf(expected, sizeof(expected), MOCK_RECORD(I, 5, "cfg", "@%u 0/3 352441c2 YWJj"), (unsigned)id);
+    mock_expect(__FILE__, __LINE__, expected, len);
+    CHECK(binary_len == 0);
+}
+
+static bool write_file(const char *path, const void *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    bool written = fwrite(data, 1, len, f) == len;
+    return fclose(f) == 0 && written;
+}
+
+static void test_tool(const char *capture_path, const char *expected_path, const char *files)
+{
+    static uint8_t fw[1000], bad[700], cfg[300], bad_text[300];
+    static char capture[sizeof(binary_capture) + MOCK_CAPTURE_SIZE / 16];
+    char expected[1024];
+    char path[256];
+    size_t expected_len = 0;
+    fill(fw, sizeof(fw), 2);
+    fill(bad, sizeof(bad), 3);
+    fill(cfg, sizeof(cfg), 4);
+    fill(bad_text, sizeof(bad_text), 5);
+
+    /* Frames to the binary sink, the second frame of "bad" corrupted */
+    mock_reset();
+    binary_len = 0;
+    serial_log_sink_level_set(0, SERIAL_LOG_NONE);
+    uint16_t fw_id = payload("fw", fw, sizeof(fw));
+    size_t bad_start = binary_len;
+    uint16_t bad_id = payload("bad", bad, sizeof(bad));
+    serial_log_sink_level_set(0, SERIAL_LOG_VERBOSE);
+
+    uint16_t chunk_len, bad_len;
+    uint32_t chunk_offset;
+    size_t frame_len;
+    frame_at(bad_start, &chunk_len, &chunk_offset, &frame_len);
+    size_t second = bad_start + frame_len;
+    frame_at(second, &bad_len, &chunk_offset, &frame_len);
+    binary_capture[second + FRAME_HEADER_SIZE + strlen("bad") + bad_len / 2] ^= 0x01;
+
+    /* Base64 records to the text sink, a character of the second line of
+       "bad_text" changed */
+    mock_tick_value = 100;
+    serial_log_sink_level_set(binary_sink, SERIAL_LOG_NONE);
+    uint16_t cfg_id = payload("cfg", cfg, sizeof(cfg));
+    uint16_t bad_text_id = payload("bad_text", bad_text, sizeof(bad_text));
+    serial_log_sink_level_set(binary_sink, SERIAL_LOG_VERBOSE);
+
+    char line[32];
+    snprintf(line, sizeof(line), "@%u ", (unsigned)bad_text_id);
+    char *first = strstr(mock_capture, line);
+    char *second_line = first ? strstr(first + 1, line) : NULL;
+    uint32_t bad_text_len = 0;
+    CHECK(second_line != NULL);
+    if (second_line)
+    {
+        /* Past "@id offset/total crc ", the bytes of the line from the
+           length of its base64 */
+        char *text = strchr(strchr(strchr(second_line, ' ') + 1, ' ') + 1, ' ') + 1;
+        size_t text_len = strspn(text, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=");
+        bad_text_len = text_len / 4 * 3 - (text[text_len - 1] == '=') - (text[text_len - 2] == '=');
+        *text = (*text == 'A') ? 'B' : 'A';
+    }
+
+    memcpy(capture, binary_capture, binary_len);
+    memcpy(capture + binary_len, mock_capture, mock_capture_len);
+    CHECK(write_file(capture_path, capture, binary_len + mock_capture_len));
+
+    /* Frames are read before text records. The corrupted payloads miss the
+       chunk which failed its CRC. */
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             "I fw #%u: %u bytes -> %s/fw-%u.bin\n",
+                             (unsigned)fw_id, (unsigned)sizeof(fw), files, (unsigned)fw_id);
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             "I bad #%u: %u of %u bytes, incomplete\n",
+                             (unsigned)bad_id, (unsigned)(sizeof(bad) - bad_len), (unsigned)sizeof(bad));
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             "I cfg #%u: %u bytes -> %s/cfg-%u.bin\n",
+                             (unsigned)cfg_id, (unsigned)sizeof(cfg), files, (unsigned)cfg_id);
+    expected_len += snprintf(expected + expected_len, sizeof(expected) - expected_len,
+                             "I bad_text #%u: %u of %u bytes, incomplete\n"
+                             "1 text chunks failed their CRC\n",
+                             (unsigned)bad_text_id, (unsigned)(sizeof(bad_text) - bad_text_len),
+                             (unsigned)sizeof(bad_text));
+    CHECK(write_file(expected_path, expected, expected_len));
+
+    snprintf(path, sizeof(path), "%s.expected/fw-%u.bin", files, (unsigned)fw_id);
+    CHECK(write_file(path, fw, sizeof(fw)));
+    snprintf(path, sizeof(path), "%s.expected/cfg-%u.bin", files, (unsigned)cfg_id);
+    CHECK(write_file(path, cfg, sizeof(cfg)));
+    mock_reset();
+    binary_len = 0;
+}
+
+int main(int argc, char **argv)
+{
+    serial_log_sink_t binary = { .log = binary_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_BINARY };
+    serial_log_function_set(mock_log, mock_tick);
+    binary_sink = serial_log_sink_add(&binary);
+    CHECK(binary_sink >= 0);
+
+    test_frames();
+    test_text();
+    if (argc == 4)
+    {
+        test_tool(argv[1], argv[2], argv[3]);
+    }
+    return mock_failures != 0;
+}
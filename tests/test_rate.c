@@ -0,0 +1,78 @@
+/*
+ * Rate limit of a tag: a token bucket of burst records, refilled at rate
+ * records per second of mock ticks in milliseconds and capped at the burst.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+static int log_records(const char *tag, int count)
+{
+    /* Records of count calls that were output */
+    mock_reset();
+    for (int i = 0; i < count; i++)
+    {
+        SERIAL_LOGI(tag, "r%d", i);
+    }
+    int records = 0;
+    for (const char *line = mock_capture; (line = strstr(line, "\r\n")) != NULL; line += 2)
+    {
+        records++;
+    }
+    return records;
+}
+
+static void test_burst(void)
+{
+    /* The bucket starts full, other tags are not limited */
+    mock_tick_value = 1000;
+    serial_log_rate_set("rate", 10, 3);
+    CHECK(log_records("rate", 5) == 3);
+    CHECK(log_records("rate", 1) == 0);
+    CHECK(log_records("other", 5) == 5);
+    CHECK_OUTPUT(MOCK_RECORD(I, 1000, "other", "r0") MOCK_RECORD(I, 1000, "other", "r1")
+                 MOCK_RECORD(I, 1000, "other", "r2") MOCK_RECORD(I, 1000, "other", "r3")
+                 MOCK_RECORD(I, 1000, "other", "r4"));
+}
+
+static void test_refill(void)
+{
+    /* 10 records per second is one per 100 ticks, fractions add up */
+    mock_tick_value += 100;
+    CHECK(log_records("rate", 3) == 1);
+    mock_tick_value += 50;
+    CHECK(log_records("rate", 1) == 0);
+    mock_tick_value += 50;
+    CHECK(log_records("rate", 1) == 1);
+    mock_tick_value += 250;
+    CHECK(log_records("rate", 3) == 2);
+    CHECK(log_records("rate", 1) == 0);
+}
+
+static void test_cap(void)
+{
+    /* A quiet period refills up to the burst, across the tick wrap too */
+    mock_tick_value += 60000;
+    CHECK(log_records("rate", 10) == 3);
+    mock_tick_value = 0xFFFFFFF0u;
+    serial_log_rate_set("wrap", 10, 2);
+    CHECK(log_records("wrap", 3) == 2);
+    mock_tick_value += 0x200;
+    CHECK(log_records("wrap", 3) == 2);
+
+    /* Rate 0 removes the limit */
+    serial_log_rate_set("rate", 0, 0);
+    CHECK(log_records("rate", 10) == 10);
+    mock_reset();
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+
+    test_burst();
+    test_refill();
+    test_cap();
+    return mock_failures != 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Text records through the default sink: layout, level and tag filters, and
+ * arguments left unevaluated when a record is filtered.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+static int evaluated = 0;
+
+static int count_evaluation(void)
+{
+    return ++evaluated;
+}
+
+static void test_layout(void)
+{
+    mock_tick_value = 7;
+    SERIAL_LOGE("app", "error %d", -5);
+    CHECK_OUTPUT(MOCK_RECORD(E, 7, "app", "error -5"));
+    SERIAL_LOGW("app", "warn %s", "x");
+    CHECK_OUTPUT(MOCK_RECORD(W, 7, "app", "warn x"));
+    SERIAL_LOGI("net", "%u bytes from %x", 64u, 0xbeefu);
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "net", "64 bytes from beef"));
+    SERIAL_LOGD("app", "%5d|%-3s|%c", 42, "ab", 'q');
+    CHECK_OUTPUT(MOCK_RECORD(D, 7, "app", "   42|ab |q"));
+    SERIAL_LOGV("app", "verbose");
+    CHECK_OUTPUT(MOCK_RECORD(V, 7, "app", "verbose"));
+
+    /* serial_log_write takes the whole layout from the caller */
+    serial_log_write(SERIAL_LOG_INFO, "raw", LOG_FORMAT(I, "raw %d"), 7, "raw", 3);
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "raw", "raw 3"));
+}
+
+static void test_levels(void)
+{
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    SERIAL_LOGD("app", "hidden");
+    SERIAL_LOGI("app", "shown");
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "app", "shown"));
+
+    /* A tag level wins over the default, in both directions */
+    serial_log_level_set("net", SERIAL_LOG_VERBOSE);
+    serial_log_level_set("app", SERIAL_LOG_ERROR);
+    SERIAL_LOGV("net", "net verbose");
+    SERIAL_LOGW("app", "app warn");
+    SERIAL_LOGE("app", "app error");
+    CHECK_OUTPUT(MOCK_RECORD(V, 7, "net", "net verbose") MOCK_RECORD(E, 7, "app", "app error"));
+
+    /* Tag strings are compared, not their addresses */
+    char tag[] = "net";
+    SERIAL_LOGV(tag, "copy");
+    CHECK_OUTPUT(MOCK_RECORD(V, 7, "net", "copy"));
+
+    /* "*" clears the tag levels */
+    serial_log_level_set("*", SERIAL_LOG_WARN);
+    SERIAL_LOGI("net", "hidden");
+    SERIAL_LOGW("app", "app warn");
+    CHECK_OUTPUT(MOCK_RECORD(W, 7, "app", "app warn"));
+
+    /* Filtered records do not evaluate their arguments */
+    evaluated = 0;
+    SERIAL_LOGI("app", "%d", count_evaluation());
+    CHECK(evaluated == 0);
+    SERIAL_LOGW("app", "%d", count_evaluation());
+    CHECK(evaluated == 1);
+    CHECK_OUTPUT(MOCK_RECORD(W, 7, "app", "1"));
+
+    /* The tag is evaluated once, whether the record is output or not */
+    const char *tags[] = { "app", "app" };
+    int tag_index = 0;
+    SERIAL_LOGW(tags[tag_index++], "tag");
+    CHECK(tag_index == 1);
+    CHECK_OUTPUT(MOCK_RECORD(W, 7, "app", "tag"));
+    tag_index = 0;
+    SERIAL_LOGI(tags[tag_index++], "tag");
+    CHECK(tag_index == 1);
+    CHECK_OUTPUT("");
+
+    serial_log_sink_level_set(0, SERIAL_LOG_ERROR);
+    SERIAL_LOGW("app", "%d", count_evaluation());
+    CHECK(evaluated == 1);
+    CHECK_OUTPUT("");
+    serial_log_sink_level_set(0, SERIAL_LOG_VERBOSE);
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+}
+
+static void test_vectored(void)
+{
+    /* Same bytes through the vectored log function, one call per record */
+    serial_log_function_vec_set(mock_log_vec, mock_tick);
+    SERIAL_LOGI("vec", "%s %d", "value", 12);
+    CHECK(mock_calls == 1);
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "vec", "value 12"));
+    serial_log_function_set(mock_log, mock_tick);
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    test_layout();
+    test_levels();
+    test_vectored();
+    return mock_failures != 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Flight recorder in a mapped file: a child process logs into it until it is
+ * killed, then the records are read back from the file. They are whole, in
+ * order and without gaps up to the last one the child got to.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "serial_log_mock.h"
+
+#define RECORDER_SIZE       8192
+
+/* Records the child logs before it reports, it is killed some time after */
+#define RECORDS_REPORTED    1000
+
+static void log_child(const char *path, int report)
+{
+    void *mem = serial_log_recorder_map(path, RECORDER_SIZE);
+    if (!mem || serial_log_recorder_start(mem, RECORDER_SIZE, SERIAL_LOG_VERBOSE, SERIAL_LOG_FORMAT_TEXT) < 0)
+    {
+        _exit(1);
+    }
+    for (uint32_t i = 0;; i++)
+    {
+        SERIAL_LOGI("rec", "record %u", (unsigned)i);
+        if (i == RECORDS_REPORTED)
+        {
+            uint32_t logged = i + 1;
+            if (write(report, &logged, sizeof(logged)) != sizeof(logged))
+            {
+                _exit(1);
+            }
+        }
+    }
+}
+
+static void check_records(uint32_t logged)
+{
+    const char *prefix = LOG_COLOR_I "I (0) rec: record ";
+    const char *line = mock_capture;
+    const char *end = mock_capture + mock_capture_len;
+    uint32_t first = 0, count = 0;
+
+    while (line < end)
+    {
+        char expected[64];
+        unsigned index;
+        const char *eol = strstr(line, "\r\n");
+        if (!eol || strncmp(line, prefix, strlen(prefix)) != 0 ||
+            sscanf(line + strlen(prefix), "%u", &index) != 1)
+        {
+            printf("damaged record at offset %ld\n", (long)(line - mock_capture));
+            mock_failures++;
+            return;
+        }
+        int len = snprintf(expected, sizeof(expected), "%s%u" LOG_RESET_COLOR, prefix, index);
+        if (eol - line != len || memcmp(line, expected, len) != 0)
+        {
+            printf("record %u is not whole\n", index);
+            mock_failures++;
+            return;
+        }
+        if (count == 0)
+        {
+            first = index;
+        }
+        else if (index != first + count)
+        {
+            printf("record %u after %u\n", index, first + count - 1);
+            mock_failures++;
+            return;
+        }
+        count++;
+        line = eol + 2;
+    }
+    /* The recorder keeps the newest records that fit */
+    CHECK(count > RECORDER_SIZE / 64);
+    CHECK(first + count >= logged);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/serial_log_recorder_XXXXXX";
+    int fd = mkstemp(path);
+    int report[2];
+    CHECK(fd >= 0);
+    CHECK(pipe(report) == 0);
+    close(fd);
+
+    serial_log_function_set(NULL, mock_tick);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(report[0]);
+        log_child(path, report[1]);
+    }
+    close(report[1]);
+
+    uint32_t logged = 0;
+    CHECK(child > 0);
+    CHECK(read(report[0], &logged, sizeof(logged)) == sizeof(logged));
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    void *mem = serial_log_recorder_map(path, RECORDER_SIZE);
+    CHECK(mem != NULL);
+    if (mem)
+    {
+        CHECK(serial_log_recorder_dump(mem, RECORDER_SIZE, mock_log));
+        check_records(logged);
+    }
+    unlink(path);
+    return mock_failures != 0;
+}
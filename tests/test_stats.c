@@ -0,0 +1,61 @@
+/*
+ * Statistics counters. A record counts once in emitted, whatever the number
+ * of sinks and formats it goes to.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+static void null_log(uint8_t *data, uint16_t len, uint32_t timeout_ms)
+{
+    (void)data;
+    (void)len;
+    (void)timeout_ms;
+}
+
+static uint32_t emitted(serial_log_level_t level)
+{
+    serial_log_stats_t stats;
+    serial_log_stats_get(&stats);
+    serial_log_stats_reset();
+    return stats.emitted[level];
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    serial_log_sink_t binary = { .log = null_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_BINARY };
+    serial_log_sink_t cbor = { .log = null_log, .level = SERIAL_LOG_VERBOSE, .format = SERIAL_LOG_FORMAT_CBOR };
+    CHECK(serial_log_sink_add(&binary) >= 0);
+    CHECK(serial_log_sink_add(&cbor) >= 0);
+    serial_log_stats_reset();
+
+    SERIAL_LOGI("stats", "value %d", 1);
+    CHECK(emitted(SERIAL_LOG_INFO) == 1);
+
+    SERIAL_LOGW_KV("stats", "kv", serial_log_field_int("n", 2));
+    CHECK(emitted(SERIAL_LOG_WARN) == 1);
+
+    char buffer[40];
+    memset(buffer, 'x', sizeof(buffer));
+    SERIAL_LOG_BUFFER_HEX("stats", buffer, sizeof(buffer));
+    CHECK(emitted(SERIAL_LOG_INFO) == 1);
+
+    SERIAL_LOG_PAYLOAD("stats", buffer, sizeof(buffer));
+    CHECK(emitted(SERIAL_LOG_INFO) == 1);
+
+    serial_log_write(SERIAL_LOG_ERROR, "stats", LOG_FORMAT(E, "%d"), 0, "stats", 3);
+    CHECK(emitted(SERIAL_LOG_ERROR) == 1);
+
+    serial_log_write_binary(SERIAL_LOG_DEBUG, "stats", "%d", 4);
+    CHECK(emitted(SERIAL_LOG_DEBUG) == 1);
+
+    /* Filtered records are not emitted */
+    serial_log_level_set("stats", SERIAL_LOG_ERROR);
+    SERIAL_LOGI("stats", "hidden");
+    serial_log_stats_t stats;
+    serial_log_stats_get(&stats);
+    CHECK(stats.emitted[SERIAL_LOG_INFO] == 0);
+    return mock_failures != 0;
+}
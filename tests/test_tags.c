@@ -0,0 +1,172 @@
+/*
+ * Tag levels set with patterns: the most specific pattern wins, the latest
+ * added wins a tie, "*" clears them, and levels already cached for a tag or
+ * held by a descriptor follow a pattern set afterwards. Tag descriptors stay
+ * unresolved until their first use, then filter as the tag string does.
+ */
+
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+SERIAL_LOG_TAG_DEFINE(io_tag, "net.tcp.io");
+SERIAL_LOG_TAG_DEFINE(drv_tag, "drv");
+
+static void test_specific(void)
+{
+    /* The exact tag, then the pattern with the most literal characters, then
+       the default level */
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    serial_log_level_set("net.*", SERIAL_LOG_WARN);
+    serial_log_level_set("net.tcp.*", SERIAL_LOG_DEBUG);
+    serial_log_level_set("net.tcp.rx", SERIAL_LOG_ERROR);
+
+    SERIAL_LOGI("net.udp", "hidden");
+    SERIAL_LOGW("net.udp", "udp");
+    SERIAL_LOGV("net.tcp.tx", "hidden");
+    SERIAL_LOGD("net.tcp.tx", "tx");
+    SERIAL_LOGW("net.tcp.rx", "hidden");
+    SERIAL_LOGE("net.tcp.rx", "rx");
+    SERIAL_LOGD("network", "hidden");
+    SERIAL_LOGI("network", "default");
+    CHECK_OUTPUT(MOCK_RECORD(W, 7, "net.udp", "udp")
+                 MOCK_RECORD(D, 7, "net.tcp.tx", "tx")
+                 MOCK_RECORD(E, 7, "net.tcp.rx", "rx")
+                 MOCK_RECORD(I, 7, "network", "default"));
+
+    /* '?' takes one character and '*' any, inside the pattern as well */
+    serial_log_level_set("a?c*x*z", SERIAL_LOG_VERBOSE);
+    SERIAL_LOGV("abcxz", "match");
+    SERIAL_LOGV("abc--x--z", "match");
+    SERIAL_LOGV("ac-x-z", "hidden");
+    SERIAL_LOGV("abc-z-x", "hidden");
+    CHECK_OUTPUT(MOCK_RECORD(V, 7, "abcxz", "match")
+                 MOCK_RECORD(V, 7, "abc--x--z", "match"));
+}
+
+static void test_tie(void)
+{
+    /* Same number of literal characters, the pattern added last wins */
+    serial_log_level_set("t?.x", SERIAL_LOG_ERROR);
+    SERIAL_LOGW("tb.x", "hidden");
+    serial_log_level_set("?b.x", SERIAL_LOG_VERBOSE);
+    SERIAL_LOGV("tb.x", "later");
+    SERIAL_LOGW("tc.x", "hidden");
+    CHECK_OUTPUT(MOCK_RECORD(V, 7, "tb.x", "later"));
+}
+
+static void test_reset(void)
+{
+    /* "*" clears the patterns along with the tag levels */
+    serial_log_level_set("*", SERIAL_LOG_DEBUG);
+    SERIAL_LOGD("net.udp", "udp");
+    SERIAL_LOGD("net.tcp.rx", "rx");
+    SERIAL_LOGV("net.tcp.tx", "hidden");
+    SERIAL_LOGV("tb.x", "hidden");
+    CHECK_OUTPUT(MOCK_RECORD(D, 7, "net.udp", "udp")
+                 MOCK_RECORD(D, 7, "net.tcp.rx", "rx"));
+
+    /* A cleared pattern set again takes effect again */
+    serial_log_level_set("net.*", SERIAL_LOG_ERROR);
+    SERIAL_LOGW("net.udp", "hidden");
+    SERIAL_LOGE("net.udp", "udp");
+    CHECK_OUTPUT(MOCK_RECORD(E, 7, "net.udp", "udp"));
+}
+
+static void test_cached(void)
+{
+    /* The level of a tag logged before is cached, a pattern set afterwards
+       invalidates it */
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    SERIAL_LOGD("cache.a", "hidden");
+    SERIAL_LOGI("cache.a", "cached");
+    serial_log_level_set("cache.*", SERIAL_LOG_VERBOSE);
+    SERIAL_LOGV("cache.a", "resolved");
+    serial_log_level_set("cache.?", SERIAL_LOG_WARN);
+    SERIAL_LOGI("cache.a", "hidden");
+    SERIAL_LOGW("cache.a", "more specific");
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "cache.a", "cached")
+                 MOCK_RECORD(V, 7, "cache.a", "resolved")
+                 MOCK_RECORD(W, 7, "cache.a", "more specific"));
+}
+
+static void test_descriptor_patterns(void)
+{
+    /* A registered descriptor is matched again on every pattern set */
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    SERIAL_LOGI_TAG(&io_tag, "default");
+    CHECK(io_tag.level == SERIAL_LOG_INFO);
+
+    serial_log_level_set("net.*", SERIAL_LOG_VERBOSE);
+    CHECK(io_tag.level == SERIAL_LOG_VERBOSE);
+    serial_log_level_set("net.tcp.*", SERIAL_LOG_WARN);
+    CHECK(io_tag.level == SERIAL_LOG_WARN);
+    SERIAL_LOGI_TAG(&io_tag, "hidden");
+    SERIAL_LOGW_TAG(&io_tag, "pattern");
+
+    /* The exact tag still wins over a pattern set after it */
+    serial_log_level_set("net.tcp.io", SERIAL_LOG_ERROR);
+    serial_log_level_set("net.tcp.i?", SERIAL_LOG_VERBOSE);
+    CHECK(io_tag.level == SERIAL_LOG_ERROR);
+
+    serial_log_level_set("*", SERIAL_LOG_DEBUG);
+    CHECK(io_tag.level == SERIAL_LOG_DEBUG);
+    CHECK_OUTPUT(MOCK_RECORD(I, 7, "net.tcp.io", "default")
+                 MOCK_RECORD(W, 7, "net.tcp.io", "pattern"));
+}
+
+static void test_descriptor(void)
+{
+    /* Not registered until its first use, a level set before does not
+       touch it */
+    serial_log_level_set("*", SERIAL_LOG_INFO);
+    serial_log_level_set("drv", SERIAL_LOG_ERROR);
+    CHECK(drv_tag.level == SERIAL_LOG_TAG_UNRESOLVED);
+    SERIAL_LOGW_TAG(&drv_tag, "hidden");
+    CHECK(drv_tag.level == SERIAL_LOG_ERROR);
+    CHECK_OUTPUT("");
+
+    /* Levels set afterwards are picked up, the tag's own and the default */
+    serial_log_level_set("drv", SERIAL_LOG_DEBUG);
+    CHECK(drv_tag.level == SERIAL_LOG_DEBUG);
+    serial_log_level_set("*", SERIAL_LOG_WARN);
+    CHECK(drv_tag.level == SERIAL_LOG_WARN);
+
+    /* Same records as through the tag string, whatever the levels */
+    static const serial_log_level_t levels[] = { SERIAL_LOG_NONE, SERIAL_LOG_ERROR, SERIAL_LOG_INFO, SERIAL_LOG_VERBOSE };
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+    {
+        char string_output[1024];
+        size_t string_len;
+        serial_log_level_set("drv", levels[i]);
+        SERIAL_LOGE("drv", "e%d", (int)i);
+        SERIAL_LOGW("drv", "w%d", (int)i);
+        SERIAL_LOGI("drv", "i%d", (int)i);
+        SERIAL_LOGD("drv", "d%d", (int)i);
+        SERIAL_LOGV("drv", "v%d", (int)i);
+        string_len = mock_capture_len < sizeof(string_output) ? mock_capture_len : sizeof(string_output);
+        memcpy(string_output, mock_capture, string_len);
+        mock_reset();
+        SERIAL_LOGE_TAG(&drv_tag, "e%d", (int)i);
+        SERIAL_LOGW_TAG(&drv_tag, "w%d", (int)i);
+        SERIAL_LOGI_TAG(&drv_tag, "i%d", (int)i);
+        SERIAL_LOGD_TAG(&drv_tag, "d%d", (int)i);
+        SERIAL_LOGV_TAG(&drv_tag, "v%d", (int)i);
+        mock_expect(__FILE__, __LINE__, string_output, string_len);
+    }
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+}
+
+int main(void)
+{
+    serial_log_function_set(mock_log, mock_tick);
+    mock_tick_value = 7;
+
+    test_specific();
+    test_tie();
+    test_reset();
+    test_cached();
+    test_descriptor_patterns();
+    test_descriptor();
+    return mock_failures != 0;
+}
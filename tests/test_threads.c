@@ -0,0 +1,233 @@
+/*
+ * Records from several threads at once, with long messages among them, come
+ * out whole: every line is one record as it was logged, and the records of
+ * each thread are all there and in order. Then the same while another thread
+ * keeps changing the level of the tags: every record still comes out whole,
+ * in order, and at a level its tag had at some point. Built with and without
+ * USE_LOG_ASYNC.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial_log_mock.h"
+
+#define THREADS             4
+#define RECORDS             1000
+
+/* Every LONG_EVERY-th record has a message longer than the record buffer */
+#define LONG_EVERY          50
+#define LONG_SIZE           600
+
+/* Tags whose level flips between FLIP_LOW and FLIP_HIGH while threads log
+   at every level */
+#define FLIP_TAGS           4
+#define FLIP_LOW            SERIAL_LOG_WARN
+#define FLIP_HIGH           SERIAL_LOG_DEBUG
+
+static char long_text[LONG_SIZE + 1];
+static const char *const flip_tags[FLIP_TAGS] = { "flip0", "flip1", "flip2", "flip3" };
+static bool flip_stop = false;
+
+static void *log_thread(void *arg)
+{
+    int thread = (int)(intptr_t)arg;
+    for (int i = 0; i < RECORDS; i++)
+    {
+        if (i % LONG_EVERY == 0)
+        {
+            SERIAL_LOGI("thr", "t%d r%d %s", thread, i, long_text);
+        }
+        else
+        {
+            SERIAL_LOGI("thr", "t%d r%d", thread, i);
+        }
+    }
+    return NULL;
+}
+
+static void check_capture(void)
+{
+    int next[THREADS] = { 0 };
+    char expected[LONG_SIZE + 64];
+    const char *line = mock_capture;
+    const char *end = mock_capture + mock_capture_len;
+    const char *prefix = LOG_COLOR_I "I (0) thr: t";
+
+    while (line < end)
+    {
+        const char *eol = strstr(line, "\r\n");
+        int thread, index;
+        if (!eol || strncmp(line, prefix, strlen(prefix)) != 0 ||
+            sscanf(line + strlen(prefix), "%d r%d", &thread, &index) != 2 ||
+            thread < 0 || thread >= THREADS)
+        {
+            printf("damaged record at offset %ld\n", (long)(line - mock_capture));
+            mock_failures++;
+            return;
+        }
+        int len;
+        if (index % LONG_EVERY == 0)
+        {
+            len = snprintf(expected, sizeof(expected), "%st%d r%d %s" LOG_RESET_COLOR, LOG_COLOR_I "I (0) thr: ",
+                           thread, index, long_text);
+        }
+        else
+        {
+            len = snprintf(expected, sizeof(expected), "%st%d r%d" LOG_RESET_COLOR, LOG_COLOR_I "I (0) thr: ",
+                           thread, index);
+        }
+        if (eol - line != len || memcmp(line, expected, len) != 0)
+        {
+            printf("record t%d r%d is not whole\n", thread, index);
+            mock_failures++;
+            return;
+        }
+        if (index != next[thread])
+        {
+            printf("thread %d: record %d after %d\n", thread, index, next[thread] - 1);
+            mock_failures++;
+            return;
+        }
+        next[thread]++;
+        line = eol + 2;
+    }
+    for (int t = 0; t < THREADS; t++)
+    {
+        CHECK(next[t] == RECORDS);
+    }
+}
+
+static void *flip_log_thread(void *arg)
+{
+    int thread = (int)(intptr_t)arg;
+    for (int i = 0; i < RECORDS; i++)
+    {
+        serial_log_level_t level = (serial_log_level_t)(SERIAL_LOG_ERROR + i % 5);
+        SERIAL_LOG_LEVEL(level, flip_tags[i % FLIP_TAGS], "t%d r%d", thread, i);
+    }
+    return NULL;
+}
+
+static void *flip_level_thread(void *arg)
+{
+    (void)arg;
+    for (uint32_t n = 0; !__atomic_load_n(&flip_stop, __ATOMIC_ACQUIRE); n++)
+    {
+        serial_log_level_set(flip_tags[n % FLIP_TAGS], (n / FLIP_TAGS) % 2 ? FLIP_HIGH : FLIP_LOW);
+    }
+    return NULL;
+}
+
+static void check_flip_capture(void)
+{
+    static const char letters[] = "EWIDV";
+    static const char *const colors[] = { LOG_COLOR_E, LOG_COLOR_W, LOG_COLOR_I, LOG_COLOR_D, LOG_COLOR_V };
+    int last[THREADS];
+    char expected[128];
+    const char *line = mock_capture;
+    const char *end = mock_capture + mock_capture_len;
+    uint32_t records = 0;
+
+    for (int t = 0; t < THREADS; t++)
+    {
+        last[t] = -1;
+    }
+    while (line < end)
+    {
+        const char *eol = strstr(line, "\r\n");
+        const char *head = eol ? strstr(line, ": t") : NULL;
+        int thread, index;
+        if (!head || head > eol || sscanf(head, ": t%d r%d", &thread, &index) != 2 ||
+            thread < 0 || thread >= THREADS || index < 0 || index >= RECORDS)
+        {
+            printf("damaged record at offset %ld\n", (long)(line - mock_capture));
+            mock_failures++;
+            return;
+        }
+        /* The level and tag the record was logged with */
+        int level = index % 5;
+        int len = snprintf(expected, sizeof(expected), "%s%c (0) %s: t%d r%d" LOG_RESET_COLOR,
+                           colors[level], letters[level], flip_tags[index % FLIP_TAGS], thread, index);
+        if (eol - line != len || memcmp(line, expected, len) != 0)
+        {
+            printf("record t%d r%d is not whole\n", thread, index);
+            mock_failures++;
+            return;
+        }
+        if (SERIAL_LOG_ERROR + level > FLIP_HIGH)
+        {
+            printf("record t%d r%d above every level its tag had\n", thread, index);
+            mock_failures++;
+            return;
+        }
+        if (index <= last[thread])
+        {
+            printf("thread %d: record %d after %d\n", thread, index, last[thread]);
+            mock_failures++;
+            return;
+        }
+        last[thread] = index;
+        records++;
+        line = eol + 2;
+    }
+    /* E and W records pass at either level */
+    CHECK(records >= THREADS * RECORDS * 2 / 5);
+}
+
+static void test_level_flip(void)
+{
+    pthread_t threads[THREADS];
+    pthread_t flipper;
+    for (int t = 0; t < FLIP_TAGS; t++)
+    {
+        serial_log_level_set(flip_tags[t], FLIP_LOW);
+    }
+    mock_reset();
+
+    pthread_create(&flipper, NULL, flip_level_thread, NULL);
+    for (int t = 0; t < THREADS; t++)
+    {
+        pthread_create(&threads[t], NULL, flip_log_thread, (void*)(intptr_t)t);
+    }
+    for (int t = 0; t < THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    __atomic_store_n(&flip_stop, true, __ATOMIC_RELEASE);
+    pthread_join(flipper, NULL);
+    serial_log_flush();
+
+    check_flip_capture();
+}
+
+int main(void)
+{
+    pthread_t threads[THREADS];
+    memset(long_text, 'x', LONG_SIZE);
+    for (int i = 0; i < LONG_SIZE; i += 50)
+    {
+        long_text[i] = (char)('a' + i / 50);
+    }
+
+    serial_log_function_set(mock_log, mock_tick);
+    /* Producers wait for room instead of dropping when the queue is full */
+    serial_log_sink_overflow_set(0, SERIAL_LOG_OVERFLOW_BLOCK, 1000);
+
+    for (int t = 0; t < THREADS; t++)
+    {
+        pthread_create(&threads[t], NULL, log_thread, (void*)(intptr_t)t);
+    }
+    for (int t = 0; t < THREADS; t++)
+    {
+        pthread_join(threads[t], NULL);
+    }
+    serial_log_flush();
+
+    check_capture();
+    test_level_flip();
+    return mock_failures != 0;
+}
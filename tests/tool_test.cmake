@@ -0,0 +1,65 @@
+# Round trip through a tool of tools/: PROGRAM writes a capture and the output
+# expected from the tool, then TOOL runs on the capture and its output is
+# compared with the expected. Run with cmake -P and
+#   -DPROGRAM=<test program> -DPYTHON=<python3> -DTOOL=<tools/*.py>
+#   -DTOOL_ARGS=<arguments, @CAPTURE@ stands for the capture> -DNAME=<file prefix>
+#   -DTOOL_RESULT=<exit code expected from the tool, 0 by default>
+# A tool writing files gets @FILES@, a directory. PROGRAM is then given the
+# directory as a third argument and writes the files expected in it to the
+# directory with ".expected" appended, they are compared byte for byte.
+
+set(capture ${NAME}.capture)
+set(expected ${NAME}.expected)
+set(output ${NAME}.output)
+set(files ${NAME}.files)
+if(NOT DEFINED TOOL_RESULT)
+    set(TOOL_RESULT 0)
+endif()
+
+# Files of the last run, an index the tool kept next to the capture included
+file(GLOB stale ${NAME}.*)
+if(stale)
+    file(REMOVE_RECURSE ${stale})
+endif()
+
+string(FIND "${TOOL_ARGS}" "@FILES@" uses_files)
+if(uses_files EQUAL -1)
+    set(program_args ${capture} ${expected})
+else()
+    set(program_args ${capture} ${expected} ${files})
+    file(MAKE_DIRECTORY ${files}.expected)
+endif()
+
+execute_process(COMMAND ${PROGRAM} ${program_args} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} failed: ${result}")
+endif()
+
+string(REPLACE "@CAPTURE@" ${capture} args "${TOOL_ARGS}")
+string(REPLACE "@FILES@" ${files} args "${args}")
+execute_process(COMMAND ${PYTHON} ${TOOL} ${args} OUTPUT_FILE ${output} RESULT_VARIABLE result)
+if(NOT result EQUAL TOOL_RESULT)
+    message(FATAL_ERROR "${TOOL} exited with ${result}, expected ${TOOL_RESULT}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${output} ${expected} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${output} differs from ${expected}")
+endif()
+
+if(NOT uses_files EQUAL -1)
+    file(GLOB written RELATIVE ${CMAKE_CURRENT_BINARY_DIR}/${files} ${files}/*)
+    file(GLOB wanted RELATIVE ${CMAKE_CURRENT_BINARY_DIR}/${files}.expected ${files}.expected/*)
+    list(SORT written)
+    list(SORT wanted)
+    if(NOT written STREQUAL wanted)
+        message(FATAL_ERROR "${TOOL} wrote \"${written}\", expected \"${wanted}\"")
+    endif()
+    foreach(file ${wanted})
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${files}/${file} ${files}.expected/${file}
+                        RESULT_VARIABLE result)
+        if(NOT result EQUAL 0)
+            message(FATAL_ERROR "${files}/${file} differs from ${files}.expected/${file}")
+        endif()
+    endforeach()
+endif()
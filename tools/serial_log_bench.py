@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""
+Compare the bytes per record and records per second of the text layouts on a
+bandwidth limited sink.
+
+serial_log.c is built with a small harness once per configuration and run on
+the host. The harness logs a mix of records to a mock UART sink that waits for
+the time its bytes take on the wire at the given baud rate (10 bits a byte),
+so the records per second are those a UART of that rate would carry.
+
+Usage:
+    serial_log_bench.py
+    serial_log_bench.py --baud 115200 --records 500
+    serial_log_bench.py --config="-DUSE_LOG_COMPACT -DLOG_BUF_SIZE=128"
+"""
+
+import argparse
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+CONFIGS = [
+    ("full", ""),
+    ("compact", "-DUSE_LOG_COMPACT"),
+    ("delta", "-DUSE_LOG_COMPACT -DLOG_COMPACT_DELTA"),
+    ("tag-id", "-DUSE_LOG_COMPACT -DLOG_COMPACT_TAG_ID"),
+    ("delta+id", "-DUSE_LOG_COMPACT -DLOG_COMPACT_DELTA -DLOG_COMPACT_TAG_ID"),
+]
+
+HARNESS = r"""
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "serial_log.h"
+
+static double bit_ns;
+static unsigned long long bytes;
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t bench_tick(void)
+{
+    return (uint32_t)(now_ns() / 1000000);
+}
+
+static void bench_uart(uint8_t *data, uint16_t len, uint32_t timeout)
+{
+    unsigned long long end = now_ns() + (unsigned long long)(len * 10 * bit_ns);
+    (void)data;
+    (void)timeout;
+    bytes += len;
+    while (now_ns() < end)
+    {
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int records = atoi(argv[2]);
+    unsigned long long start;
+    double seconds;
+    int i;
+
+    bit_ns = 1e9 / atof(argv[1]);
+    serial_log_function_set(bench_uart, bench_tick);
+    serial_log_level_set("*", SERIAL_LOG_VERBOSE);
+    start = now_ns();
+    for (i = 0; i < records; i++)
+    {
+        switch (i % 5)
+        {
+        case 0:
+            SERIAL_LOGI("net.rx", "packet %d: %u bytes from %s", i, 64u + i % 1400, "10.0.0.17");
+            break;
+        case 1:
+            SERIAL_LOGD("sensor", "temp %d.%d C, hum %d %%", 21 + i % 5, i % 10, 40 + i % 20);
+            break;
+        case 2:
+            SERIAL_LOGW("power", "battery low: %d mV", 3300 - i % 200);
+            break;
+        case 3:
+            SERIAL_LOGV("scheduler", "task %d switched in", i % 16);
+            break;
+        default:
+            SERIAL_LOGE("storage", "write failed at block %d, err %d", i, -5);
+            break;
+        }
+    }
+    seconds = (now_ns() - start) / 1e9;
+    printf("%llu %f\n", bytes, seconds);
+    return 0;
+}
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--cc", default="cc", help="host C compiler, default cc")
+    parser.add_argument("--cflags", default="-O2", help="flags for every configuration, default -O2")
+    parser.add_argument("--config", action="append", help="defines of a configuration to run instead of the built-in list")
+    parser.add_argument("--baud", type=int, default=921600, help="baud rate of the mock UART, default 921600")
+    parser.add_argument("--records", type=int, default=2000, help="records logged per configuration, default 2000")
+    parser.add_argument("--source", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "serial_log.c"),
+                        help="path to serial_log.c")
+    args = parser.parse_args()
+
+    configs = [("#%d" % (i + 1), c) for i, c in enumerate(args.config)] if args.config else CONFIGS
+    source = os.path.abspath(args.source)
+
+    print("%-10s %10s %10s %7s  %s" % ("config", "bytes/rec", "records/s", "ratio", "defines"))
+    failed = False
+    base = None
+    with tempfile.TemporaryDirectory() as tmp:
+        harness = os.path.join(tmp, "bench.c")
+        binary = os.path.join(tmp, "bench")
+        with open(harness, "w") as f:
+            f.write(HARNESS)
+        for name, defines in configs:
+            cmd = [args.cc] + shlex.split(args.cflags) + shlex.split(defines)
+            cmd += ["-I", os.path.dirname(source), "-include", "stdint.h", source, harness, "-o", binary]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if result.returncode:
+                print("%-10s %10s %10s %7s  %s" % (name[:10], "-", "-", "-", defines))
+                sys.stderr.write(result.stderr)
+                failed = True
+                continue
+            out = subprocess.run([binary, str(args.baud), str(args.records)], check=True,
+                                 capture_output=True, text=True).stdout.split()
+            per_record = int(out[0]) / args.records
+            rate = args.records / float(out[1])
+            if base is None:
+                base = per_record
+            print("%-10s %10.1f %10.0f %6.2fx  %s" % (name[:10], per_record, rate, base / per_record, defines))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
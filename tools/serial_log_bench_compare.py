@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""
+Compare the results of bench/serial_log_bench.c side by side: one column of
+nanoseconds per call for each result file, and the ratio of each to the
+first. The files are those of the bench target, of different configurations
+(libc.json against async.json) or of one configuration before and after a
+change.
+
+Usage:
+    serial_log_bench_compare.py build/libc.json build/async.json
+    serial_log_bench_compare.py before/libc.json build/libc.json --case slow_sink_burst
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Name of the results and nanoseconds per call of each case."""
+    with open(path) as f:
+        data = json.load(f)
+    return data["config"], {r["case"]: r["ns_per_op"] for r in data["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("results", nargs="+", help="JSON result files, the first is the baseline")
+    parser.add_argument("--case", action="append", help="compare only this case, may be repeated")
+    args = parser.parse_args()
+
+    runs = [load(path) for path in args.results]
+    cases = [case for case in runs[0][1] if not args.case or case in args.case]
+    names = ["%s (%s)" % (config, path) if [c for c, _ in runs].count(config) > 1 else config
+             for (config, _), path in zip(runs, args.results)]
+
+    width = max([len("case")] + [len(case) for case in cases])
+    columns = [max(len(name), 18) for name in names]
+    out = sys.stdout
+    out.write("%-*s" % (width, "case"))
+    for name, column in zip(names, columns):
+        out.write("  %*s" % (column, name))
+    out.write("\n")
+    for case in cases:
+        base = runs[0][1].get(case)
+        out.write("%-*s" % (width, case))
+        for (_, results), column in zip(runs, columns):
+            value = results.get(case)
+            if value is None:
+                cell = "-"
+            elif base and results is not runs[0][1]:
+                cell = "%.1f %6.2fx" % (value, value / base)
+            else:
+                cell = "%.1f" % value
+            out.write("  %*s" % (column, cell))
+        out.write("\n")
+
+
+if __name__ == "__main__":
+    main()
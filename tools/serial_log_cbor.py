@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""
+Convert CBOR serial_log records (SERIAL_LOG_FORMAT_CBOR) to JSON lines.
+
+Each record is a CBOR map behind the self-describe tag 55799, whose three
+bytes D9 D9 F7 are used to find the next record after garbage or a cut. A
+record holding these bytes in a field is taken for a cut one and skipped.
+
+Usage:
+    serial_log_cbor.py capture.bin
+    cat /dev/ttyUSB0 | serial_log_cbor.py -
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+CBOR_SYNC = b"\xd9\xd9\xf7"
+
+KEY_LEVEL = 0
+KEY_TICK = 1
+KEY_TAG = 2
+KEY_MESSAGE = 3
+KEY_FIELDS = 4
+KEY_TIME_US = 5
+
+LEVEL_LETTER = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+
+
+class Incomplete(Exception):
+    """The item runs past the end of the data read so far."""
+
+
+class Malformed(Exception):
+    """The data is not a CBOR item this library writes."""
+
+
+def decode_item(data, off=0):
+    """Decode one CBOR item at off, return (value, end offset)."""
+    if off >= len(data):
+        raise Incomplete
+    initial = data[off]
+    major, info = initial >> 5, initial & 0x1F
+    off += 1
+
+    if major == 7:
+        if info == 20:
+            return False, off
+        if info == 21:
+            return True, off
+        if info == 22:
+            return None, off
+        sizes = {25: (2, ">e"), 26: (4, ">f"), 27: (8, ">d")}
+        if info not in sizes:
+            raise Malformed("simple value %d" % info)
+        size, code = sizes[info]
+        if off + size > len(data):
+            raise Incomplete
+        return struct.unpack_from(code, data, off)[0], off + size
+
+    # Argument of the head, big endian in 0, 1, 2, 4 or 8 bytes
+    if info < 24:
+        value = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        if off + size > len(data):
+            raise Incomplete
+        value = int.from_bytes(data[off:off + size], "big")
+        off += size
+    else:
+        raise Malformed("indefinite length")
+
+    if major == 0:
+        return value, off
+    if major == 1:
+        return -1 - value, off
+    if major in (2, 3):
+        if off + value > len(data):
+            raise Incomplete
+        raw = data[off:off + value]
+        off += value
+        return (bytes(raw) if major == 2 else raw.decode("utf-8", "replace")), off
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, off = decode_item(data, off)
+            items.append(item)
+        return items, off
+    if major == 5:
+        items = {}
+        for _ in range(value):
+            key, off = decode_item(data, off)
+            item, off = decode_item(data, off)
+            if isinstance(key, (dict, list)):
+                raise Malformed("map key")
+            items[key] = item
+        return items, off
+    if major == 6:
+        return decode_item(data, off)
+    raise Malformed("major type %d" % major)
+
+
+def decode_fields(data):
+    """Decode the fields map of a binary record with the KV flag."""
+    try:
+        fields, _ = decode_item(data)
+    except (Incomplete, Malformed):
+        return None
+    return fields if isinstance(fields, dict) else None
+
+
+def json_value(value):
+    """Byte strings as hex, JSON has no bytes."""
+    if isinstance(value, bytes):
+        return value.hex()
+    if isinstance(value, dict):
+        return {key: json_value(item) for key, item in value.items()}
+    if isinstance(value, list):
+        return [json_value(item) for item in value]
+    return value
+
+
+def to_json(record):
+    """Map a decoded record onto JSON names."""
+    out = {"level": LEVEL_LETTER.get(record.get(KEY_LEVEL), str(record.get(KEY_LEVEL)))}
+    if KEY_TIME_US in record:
+        out["time_us"] = record[KEY_TIME_US]
+    if KEY_TICK in record:
+        out["tick"] = record[KEY_TICK]
+    out["tag"] = record.get(KEY_TAG)
+    out["message"] = record.get(KEY_MESSAGE)
+    if KEY_FIELDS in record:
+        out["fields"] = json_value(record[KEY_FIELDS])
+    return out
+
+
+def decode_records(stream):
+    """Yield every record in the stream as a dict with integer keys."""
+    buf = b""
+    done = False
+    while not done:
+        chunk = stream.read(4096)
+        done = not chunk
+        buf += chunk
+        while True:
+            start = buf.find(CBOR_SYNC)
+            if start < 0:
+                # Keep a possible start of the sync bytes
+                buf = buf[-(len(CBOR_SYNC) - 1):]
+                break
+            buf = buf[start:]
+            try:
+                record, end = decode_item(buf, len(CBOR_SYNC))
+            except Incomplete:
+                if not done:
+                    break
+                # A record cut at the end of the stream, look for another
+                buf = buf[1:]
+                continue
+            except Malformed:
+                buf = buf[1:]
+                continue
+            if not isinstance(record, dict) or KEY_LEVEL not in record or KEY_TAG not in record:
+                buf = buf[1:]
+                continue
+            if buf.find(CBOR_SYNC, len(CBOR_SYNC), end) >= 0:
+                # A cut record ran into the next one
+                buf = buf[1:]
+                continue
+            buf = buf[end:]
+            yield record
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="captured CBOR stream, '-' for stdin")
+    args = parser.parse_args()
+
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    for record in decode_records(stream):
+        print(json.dumps(to_json(record), ensure_ascii=False), flush=True)
+
+
+if __name__ == "__main__":
+    main()
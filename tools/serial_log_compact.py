@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""
+Turn records of the compact layout (USE_LOG_COMPACT) back into the usual one,
+so the other tools and terminals take them as they are.
+
+A compact record is "I 1f4 tag: message". The timestamp is hex, "+" in front
+of it marks the difference to the record before (LOG_COMPACT_DELTA), which is
+added up here. One record in LOG_COMPACT_RESYNC is stamped with the time
+instead, and the differences are added up from it again, so records a sink
+filtered or dropped shift the times only until then. Tags written as "#" and
+a 16 bit hash (LOG_COMPACT_TAG_ID) are looked up among the tags given with
+--tags, or among the strings of the firmware with --elf. A hash two strings
+share is left as it is. Lines that are not compact records pass through
+unchanged.
+
+Usage:
+    serial_log_compact.py capture.txt
+    cat /dev/ttyUSB0 | serial_log_compact.py - --elf firmware.elf --time-us
+"""
+
+import argparse
+import re
+import sys
+
+LEVEL_COLOR = {b"E": b"31", b"W": b"33", b"I": b"37", b"D": b"32", b"V": b"34"}
+RESET_COLOR = b"\x1b[0m"
+
+RECORD = re.compile(rb"([EWIDV]) (\+?)([0-9a-f]{1,16}) (#[0-9a-f]{4}|[^\r\n\x1b:]{1,64}): ([^\r\n]*)\r?\n?")
+TAG_CANDIDATE = re.compile(rb"[\x21-\x39\x3b-\x7e]{1,64}")
+
+
+def tag_id(tag):
+    """FNV-1a of the tag folded to 16 bits, as log_tag_text computes it."""
+    value = 2166136261
+    for byte in tag:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return (value >> 16) ^ (value & 0xFFFF)
+
+
+class TagNames:
+    """Tag of each id. Ids of more than one candidate are kept as they are."""
+
+    def __init__(self):
+        self.names = {}
+        self.shared = set()
+
+    def add(self, tag, preferred=False):
+        key = tag_id(tag)
+        if preferred:
+            self.names[key] = tag
+            self.shared.discard(key)
+        elif key not in self.names:
+            self.names[key] = tag
+        elif self.names[key] != tag:
+            self.shared.add(key)
+
+    def get(self, text):
+        key = int(text[1:], 16)
+        if key in self.shared or key not in self.names:
+            return text
+        return self.names[key]
+
+
+def elf_tags(path, names):
+    """Every string of the allocated sections that could be a tag."""
+    from serial_log_decode import StringTable
+
+    for _, data in StringTable(path).sections:
+        for string in data.split(b"\0"):
+            if TAG_CANDIDATE.fullmatch(string):
+                names.add(string)
+
+
+def expand(line, names, state, time_us):
+    """Usual layout of a compact record, None for other lines."""
+    m = RECORD.fullmatch(line)
+    if not m:
+        return None
+    letter, delta, stamp, tag, message = m.groups()
+    value = int(stamp, 16)
+    if delta:
+        state["time"] = (state["time"] + value) & 0xFFFFFFFF
+        value = state["time"]
+    else:
+        # The differences after a record stamped with the time add up from it
+        state["time"] = value & 0xFFFFFFFF
+    if tag.startswith(b"#"):
+        tag = names.get(tag)
+    if time_us:
+        stamp = b"%d.%06d" % (value // 1000000, value % 1000000)
+    else:
+        stamp = b"%d" % value
+    return b"\x1b[0;%sm%s (%s) %s: %s%s\r\n" % (LEVEL_COLOR[letter], letter, stamp, tag, message, RESET_COLOR)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="captured compact records, '-' for stdin")
+    parser.add_argument("--tags", help="file with one tag per line, for tag ids")
+    parser.add_argument("--elf", help="firmware ELF file, its strings are taken as tags for tag ids")
+    parser.add_argument("--time-us", action="store_true",
+                        help="timestamps are microseconds (serial_log_time_us_set), output them as seconds")
+    args = parser.parse_args()
+
+    names = TagNames()
+    if args.elf:
+        elf_tags(args.elf, names)
+    if args.tags:
+        with open(args.tags, "rb") as f:
+            for tag in f.read().split():
+                names.add(tag, preferred=True)
+
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    out = sys.stdout.buffer
+    state = {"time": 0}
+    for line in stream:
+        record = expand(line, names, state, args.time_us)
+        out.write(line if record is None else record)
+        if args.input == "-":
+            out.flush()
+    out.flush()
+
+
+if __name__ == "__main__":
+    main()
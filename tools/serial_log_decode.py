@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+"""
+Decode binary serial_log records (USE_LOG_BINARY) back into text.
+
+Records do not carry any string, only the address of the format string and
+of the tag. Both are looked up in the ELF file of the firmware that produced
+the stream.
+
+Usage:
+    serial_log_decode.py firmware.elf capture.bin
+    cat /dev/ttyUSB0 | serial_log_decode.py firmware.elf -
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+from serial_log_cbor import decode_fields
+from serial_log_payload import LOG_PAYLOAD_SYNC, Incomplete, parse_frame
+
+LOG_BINARY_SYNC = 0xA5
+LOG_BINARY_HEADER = struct.Struct("<BBHIII")
+LOG_BINARY_LEVEL_US = 0x80
+LOG_BINARY_LEVEL_KV = 0x40
+
+LEVEL_LETTER = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+LEVEL_COLOR = {1: "31", 2: "33", 3: "37", 4: "32", 5: "34"}
+
+SYNC = re.compile(b"[%c%c]" % (LOG_BINARY_SYNC, LOG_PAYLOAD_SYNC))
+CONVERSION = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|j|z|t|L)?([diuxXoscpfFeEgGaA%])")
+
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+
+class StringTable:
+    """Read NUL terminated strings from the allocated sections of an ELF file."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            elf = f.read()
+        if elf[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is64 = elf[4] == 2
+        endian = "<" if elf[5] == 1 else ">"
+        self.long_size = 8 if is64 else 4
+
+        # Section header table location from the ELF header
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", elf, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", elf, 0x3A)
+            section = struct.Struct(endian + "IIQQQQ")
+        else:
+            shoff, = struct.unpack_from(endian + "I", elf, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", elf, 0x2E)
+            section = struct.Struct(endian + "IIIIII")
+
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, sh_flags, sh_addr, sh_offset, sh_size = section.unpack_from(elf, shoff + i * shentsize)
+            if sh_flags & SHF_ALLOC and sh_type != SHT_NOBITS and sh_size:
+                self.sections.append((sh_addr, elf[sh_offset:sh_offset + sh_size]))
+        self.cache = {}
+
+    def get(self, addr):
+        if addr in self.cache:
+            return self.cache[addr]
+        text = None
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                end = data.find(b"\0", addr - base)
+                text = data[addr - base:end].decode("utf-8", "replace")
+                break
+        self.cache[addr] = text
+        return text
+
+
+def render(fmt, args, long_size):
+    """Expand a C format string using raw little-endian argument bytes."""
+    out = []
+    pos = 0
+    off = 0
+
+    def take(size, code):
+        nonlocal off
+        if off + size > len(args):
+            raise IndexError
+        value = struct.unpack_from("<" + code, args, off)[0]
+        off += size
+        return value
+
+    for m in CONVERSION.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        try:
+            if width == "*":
+                width = str(take(4, "i"))
+            if precision == "*":
+                precision = str(take(4, "i"))
+            spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+
+            if conv in "diuxXoc":
+                if length in ("ll", "j"):
+                    value = take(8, "q")
+                elif length in ("l", "z", "t"):
+                    value = take(long_size, "q" if long_size == 8 else "i")
+                else:
+                    value = take(4, "i")
+                if conv == "u" or conv in "xXo":
+                    bits = 64 if length in ("ll", "j") or (length in ("l", "z", "t") and long_size == 8) else 32
+                    value &= (1 << bits) - 1
+                    conv = "d" if conv == "u" else conv
+                if conv == "c":
+                    value = chr(value & 0xFF)
+                out.append((spec + ("i" if conv == "i" else conv)) % value)
+            elif conv == "p":
+                out.append("0x%x" % take(4, "I"))
+            elif conv in "fFeEgGaA":
+                value = take(8, "d")
+                out.append((spec + conv.replace("a", "e").replace("A", "E")) % value)
+            elif conv == "s":
+                n = take(1, "B")
+                if off + n > len(args):
+                    raise IndexError
+                out.append((spec + "s") % args[off:off + n].decode("utf-8", "replace"))
+                off += n
+        except IndexError:
+            out.append("<?>")
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def render_fields(message, args):
+    """Message of a structured record followed by its fields as key=value."""
+    fields = decode_fields(args)
+    if fields is None:
+        return message + " <?>"
+    out = [message]
+    for key, value in fields.items():
+        if isinstance(value, bool):
+            value = "true" if value else "false"
+        elif isinstance(value, bytes):
+            value = value.hex()
+        elif isinstance(value, str):
+            value = json.dumps(value, ensure_ascii=False)
+        out.append("%s=%s" % (key, value))
+    return " ".join(out)
+
+
+def decode_records(stream, strings):
+    """Yield (level, stamp, tag, message) for every record in the stream."""
+    buf = b""
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        buf += chunk
+        while True:
+            m = SYNC.search(buf)
+            if not m:
+                buf = b""
+                break
+            buf = buf[m.start():]
+            if buf[0] == LOG_PAYLOAD_SYNC:
+                # Payload frames are skipped, serial_log_payload.py extracts them
+                try:
+                    frame = parse_frame(buf)
+                except Incomplete:
+                    break
+                buf = buf[frame[-1]:] if frame else buf[1:]
+                continue
+            if len(buf) < LOG_BINARY_HEADER.size:
+                break
+            _, level, args_len, timestamp, fmt_addr, tag_addr = LOG_BINARY_HEADER.unpack_from(buf)
+            kv = level & LOG_BINARY_LEVEL_KV
+            level &= ~LOG_BINARY_LEVEL_KV
+            if level & LOG_BINARY_LEVEL_US:
+                # Low 32 bits of the time in microseconds
+                level &= ~LOG_BINARY_LEVEL_US
+                stamp = "%d.%06d" % divmod(timestamp, 1000000)
+            else:
+                stamp = "%d" % timestamp
+            fmt = strings.get(fmt_addr)
+            if level not in LEVEL_LETTER or fmt is None:
+                # Not a record header, resync on the next sync byte
+                buf = buf[1:]
+                continue
+            end = LOG_BINARY_HEADER.size + args_len
+            if len(buf) < end:
+                break
+            args = buf[LOG_BINARY_HEADER.size:end]
+            buf = buf[end:]
+            tag = strings.get(tag_addr) or "0x%08x" % tag_addr
+            if kv:
+                # Structured record, the format is a plain message and the
+                # arguments a CBOR map of fields
+                yield level, stamp, tag, render_fields(fmt, args)
+            else:
+                yield level, stamp, tag, render(fmt, args, strings.long_size)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="firmware ELF file with the format strings")
+    parser.add_argument("input", help="captured binary stream, '-' for stdin")
+    parser.add_argument("--color", action="store_true", help="colorize output like LOG_FORMAT")
+    args = parser.parse_args()
+
+    strings = StringTable(args.elf)
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    for level, stamp, tag, message in decode_records(stream, strings):
+        line = "%s (%s) %s: %s" % (LEVEL_LETTER[level], stamp, tag, message)
+        if args.color:
+            line = "\033[0;%sm%s\033[0m" % (LEVEL_COLOR[level], line)
+        print(line, flush=True)
+
+
+if __name__ == "__main__":
+    main()
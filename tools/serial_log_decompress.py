@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""
+Decompress the output of a serial_log sink with compression enabled
+(USE_LOG_COMPRESS) back into the plain log stream.
+
+The stream is a sequence of frames: a sync byte, a 15 bit payload length with
+a history reset flag in the top bit, and LZ4 style sequences referring to the
+previous output. Decoding starts at the first frame with the reset flag, and
+starts over at the next one after a damaged frame.
+
+Usage:
+    serial_log_decompress.py capture.lz > capture.txt
+    cat /dev/ttyUSB0 | serial_log_decompress.py - | serial_log_decode.py firmware.elf -
+"""
+
+import argparse
+import sys
+
+LOG_COMPRESS_SYNC = 0x5A
+LOG_COMPRESS_FRAME_HEADER = 3
+LOG_COMPRESS_MIN_MATCH = 4
+
+# Window of the largest configuration, the decoder needs at least the one the
+# target was built with
+HISTORY_SIZE = 32768
+
+
+class FrameError(Exception):
+    pass
+
+
+def read_length(payload, pos, length):
+    """Add the extension bytes of a 4 bit length field."""
+    if length < 15:
+        return length, pos
+    while True:
+        if pos >= len(payload):
+            raise FrameError("truncated length")
+        byte = payload[pos]
+        pos += 1
+        length += byte
+        if byte != 255:
+            return length, pos
+
+
+def decode_frame(payload, history):
+    """Decode one frame payload, appending the output to history."""
+    out_start = len(history)
+    pos = 0
+    while pos < len(payload):
+        token = payload[pos]
+        pos += 1
+        literal_len, pos = read_length(payload, pos, token >> 4)
+        if pos + literal_len > len(payload):
+            raise FrameError("truncated literals")
+        history += payload[pos:pos + literal_len]
+        pos += literal_len
+        if pos == len(payload):
+            # Last sequence, literals only
+            break
+        if pos + 2 > len(payload):
+            raise FrameError("truncated offset")
+        offset = payload[pos] | (payload[pos + 1] << 8)
+        pos += 2
+        match_len, pos = read_length(payload, pos, token & 0xF)
+        match_len += LOG_COMPRESS_MIN_MATCH
+        if offset == 0 or offset > len(history):
+            raise FrameError("offset out of history")
+        # Byte by byte, the match may overlap the bytes it produces
+        src = len(history) - offset
+        for i in range(match_len):
+            history.append(history[src + i])
+    return bytes(history[out_start:])
+
+
+def decompress(stream):
+    """Yield decompressed data, frame by frame."""
+    buf = b""
+    history = None
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        buf += chunk
+        while True:
+            start = buf.find(bytes([LOG_COMPRESS_SYNC]))
+            if start < 0:
+                buf = b""
+                break
+            buf = buf[start:]
+            if len(buf) < LOG_COMPRESS_FRAME_HEADER:
+                break
+            length = buf[1] | ((buf[2] & 0x7F) << 8)
+            reset = bool(buf[2] & 0x80)
+            end = LOG_COMPRESS_FRAME_HEADER + length
+            if len(buf) < end:
+                break
+            payload = buf[LOG_COMPRESS_FRAME_HEADER:end]
+
+            if reset:
+                history = bytearray()
+            if history is None:
+                # Not in sync, wait for a frame which starts a new history
+                buf = buf[1:]
+                continue
+            try:
+                data = decode_frame(payload, history)
+            except FrameError:
+                history = None
+                buf = buf[1:]
+                continue
+            buf = buf[end:]
+            if len(history) > 2 * HISTORY_SIZE:
+                del history[:len(history) - HISTORY_SIZE]
+            yield data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="captured compressed stream, '-' for stdin")
+    args = parser.parse_args()
+
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    for data in decompress(stream):
+        sys.stdout.buffer.write(data)
+        sys.stdout.buffer.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Report the ROM and RAM serial_log takes in each configuration.
+
+serial_log.c is compiled once per configuration with the given compiler and
+flags, and the sections of the object file are summed: ROM is code and
+constant data, RAM is initialized and zeroed data. Stacks, and the heap used
+by tag entries and FreeRTOS objects without USE_LOG_STATIC, are not counted.
+
+Usage:
+    serial_log_footprint.py
+    serial_log_footprint.py --cc arm-none-eabi-gcc --cflags="-mcpu=cortex-m4 -mthumb -Os"
+    serial_log_footprint.py --config="-DUSE_LOG_STATIC -DLOG_BUF_SIZE=128"
+"""
+
+import argparse
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+
+# Configurations built on any host, RTOS ones need --cflags with its include paths
+CONFIGS = [
+    ("minimal", ""),
+    ("static", "-DUSE_LOG_STATIC"),
+    ("formatter", "-DUSE_LOG_FORMATTER -DUSE_LOG_STATIC"),
+    ("binary", "-DUSE_LOG_BINARY -DUSE_LOG_STATIC"),
+    ("stats", "-DUSE_LOG_STATS -DUSE_LOG_STATIC"),
+    ("compress", "-DUSE_LOG_COMPRESS -DUSE_LOG_STATIC"),
+    ("async", "-DUSE_LOG_ASYNC -DUSE_LOG_STATIC"),
+    ("dma", "-DUSE_LOG_DMA -DUSE_LOG_STATIC"),
+    ("compact", "-DUSE_LOG_COMPACT -DLOG_COMPACT_DELTA -DLOG_COMPACT_TAG_ID -DUSE_LOG_STATIC"),
+    ("small", "-DUSE_LOG_FORMATTER -DUSE_LOG_STATIC -DLOG_BUF_SIZE=128 -DBYTES_PER_LINE=8 "
+              "-DTAG_CACHE_SIZE=8 -DTAG_HASH_SIZE=8 -DLOG_BUF_POOL_SIZE=2 -DLOG_SINK_MAX=2 "
+              "-DLOG_TAG_POOL_SIZE=256"),
+]
+
+ROM_SECTIONS = (".text", ".rodata")
+RAM_SECTIONS = (".data", ".bss", ".tbss", ".tdata", "COMMON")
+
+
+def section_sizes(objdump, obj):
+    """Sum section sizes by kind from objdump -h."""
+    out = subprocess.run([objdump, "-h", obj], check=True, capture_output=True, text=True).stdout
+    rom = ram = 0
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) < 3 or not parts[0].isdigit():
+            continue
+        name, size = parts[1], int(parts[2], 16)
+        if name.startswith(ROM_SECTIONS):
+            rom += size
+        elif name.startswith(RAM_SECTIONS):
+            ram += size
+        if name.startswith(".data"):
+            # Initial values are kept in ROM too
+            rom += size
+    return rom, ram
+
+
+def tool_for(cc, name):
+    """objdump of the same toolchain, arm-none-eabi-gcc gives arm-none-eabi-objdump."""
+    base = os.path.basename(cc)
+    for suffix in ("gcc", "clang", "cc"):
+        if base.endswith(suffix):
+            return os.path.join(os.path.dirname(cc), base[:-len(suffix)] + name)
+    return name
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--cc", default="cc", help="C compiler, default cc")
+    parser.add_argument("--cflags", default="-Os", help="flags for every configuration, default -Os")
+    parser.add_argument("--config", action="append", help="defines of a configuration to build instead of the built-in list")
+    parser.add_argument("--source", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "serial_log.c"),
+                        help="path to serial_log.c")
+    args = parser.parse_args()
+
+    configs = [("#%d" % (i + 1), c) for i, c in enumerate(args.config)] if args.config else CONFIGS
+    source = os.path.abspath(args.source)
+    objdump = tool_for(args.cc, "objdump")
+
+    print("%-10s %8s %8s  %s" % ("config", "ROM", "RAM", "defines"))
+    failed = False
+    with tempfile.TemporaryDirectory() as tmp:
+        obj = os.path.join(tmp, "serial_log.o")
+        for name, defines in configs:
+            cmd = [args.cc] + shlex.split(args.cflags) + shlex.split(defines)
+            cmd += ["-I", os.path.dirname(source), "-c", source, "-o", obj]
+            result = subprocess.run(cmd, capture_output=True, text=True)
+            if result.returncode:
+                print("%-10s %8s %8s  %s" % (name[:10], "-", "-", defines))
+                sys.stderr.write(result.stderr)
+                failed = True
+                continue
+            rom, ram = section_sizes(objdump, obj)
+            print("%-10s %8d %8d  %s" % (name[:10], rom, ram, defines))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,392 @@
+#!/usr/bin/env python3
+"""
+Index and query large captures of serial_log text records.
+
+Records are found by their header, color, level letter, timestamp and tag,
+wherever it starts, so bytes damaged on the wire only cost the records they
+hit. A record whose line end was lost stops at the next header.
+
+The capture is mapped and split at line ends between worker processes. The
+index is kept next to the capture (capture.log.idx) and holds, for each tag
+and level, the numbers of its records, and the time range of each block of
+records. It is extended when the capture has grown since.
+
+Times are given as they appear in the records, ticks or seconds with
+microseconds.
+
+Usage:
+    serial_log_index.py index capture.log
+    serial_log_index.py query capture.log --tag 'net.*' --level W --since 120 --until 180
+    serial_log_index.py query capture.log --grep 'timeout' --follow
+    serial_log_index.py stats capture.log
+"""
+
+import argparse
+import fnmatch
+import heapq
+import mmap
+import multiprocessing
+import os
+import re
+import struct
+import sys
+import time
+import zlib
+from array import array
+
+LEVEL_LETTER = "EWIDV"
+LEVEL_NUMBER = {b"E": 1, b"W": 2, b"I": 3, b"D": 4, b"V": 5}
+
+# Header, then the message up to the line end or the next header
+RECORD = re.compile(
+    rb"(?:\x1b\[[0-9;]*m)?([EWIDV]) \((\d+)(?:\.(\d{6}))?\) ([^\r\n\x1b:]{1,64}): "
+    rb"([^\n\x1b]*(?:\x1b(?!\[[0-9;]*m[EWIDV] \(\d)[^\n\x1b]*)*)\n?")
+COLOR = re.compile(rb"\x1b\[[0-9;]*m")
+RESET_COLOR = b"\x1b[0m"
+
+INDEX_MAGIC = b"SLIX"
+INDEX_VERSION = 1
+INDEX_HEADER = struct.Struct("<4sIQQIII")
+HEAD_CRC_SIZE = 4096
+BLOCK_SHIFT = 12
+CHUNK_MIN = 1 << 22
+
+
+def record_time(whole, fraction):
+    """Timestamp in millionths of the unit printed, ticks or seconds."""
+    return int(whole) * 1000000 + (int(fraction) if fraction else 0)
+
+
+def message(m):
+    """Message of a record without the color reset and line end."""
+    text = m.group(5).rstrip(b"\r")
+    return text[:-len(RESET_COLOR)] if text.endswith(RESET_COLOR) else text
+
+
+def parse_time(text):
+    return int(round(float(text) * 1000000))
+
+
+def scan(data, start, end):
+    """Find the records in data[start:end], returns offsets, lengths, times,
+    postings per (tag, level) of record numbers from 0, and garbage bytes."""
+    offsets = array("Q")
+    lengths = array("I")
+    times = array("q")
+    postings = {}
+    matched = 0
+    for m in RECORD.finditer(data, start, end):
+        letter, whole, fraction, tag, _ = m.groups()
+        record_start, record_end = m.span()
+        key = (tag, LEVEL_NUMBER[letter])
+        entry = postings.get(key)
+        if entry is None:
+            entry = postings[key] = array("I")
+        entry.append(len(offsets))
+        offsets.append(record_start)
+        lengths.append(record_end - record_start)
+        times.append(record_time(whole, fraction))
+        matched += record_end - record_start
+    return offsets, lengths, times, postings, (end - start) - matched
+
+
+def scan_worker(job):
+    path, start, end = job
+    with open(path, "rb") as f, mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+        return scan(mm, start, end)
+
+
+def head_crc(mm, indexed):
+    """CRC of the start of the capture, to tell a new capture from a grown one."""
+    return zlib.crc32(mm[:min(HEAD_CRC_SIZE, indexed)])
+
+
+class Index:
+    """Records of a capture: offset, length and time, postings and time blocks."""
+
+    def __init__(self):
+        self.indexed = 0
+        self.garbage = 0
+        self.crc = 0
+        self.offsets = array("Q")
+        self.lengths = array("I")
+        self.times = array("q")
+        self.postings = {}
+        self.block_min = array("q")
+        self.block_max = array("q")
+
+    def append(self, offsets, lengths, times, postings, garbage):
+        base = len(self.offsets)
+        self.offsets.extend(offsets)
+        self.lengths.extend(lengths)
+        self.times.extend(times)
+        for key, numbers in postings.items():
+            entry = self.postings.get(key)
+            if entry is None:
+                entry = self.postings[key] = array("I")
+            entry.extend(map(base.__add__, numbers))
+        self.garbage += garbage
+        self.update_blocks(base)
+
+    def update_blocks(self, first):
+        """Time range of every block from the one holding record first."""
+        block = first >> BLOCK_SHIFT
+        del self.block_min[block:]
+        del self.block_max[block:]
+        for start in range(block << BLOCK_SHIFT, len(self.times), 1 << BLOCK_SHIFT):
+            chunk = self.times[start:start + (1 << BLOCK_SHIFT)]
+            self.block_min.append(min(chunk))
+            self.block_max.append(max(chunk))
+
+    def save(self, path):
+        tags = sorted({tag for tag, _ in self.postings})
+        tag_ids = {tag: i for i, tag in enumerate(tags)}
+        tmp = path + ".tmp"
+        with open(tmp, "wb") as f:
+            f.write(INDEX_HEADER.pack(INDEX_MAGIC, INDEX_VERSION, self.indexed, self.garbage,
+                                      self.crc, len(self.offsets), len(tags)))
+            for tag in tags:
+                f.write(struct.pack("<H", len(tag)) + tag)
+            for values in (self.offsets, self.lengths, self.times):
+                values.tofile(f)
+            f.write(struct.pack("<I", len(self.postings)))
+            for (tag, level), numbers in self.postings.items():
+                f.write(struct.pack("<IBI", tag_ids[tag], level, len(numbers)))
+                numbers.tofile(f)
+        os.replace(tmp, path)
+
+    @classmethod
+    def load(cls, path):
+        index = cls()
+        with open(path, "rb") as f:
+            header = f.read(INDEX_HEADER.size)
+            if len(header) < INDEX_HEADER.size:
+                return None
+            magic, version, index.indexed, index.garbage, index.crc, count, tag_count = INDEX_HEADER.unpack(header)
+            if magic != INDEX_MAGIC or version != INDEX_VERSION:
+                return None
+            tags = []
+            for _ in range(tag_count):
+                size, = struct.unpack("<H", f.read(2))
+                tags.append(f.read(size))
+            for values in (index.offsets, index.lengths, index.times):
+                values.fromfile(f, count)
+            lists, = struct.unpack("<I", f.read(4))
+            for _ in range(lists):
+                tag, level, size = struct.unpack("<IBI", f.read(9))
+                numbers = array("I")
+                numbers.fromfile(f, size)
+                index.postings[(tags[tag], level)] = numbers
+        index.update_blocks(0)
+        return index
+
+
+def split(mm, start, end, jobs):
+    """Ranges of about equal size ending at line ends."""
+    size = max(CHUNK_MIN, (end - start) // jobs + 1)
+    ranges = []
+    while start < end:
+        cut = start + size
+        if cut >= end:
+            cut = end
+        else:
+            line_end = mm.find(b"\n", cut, end)
+            cut = end if line_end < 0 else line_end + 1
+        ranges.append((start, cut))
+        start = cut
+    return ranges
+
+
+def build(path, jobs, quiet=False):
+    """Load the index of a capture, extended or rebuilt to its last line end."""
+    index_path = path + ".idx"
+    with open(path, "rb") as f:
+        if os.fstat(f.fileno()).st_size == 0:
+            return Index()
+        with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+            index = Index.load(index_path) if os.path.exists(index_path) else None
+            if index is None or index.indexed > len(mm) or index.crc != head_crc(mm, index.indexed):
+                # A new capture, or one written over
+                index = Index()
+            end = mm.rfind(b"\n") + 1
+            if end <= index.indexed:
+                return index
+
+            started = time.time()
+            ranges = split(mm, index.indexed, end, jobs)
+            if len(ranges) > 1 and jobs > 1:
+                with multiprocessing.Pool(min(jobs, len(ranges))) as pool:
+                    results = pool.map(scan_worker, [(path, a, b) for a, b in ranges])
+            else:
+                results = [scan(mm, a, b) for a, b in ranges]
+            before = len(index.offsets)
+            for result in results:
+                index.append(*result)
+            index.indexed = end
+            index.crc = head_crc(mm, end)
+            if not quiet:
+                sys.stderr.write("indexed %d records in %d MB, %.1f s\n" % (
+                    len(index.offsets) - before, (end - ranges[0][0]) >> 20, time.time() - started))
+    try:
+        index.save(index_path)
+    except OSError as e:
+        sys.stderr.write("index not saved: %s\n" % e)
+    return index
+
+
+class Query:
+    """Record filter on tag pattern, most verbose level, time range and regex."""
+
+    def __init__(self, args):
+        self.tags = args.tag
+        self.level = LEVEL_LETTER.index(args.level) + 1 if args.level else 5
+        self.since = parse_time(args.since) if args.since is not None else None
+        self.until = parse_time(args.until) if args.until is not None else None
+        self.grep = re.compile(args.grep.encode()) if args.grep else None
+
+    def tag_match(self, tag):
+        if not self.tags:
+            return True
+        text = tag.decode("utf-8", "replace")
+        return any(fnmatch.fnmatchcase(text, pattern) for pattern in self.tags)
+
+    def time_match(self, value):
+        return (self.since is None or value >= self.since) and (self.until is None or value <= self.until)
+
+    def match(self, m):
+        """For records scanned while following."""
+        return (LEVEL_NUMBER[m.group(1)] <= self.level and self.tag_match(m.group(4)) and
+                self.time_match(record_time(m.group(2), m.group(3))) and
+                (self.grep is None or self.grep.search(message(m))))
+
+    def candidates(self, index):
+        """Record numbers in capture order, from the postings of the tags and
+        levels asked for, skipping blocks outside the time range."""
+        lists = [numbers for (tag, level), numbers in index.postings.items()
+                 if level <= self.level and self.tag_match(tag)]
+        if len(lists) == len(index.postings):
+            numbers = range(len(index.offsets))
+        elif len(lists) == 1:
+            numbers = lists[0]
+        else:
+            numbers = heapq.merge(*lists)
+        if self.since is None and self.until is None:
+            return numbers
+        return self.time_filter(index, numbers)
+
+    def time_filter(self, index, numbers):
+        skip = -1
+        for number in numbers:
+            block = number >> BLOCK_SHIFT
+            if block == skip:
+                continue
+            if ((self.since is not None and index.block_max[block] < self.since) or
+                    (self.until is not None and index.block_min[block] > self.until)):
+                skip = block
+                continue
+            if self.time_match(index.times[number]):
+                yield number
+
+
+def output(record, color):
+    record = record.rstrip(b"\r\n")
+    if not color:
+        record = COLOR.sub(b"", record)
+    sys.stdout.buffer.write(record + b"\n")
+
+
+def query(args):
+    index = build(args.capture, args.jobs, quiet=True)
+    q = Query(args)
+    count = 0
+    with open(args.capture, "rb") as f:
+        if index.offsets:
+            with mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ) as mm:
+                for number in q.candidates(index):
+                    offset = index.offsets[number]
+                    record = mm[offset:offset + index.lengths[number]]
+                    if q.grep:
+                        m = RECORD.match(record)
+                        if not m or not q.grep.search(message(m)):
+                            continue
+                    count += 1
+                    if not args.count:
+                        output(record, args.color)
+        if args.count:
+            print(count)
+        if args.follow:
+            follow(f, index.indexed, q, args.color)
+
+
+def follow(f, pos, q, color):
+    """Print matching records as the capture grows, like tail -f."""
+    try:
+        while True:
+            size = os.fstat(f.fileno()).st_size
+            if size < pos:
+                # Capture truncated, start over
+                pos = 0
+            if size == pos:
+                time.sleep(0.2)
+                continue
+            f.seek(pos)
+            data = f.read(size - pos)
+            end = data.rfind(b"\n") + 1
+            if end == 0:
+                time.sleep(0.2)
+                continue
+            for m in RECORD.finditer(data, 0, end):
+                if q.match(m):
+                    output(m.group(0), color)
+            sys.stdout.flush()
+            pos += end
+    except KeyboardInterrupt:
+        pass
+
+
+def stats(args):
+    index = build(args.capture, args.jobs, quiet=True)
+    counts = {}
+    for (tag, level), numbers in index.postings.items():
+        counts.setdefault(tag, [0] * 5)[level - 1] += len(numbers)
+    print("%-24s %8s %8s %8s %8s %8s" % (("tag",) + tuple(LEVEL_LETTER)))
+    for tag in sorted(counts):
+        print("%-24s %8d %8d %8d %8d %8d" % ((tag.decode("utf-8", "replace"),) + tuple(counts[tag])))
+    if index.times:
+        print("records %d, time %g to %g, garbage %d bytes" % (
+            len(index.offsets), min(index.block_min) / 1e6, max(index.block_max) / 1e6, index.garbage))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1, help="worker processes, default one per CPU")
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    command = commands.add_parser("index", help="build or extend the index")
+    command.add_argument("capture")
+
+    command = commands.add_parser("query", help="print matching records")
+    command.add_argument("capture")
+    command.add_argument("--tag", action="append", help="tag or glob pattern, repeatable")
+    command.add_argument("--level", choices=list(LEVEL_LETTER), help="most verbose level")
+    command.add_argument("--since", help="first time")
+    command.add_argument("--until", help="last time")
+    command.add_argument("--grep", help="regular expression on the message")
+    command.add_argument("--count", action="store_true", help="print the number of records only")
+    command.add_argument("--color", action="store_true", help="keep the ANSI colors")
+    command.add_argument("--follow", "-f", action="store_true", help="keep printing records as the capture grows")
+
+    command = commands.add_parser("stats", help="records per tag and level")
+    command.add_argument("capture")
+
+    args = parser.parse_args()
+    if args.command == "index":
+        build(args.capture, args.jobs)
+    elif args.command == "query":
+        query(args)
+    else:
+        stats(args)
+
+
+if __name__ == "__main__":
+    main()
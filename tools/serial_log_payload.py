@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""
+Extract the payloads written with serial_log_payload to files.
+
+Binary and CBOR sinks carry payloads in frames: a sync byte 0xA6, a 20 byte
+header, the tag, a chunk of the payload and a CRC-32 of all of it. Text sinks
+carry them in records whose message is "@id offset/total crc base64". Chunks
+are put back together by tag and payload id. Chunks failing their CRC are
+left out, and so is any payload missing a chunk.
+
+Usage:
+    serial_log_payload.py capture.bin -o payloads
+    cat /dev/ttyUSB0 | serial_log_payload.py - -o payloads
+"""
+
+import argparse
+import base64
+import binascii
+import os
+import re
+import struct
+import sys
+import zlib
+
+LOG_PAYLOAD_SYNC = 0xA6
+LOG_PAYLOAD_HEADER = struct.Struct("<BBBBHHIII")
+LOG_PAYLOAD_CRC = struct.Struct("<I")
+LOG_PAYLOAD_TAG_MAX = 32
+LOG_BINARY_LEVEL_US = 0x80
+
+LEVEL_LETTER = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+
+TEXT_CHUNK = re.compile(
+    rb"([EWIDV]) \((\d+(?:\.\d{6})?)\) ([^\r\n\x1b:]{1,64}): @(\d+) (\d+)/(\d+) ([0-9a-f]{8}) ([A-Za-z0-9+/]*={0,2})")
+
+
+class Incomplete(Exception):
+    """The frame runs past the end of the data read so far."""
+
+
+def parse_frame(data, off=0):
+    """Frame at off as (tag, id, offset, total, level, chunk, end), None when
+    there is no valid frame there."""
+    if len(data) - off < LOG_PAYLOAD_HEADER.size:
+        raise Incomplete
+    sync, level, tag_len, reserved, pid, chunk_len, offset, total, _ = LOG_PAYLOAD_HEADER.unpack_from(data, off)
+    if (sync != LOG_PAYLOAD_SYNC or reserved or tag_len > LOG_PAYLOAD_TAG_MAX or
+            (level & ~LOG_BINARY_LEVEL_US) not in LEVEL_LETTER or offset + chunk_len > total):
+        return None
+    tag_start = off + LOG_PAYLOAD_HEADER.size
+    chunk_start = tag_start + tag_len
+    end = chunk_start + chunk_len + LOG_PAYLOAD_CRC.size
+    if len(data) < end:
+        raise Incomplete
+    crc, = LOG_PAYLOAD_CRC.unpack_from(data, end - LOG_PAYLOAD_CRC.size)
+    if zlib.crc32(data[off:end - LOG_PAYLOAD_CRC.size]) != crc:
+        return None
+    tag = bytes(data[tag_start:chunk_start]).decode("utf-8", "replace")
+    return tag, pid, offset, total, level & ~LOG_BINARY_LEVEL_US, bytes(data[chunk_start:end - LOG_PAYLOAD_CRC.size]), end
+
+
+class Payload:
+    def __init__(self, tag, pid, total, level):
+        self.tag = tag
+        self.pid = pid
+        self.total = total
+        self.level = level
+        self.chunks = {}
+
+    def received(self):
+        return sum(len(chunk) for chunk in self.chunks.values())
+
+    def data(self):
+        """The payload, or None while a chunk is missing."""
+        out = bytearray()
+        for offset in sorted(self.chunks):
+            if offset != len(out):
+                return None
+            out += self.chunks[offset]
+        return bytes(out) if len(out) == self.total else None
+
+
+class Collector:
+    """Chunks put back together by tag and payload id, in the order seen."""
+
+    def __init__(self):
+        self.open = {}
+        self.payloads = []
+        self.crc_errors = 0
+
+    def add(self, tag, pid, offset, total, level, chunk):
+        key = (tag, pid)
+        payload = self.open.get(key)
+        if payload is not None and (payload.total != total or offset in payload.chunks):
+            # The payload id came round again
+            payload = None
+        if payload is None:
+            payload = self.open[key] = Payload(tag, pid, total, level)
+            self.payloads.append(payload)
+        payload.chunks[offset] = chunk
+
+
+def scan_frames(data, collector):
+    """Frames anywhere in the data, a frame failing its CRC resyncs on the next sync byte."""
+    pos = data.find(bytes([LOG_PAYLOAD_SYNC]))
+    while pos >= 0:
+        try:
+            frame = parse_frame(data, pos)
+        except Incomplete:
+            break
+        if frame is None:
+            pos = data.find(bytes([LOG_PAYLOAD_SYNC]), pos + 1)
+            continue
+        tag, pid, offset, total, level, chunk, end = frame
+        collector.add(tag, pid, offset, total, level, chunk)
+        pos = data.find(bytes([LOG_PAYLOAD_SYNC]), end)
+
+
+def scan_text(data, collector):
+    """Base64 records of text sinks."""
+    for m in TEXT_CHUNK.finditer(data):
+        letter, _, tag, pid, offset, total, crc, text = m.groups()
+        try:
+            chunk = base64.b64decode(text, validate=True)
+        except binascii.Error:
+            collector.crc_errors += 1
+            continue
+        if zlib.crc32(chunk) != int(crc, 16) or int(offset) + len(chunk) > int(total):
+            collector.crc_errors += 1
+            continue
+        level = next(number for number, value in LEVEL_LETTER.items() if value == letter.decode())
+        collector.add(tag.decode("utf-8", "replace"), int(pid), int(offset), int(total), level, chunk)
+
+
+def file_name(directory, payload, used):
+    """tag-id.bin, with characters unfit for a file name replaced."""
+    base = re.sub(r"[^A-Za-z0-9._-]", "_", payload.tag) + "-%d" % payload.pid
+    name = base + ".bin"
+    count = 1
+    while name in used:
+        count += 1
+        name = "%s.%d.bin" % (base, count)
+    used.add(name)
+    return os.path.join(directory, name)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="captured stream, binary or text, '-' for stdin")
+    parser.add_argument("-o", "--output", default=".", help="directory for the payload files")
+    args = parser.parse_args()
+
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    data = stream.read()
+    collector = Collector()
+    scan_frames(data, collector)
+    scan_text(data, collector)
+
+    os.makedirs(args.output, exist_ok=True)
+    used = set()
+    incomplete = 0
+    for payload in collector.payloads:
+        content = payload.data()
+        if content is None:
+            incomplete += 1
+            print("%s %s #%d: %d of %d bytes, incomplete" % (
+                LEVEL_LETTER[payload.level], payload.tag, payload.pid, payload.received(), payload.total))
+            continue
+        path = file_name(args.output, payload, used)
+        with open(path, "wb") as f:
+            f.write(content)
+        print("%s %s #%d: %d bytes -> %s" % (LEVEL_LETTER[payload.level], payload.tag, payload.pid, payload.total, path))
+    if collector.crc_errors:
+        print("%d text chunks failed their CRC" % collector.crc_errors)
+    return 1 if incomplete or collector.crc_errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())